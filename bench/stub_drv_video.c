@@ -0,0 +1,1267 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * In-memory VA driver used in place of i965_drv_video/pvr_drv_video when
+ * benchmarking the wrapper. It is built twice, once per backend name, and
+ * hands out IDs from the same object heap offsets as the real driver, so the
+ * two backends return overlapping IDs just like on hardware.
+ *
+ * The behaviour is tuned with environment variables, where NAME is the
+ * upper-case backend name (I965 or PVR):
+ *
+ *   STUB_NAME_INIT_MS       sleep in __vaDriverInit_0_32
+ *   STUB_NAME_INIT_KB       memory __vaDriverInit_0_32 allocates and touches,
+ *                           held until vaTerminate
+ *   STUB_NAME_CALL_NS       busy-wait on every entry point
+ *   STUB_NAME_DECODE_US     time a frame takes to decode, frames are decoded
+ *                           one after another like on a single video engine,
+ *                           and reading one another driver has not finished
+ *                           decoding is counted in early_reads
+ *   STUB_NAME_END_PICTURE_US  block vaEndPicture for this long
+ *   STUB_NAME_PROFILES      comma separated profile numbers to advertise
+ */
+
+#define _GNU_SOURCE
+#include <va/va.h>
+#include <va/va_backend.h>
+#include <va/va_dec_vp8.h>
+#include <va/va_vpp.h>
+#include <va/va_drmcommon.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "stub_drv_video.h"
+
+#define DLL_EXPORT __attribute__((visibility("default")))
+
+#ifndef STUB_NAME
+#define STUB_NAME "i965"
+#endif
+
+#ifdef STUB_PVR
+#define CONFIG_ID_OFFSET	0x01000000
+#define CONTEXT_ID_OFFSET	0x02000000
+#define SURFACE_ID_OFFSET	0x03000000
+#define BUFFER_ID_OFFSET	0x04000000
+#define IMAGE_ID_OFFSET		0x05000000
+#define SUBPIC_ID_OFFSET	0x06000000
+#else
+#define CONFIG_ID_OFFSET	0x01000000
+#define CONTEXT_ID_OFFSET	0x02000000
+#define SURFACE_ID_OFFSET	0x04000000
+#define BUFFER_ID_OFFSET	0x08000000
+#define IMAGE_ID_OFFSET		0x0a000000
+#define SUBPIC_ID_OFFSET	0x10000000
+#endif
+
+#define STUB_MAX_OBJECTS	4096
+#define STUB_MAX_PROFILES	32
+
+struct stub_config {
+    int used;
+    VAProfile profile;
+    VAEntrypoint entrypoint;
+};
+
+struct stub_context {
+    int used;
+    VAConfigID config_id;
+    VASurfaceID render_target;
+};
+
+struct stub_surface {
+    int used;
+    int width;
+    int height;
+    unsigned int pitch;
+    size_t size;
+    void *data;
+    int fd;             /* memfd backing data, -1 for imported user memory */
+    int owns_data;
+    uint64_t ready_ns;  /* monotonic time the last decode completes */
+};
+
+struct stub_buffer {
+    int used;
+    VABufferType type;
+    unsigned int size;
+    unsigned int num_elements;
+    void *data;
+    int owns_data;
+    int fd;
+};
+
+struct stub_image {
+    int used;
+    VAImage image;
+};
+
+struct stub_driver_data {
+    pthread_mutex_t lock;
+    struct stub_config configs[STUB_MAX_OBJECTS];
+    struct stub_context contexts[STUB_MAX_OBJECTS];
+    struct stub_surface surfaces[STUB_MAX_OBJECTS];
+    struct stub_buffer buffers[STUB_MAX_OBJECTS];
+    struct stub_image images[STUB_MAX_OBJECTS];
+    int subpictures[STUB_MAX_OBJECTS];
+    VAProfile profiles[STUB_MAX_PROFILES];
+    int num_profiles;
+    uint64_t call_ns;
+    uint64_t decode_ns;
+    uint64_t end_picture_ns;
+    uint64_t engine_idle_ns;    /* monotonic time the queued decodes complete */
+    void *init_data;            /* STUB_NAME_INIT_KB */
+    size_t init_size;
+};
+
+static struct stub_stats stub_stats;
+
+DLL_EXPORT struct stub_stats *
+stub_drv_get_stats(void)
+{
+    return &stub_stats;
+}
+
+#define STUB_DATA(ctx)	((struct stub_driver_data *)(ctx)->pDriverData)
+#define STUB_COUNT(name)	__sync_fetch_and_add(&stub_stats.name, 1)
+
+static uint64_t
+stub_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+stub_sleep_ns(uint64_t ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000ull;
+    ts.tv_nsec = ns % 1000000000ull;
+    while (nanosleep(&ts, &ts) && errno == EINTR)
+        ;
+}
+
+static void
+stub_spin(struct stub_driver_data *stub)
+{
+    uint64_t end;
+
+    STUB_COUNT(calls);
+    if (!stub->call_ns)
+        return;
+
+    end = stub_now_ns() + stub->call_ns;
+    while (stub_now_ns() < end)
+        ;
+}
+
+/* A decode stamps the time it completes into the first bytes of the surface,
+ * which the drivers sharing the surface memory see as it being written
+ * until then. A driver orders the reads of its own decodes itself.
+ */
+static void
+stub_surface_read(struct stub_driver_data *stub, struct stub_surface *surface)
+{
+    uint64_t stamp = __atomic_load_n((uint64_t *)surface->data, __ATOMIC_ACQUIRE);
+    uint64_t ready_ns;
+
+    pthread_mutex_lock(&stub->lock);
+    ready_ns = surface->ready_ns;
+    pthread_mutex_unlock(&stub->lock);
+
+    if (stamp != ready_ns && stamp > stub_now_ns())
+        STUB_COUNT(early_reads);
+}
+
+static uint64_t
+stub_getenv_u64(const char *suffix, uint64_t def)
+{
+    char name[64];
+    const char *value;
+    int i;
+
+    snprintf(name, sizeof(name), "STUB_%s_%s", STUB_NAME, suffix);
+    for (i = 0; name[i]; i++)
+        name[i] = toupper((unsigned char)name[i]);
+
+    value = getenv(name);
+    return value ? strtoull(value, NULL, 0) : def;
+}
+
+#define STUB_ALLOC(stub, array, offset, id_out)	\
+    ({	\
+        int __i, __found = 0;	\
+        for (__i = 0; __i < STUB_MAX_OBJECTS; __i++) {	\
+            if (!(stub)->array[__i].used) {	\
+                memset(&(stub)->array[__i], 0, sizeof((stub)->array[__i]));	\
+                (stub)->array[__i].used = 1;	\
+                *(id_out) = (offset) + __i;	\
+                __found = 1;	\
+                break;	\
+            }	\
+        }	\
+        __found ? &(stub)->array[__i] : NULL;	\
+    })
+
+/* Every object struct starts with its "used" flag */
+static void *
+stub_lookup(void *array, size_t size, unsigned int offset, unsigned int id)
+{
+    int *obj;
+
+    if (id < offset || id >= offset + STUB_MAX_OBJECTS)
+        return NULL;
+
+    obj = (int *)((char *)array + (size_t)(id - offset) * size);
+    return *obj ? obj : NULL;
+}
+
+#define STUB_LOOKUP(stub, array, offset, id)	\
+    ((__typeof__(&(stub)->array[0]))stub_lookup((stub)->array, sizeof((stub)->array[0]), offset, id))
+
+static VAStatus
+stub_Terminate(VADriverContextP ctx)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    int i;
+
+    for (i = 0; i < STUB_MAX_OBJECTS; i++) {
+        struct stub_surface *surface = &stub->surfaces[i];
+        struct stub_buffer *buffer = &stub->buffers[i];
+
+        if (surface->used && surface->owns_data)
+            munmap(surface->data, surface->size);
+        if (surface->used && surface->fd >= 0)
+            close(surface->fd);
+        if (buffer->used && buffer->owns_data)
+            free(buffer->data);
+    }
+
+    if (stub->init_data)
+        munmap(stub->init_data, stub->init_size);
+    pthread_mutex_destroy(&stub->lock);
+    free(stub);
+    ctx->pDriverData = NULL;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_QueryConfigProfiles(VADriverContextP ctx, VAProfile *profile_list, int *num_profiles)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+
+    STUB_COUNT(query_config);
+    memcpy(profile_list, stub->profiles, stub->num_profiles * sizeof(*profile_list));
+    *num_profiles = stub->num_profiles;
+    return VA_STATUS_SUCCESS;
+}
+
+static int
+stub_has_profile(struct stub_driver_data *stub, VAProfile profile)
+{
+    int i;
+
+    for (i = 0; i < stub->num_profiles; i++) {
+        if (stub->profiles[i] == profile)
+            return 1;
+    }
+    return 0;
+}
+
+static VAStatus
+stub_QueryConfigEntrypoints(VADriverContextP ctx, VAProfile profile,
+                            VAEntrypoint *entrypoint_list, int *num_entrypoints)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+
+    STUB_COUNT(query_config);
+    if (!stub_has_profile(stub, profile))
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+
+    /* Like i965, VAProfileNone is video processing only */
+    entrypoint_list[0] = profile == VAProfileNone ? VAEntrypointVideoProc : VAEntrypointVLD;
+    *num_entrypoints = 1;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_GetConfigAttributes(VADriverContextP ctx, VAProfile profile, VAEntrypoint entrypoint,
+                         VAConfigAttrib *attrib_list, int num_attribs)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    int i;
+
+    STUB_COUNT(query_config);
+    if (!stub_has_profile(stub, profile))
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+    if (entrypoint != (profile == VAProfileNone ? VAEntrypointVideoProc : VAEntrypointVLD))
+        return VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT;
+
+    for (i = 0; i < num_attribs; i++) {
+        if (attrib_list[i].type == VAConfigAttribRTFormat)
+            attrib_list[i].value = VA_RT_FORMAT_YUV420;
+        else
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_CreateConfig(VADriverContextP ctx, VAProfile profile, VAEntrypoint entrypoint,
+                  VAConfigAttrib *attrib_list, int num_attribs, VAConfigID *config_id)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_config *config;
+
+    stub_spin(stub);
+    if (!stub_has_profile(stub, profile))
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+
+    pthread_mutex_lock(&stub->lock);
+    config = STUB_ALLOC(stub, configs, CONFIG_ID_OFFSET, config_id);
+    if (config) {
+        config->profile = profile;
+        config->entrypoint = entrypoint;
+    }
+    pthread_mutex_unlock(&stub->lock);
+
+    return config ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+}
+
+static VAStatus
+stub_DestroyConfig(VADriverContextP ctx, VAConfigID config_id)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_config *config;
+
+    stub_spin(stub);
+    pthread_mutex_lock(&stub->lock);
+    config = STUB_LOOKUP(stub, configs, CONFIG_ID_OFFSET, config_id);
+    if (config)
+        config->used = 0;
+    pthread_mutex_unlock(&stub->lock);
+
+    return config ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_CONFIG;
+}
+
+static VAStatus
+stub_QueryConfigAttributes(VADriverContextP ctx, VAConfigID config_id, VAProfile *profile,
+                           VAEntrypoint *entrypoint, VAConfigAttrib *attrib_list, int *num_attribs)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_config *config = STUB_LOOKUP(stub, configs, CONFIG_ID_OFFSET, config_id);
+
+    stub_spin(stub);
+    if (!config)
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+
+    *profile = config->profile;
+    *entrypoint = config->entrypoint;
+    attrib_list[0].type = VAConfigAttribRTFormat;
+    attrib_list[0].value = VA_RT_FORMAT_YUV420;
+    *num_attribs = 1;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_surface_init(struct stub_surface *surface, unsigned int width, unsigned int height,
+                  VASurfaceAttribExternalBuffers *desc, int mem_type)
+{
+    surface->width = width;
+    surface->height = height;
+    surface->pitch = desc && desc->pitches[0] ? desc->pitches[0] : (width + 63) & ~63;
+    surface->size = surface->pitch * ((height + 31) & ~31) * 3 / 2;
+    surface->fd = -1;
+
+    if (desc && desc->buffers && mem_type == VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR) {
+        surface->data = (void *)(uintptr_t)desc->buffers[0];
+        return VA_STATUS_SUCCESS;
+    }
+
+    if (desc && desc->buffers && mem_type == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME) {
+        surface->fd = dup((int)desc->buffers[0]);
+        surface->data = mmap(NULL, surface->size, PROT_READ | PROT_WRITE, MAP_SHARED, surface->fd, 0);
+        if (surface->data == MAP_FAILED) {
+            close(surface->fd);
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+        }
+        surface->owns_data = 1;
+        STUB_COUNT(prime_imports);
+        return VA_STATUS_SUCCESS;
+    }
+
+    /* Back every surface by a memfd so that it can be exported as a PRIME fd */
+    surface->fd = syscall(SYS_memfd_create, "stub-surface", 0);
+    if (surface->fd < 0 || ftruncate(surface->fd, surface->size))
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    surface->data = mmap(NULL, surface->size, PROT_READ | PROT_WRITE, MAP_SHARED, surface->fd, 0);
+    if (surface->data == MAP_FAILED)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    surface->owns_data = 1;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_CreateSurfaces2(VADriverContextP ctx, unsigned int format, unsigned int width, unsigned int height,
+                     VASurfaceID *surfaces, unsigned int num_surfaces,
+                     VASurfaceAttrib *attrib_list, unsigned int num_attribs)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    VASurfaceAttribExternalBuffers *desc = NULL;
+    int mem_type = VA_SURFACE_ATTRIB_MEM_TYPE_VA;
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    unsigned int i;
+
+    stub_spin(stub);
+    STUB_COUNT(create_surfaces);
+
+    for (i = 0; i < num_attribs; i++) {
+        if (attrib_list[i].type == VASurfaceAttribMemoryType)
+            mem_type = attrib_list[i].value.value.i;
+        else if (attrib_list[i].type == VASurfaceAttribExternalBufferDescriptor)
+            desc = attrib_list[i].value.value.p;
+    }
+
+    pthread_mutex_lock(&stub->lock);
+    for (i = 0; i < num_surfaces && vaStatus == VA_STATUS_SUCCESS; i++) {
+        struct stub_surface *surface = STUB_ALLOC(stub, surfaces, SURFACE_ID_OFFSET, &surfaces[i]);
+
+        if (!surface) {
+            vaStatus = VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+            break;
+        }
+        vaStatus = stub_surface_init(surface, width, height, desc, mem_type);
+        if (vaStatus != VA_STATUS_SUCCESS)
+            surface->used = 0;
+    }
+    pthread_mutex_unlock(&stub->lock);
+
+    return vaStatus;
+}
+
+static VAStatus
+stub_CreateSurfaces(VADriverContextP ctx, int width, int height, int format,
+                    int num_surfaces, VASurfaceID *surfaces)
+{
+    return stub_CreateSurfaces2(ctx, format, width, height, surfaces, num_surfaces, NULL, 0);
+}
+
+static VAStatus
+stub_DestroySurfaces(VADriverContextP ctx, VASurfaceID *surface_list, int num_surfaces)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    int i;
+
+    stub_spin(stub);
+    STUB_COUNT(destroy_surfaces);
+
+    pthread_mutex_lock(&stub->lock);
+    for (i = 0; i < num_surfaces; i++) {
+        struct stub_surface *surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, surface_list[i]);
+
+        if (!surface) {
+            vaStatus = VA_STATUS_ERROR_INVALID_SURFACE;
+            continue;
+        }
+        if (surface->owns_data)
+            munmap(surface->data, surface->size);
+        if (surface->fd >= 0)
+            close(surface->fd);
+        surface->used = 0;
+    }
+    pthread_mutex_unlock(&stub->lock);
+
+    return vaStatus;
+}
+
+static VAStatus
+stub_CreateContext(VADriverContextP ctx, VAConfigID config_id, int picture_width, int picture_height,
+                   int flag, VASurfaceID *render_targets, int num_render_targets, VAContextID *context)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_context *obj_context;
+    int i;
+
+    stub_spin(stub);
+    if (!STUB_LOOKUP(stub, configs, CONFIG_ID_OFFSET, config_id))
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+    for (i = 0; i < num_render_targets; i++) {
+        if (!STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, render_targets[i]))
+            return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+
+    pthread_mutex_lock(&stub->lock);
+    obj_context = STUB_ALLOC(stub, contexts, CONTEXT_ID_OFFSET, context);
+    if (obj_context) {
+        obj_context->config_id = config_id;
+        obj_context->render_target = VA_INVALID_SURFACE;
+    }
+    pthread_mutex_unlock(&stub->lock);
+
+    return obj_context ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+}
+
+static VAStatus
+stub_DestroyContext(VADriverContextP ctx, VAContextID context)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_context *obj_context;
+
+    stub_spin(stub);
+    pthread_mutex_lock(&stub->lock);
+    obj_context = STUB_LOOKUP(stub, contexts, CONTEXT_ID_OFFSET, context);
+    if (obj_context)
+        obj_context->used = 0;
+    pthread_mutex_unlock(&stub->lock);
+
+    return obj_context ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_CONTEXT;
+}
+
+static VAStatus
+stub_CreateBuffer(VADriverContextP ctx, VAContextID context, VABufferType type, unsigned int size,
+                  unsigned int num_elements, void *data, VABufferID *buf_id)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_buffer *buffer;
+    void *storage;
+
+    stub_spin(stub);
+    STUB_COUNT(create_buffer);
+    if (!STUB_LOOKUP(stub, contexts, CONTEXT_ID_OFFSET, context))
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+
+    storage = calloc(num_elements, size);
+    if (!storage)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    if (data)
+        memcpy(storage, data, (size_t)size * num_elements);
+
+    pthread_mutex_lock(&stub->lock);
+    buffer = STUB_ALLOC(stub, buffers, BUFFER_ID_OFFSET, buf_id);
+    if (buffer) {
+        buffer->type = type;
+        buffer->size = size;
+        buffer->num_elements = num_elements;
+        buffer->data = storage;
+        buffer->owns_data = 1;
+        buffer->fd = -1;
+    }
+    pthread_mutex_unlock(&stub->lock);
+
+    if (!buffer) {
+        free(storage);
+        return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_BufferSetNumElements(VADriverContextP ctx, VABufferID buf_id, unsigned int num_elements)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_buffer *buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buf_id);
+
+    stub_spin(stub);
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    if (num_elements > buffer->num_elements)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    buffer->num_elements = num_elements;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_BufferInfo(VADriverContextP ctx, VABufferID buf_id, VABufferType *type,
+                unsigned int *size, unsigned int *num_elements)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_buffer *buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buf_id);
+
+    stub_spin(stub);
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    *type = buffer->type;
+    *size = buffer->size;
+    *num_elements = buffer->num_elements;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_MapBuffer(VADriverContextP ctx, VABufferID buf_id, void **pbuf)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_buffer *buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buf_id);
+
+    stub_spin(stub);
+    STUB_COUNT(map_buffer);
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    *pbuf = buffer->data;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_UnmapBuffer(VADriverContextP ctx, VABufferID buf_id)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_buffer *buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buf_id);
+
+    stub_spin(stub);
+    STUB_COUNT(unmap_buffer);
+    return buffer ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_BUFFER;
+}
+
+static VAStatus
+stub_DestroyBuffer(VADriverContextP ctx, VABufferID buffer_id)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_buffer *buffer;
+
+    stub_spin(stub);
+    pthread_mutex_lock(&stub->lock);
+    buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buffer_id);
+    if (buffer) {
+        if (buffer->owns_data)
+            free(buffer->data);
+        buffer->used = 0;
+    }
+    pthread_mutex_unlock(&stub->lock);
+
+    return buffer ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_BUFFER;
+}
+
+static VAStatus
+stub_BeginPicture(VADriverContextP ctx, VAContextID context, VASurfaceID render_target)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_context *obj_context = STUB_LOOKUP(stub, contexts, CONTEXT_ID_OFFSET, context);
+
+    stub_spin(stub);
+    STUB_COUNT(begin_picture);
+    if (!obj_context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    if (!STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, render_target))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    obj_context->render_target = render_target;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_RenderPicture(VADriverContextP ctx, VAContextID context, VABufferID *buffers, int num_buffers)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_context *obj_context = STUB_LOOKUP(stub, contexts, CONTEXT_ID_OFFSET, context);
+    struct stub_config *config;
+    int i;
+
+    stub_spin(stub);
+    STUB_COUNT(render_picture);
+    if (!obj_context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+
+    config = STUB_LOOKUP(stub, configs, CONFIG_ID_OFFSET, obj_context->config_id);
+    for (i = 0; i < num_buffers; i++) {
+        struct stub_buffer *buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buffers[i]);
+
+        if (!buffer)
+            return VA_STATUS_ERROR_INVALID_BUFFER;
+
+        /* VP8 reference frames must be surface IDs of this driver */
+        if (config && config->profile == VAProfileVP8Version0_3 &&
+            buffer->type == VAPictureParameterBufferType &&
+            buffer->size >= sizeof(VAPictureParameterBufferVP8)) {
+            const VAPictureParameterBufferVP8 *pic_param = buffer->data;
+            const VASurfaceID refs[3] = {
+                pic_param->last_ref_frame,
+                pic_param->golden_ref_frame,
+                pic_param->alt_ref_frame,
+            };
+            int j;
+
+            for (j = 0; j < 3; j++) {
+                if (refs[j] != VA_INVALID_SURFACE &&
+                    !STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, refs[j]))
+                    STUB_COUNT(bad_references);
+            }
+        }
+
+        /* A pipeline reads its input and references right away */
+        if (buffer->type == VAProcPipelineParameterBufferType &&
+            buffer->size >= sizeof(VAProcPipelineParameterBuffer)) {
+            const VAProcPipelineParameterBuffer *pipeline = buffer->data;
+            struct stub_surface *surface;
+            unsigned int j;
+
+            if ((surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, pipeline->surface)))
+                stub_surface_read(stub, surface);
+            for (j = 0; pipeline->forward_references && j < pipeline->num_forward_references; j++) {
+                if ((surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, pipeline->forward_references[j])))
+                    stub_surface_read(stub, surface);
+            }
+            for (j = 0; pipeline->backward_references && j < pipeline->num_backward_references; j++) {
+                if ((surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, pipeline->backward_references[j])))
+                    stub_surface_read(stub, surface);
+            }
+        }
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_EndPicture(VADriverContextP ctx, VAContextID context)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_context *obj_context = STUB_LOOKUP(stub, contexts, CONTEXT_ID_OFFSET, context);
+    struct stub_surface *surface;
+
+    stub_spin(stub);
+    STUB_COUNT(end_picture);
+    if (!obj_context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+
+    if (stub->end_picture_ns)
+        stub_sleep_ns(stub->end_picture_ns);
+
+    surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, obj_context->render_target);
+    if (surface) {
+        uint64_t now = stub_now_ns();
+
+        /* The frame starts once the ones queued before it are done */
+        pthread_mutex_lock(&stub->lock);
+        if (stub->engine_idle_ns < now)
+            stub->engine_idle_ns = now;
+        stub->engine_idle_ns += stub->decode_ns;
+        surface->ready_ns = stub->engine_idle_ns;
+        __atomic_store_n((uint64_t *)surface->data, surface->ready_ns, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&stub->lock);
+    }
+    obj_context->render_target = VA_INVALID_SURFACE;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_SyncSurface(VADriverContextP ctx, VASurfaceID render_target)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_surface *surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, render_target);
+    uint64_t now;
+
+    stub_spin(stub);
+    STUB_COUNT(sync_surface);
+    if (!surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    now = stub_now_ns();
+    if (surface->ready_ns > now)
+        stub_sleep_ns(surface->ready_ns - now);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_QuerySurfaceStatus(VADriverContextP ctx, VASurfaceID render_target, VASurfaceStatus *status)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_surface *surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, render_target);
+
+    stub_spin(stub);
+    STUB_COUNT(query_surface_status);
+    if (!surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    *status = surface->ready_ns > stub_now_ns() ? VASurfaceRendering : VASurfaceReady;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_PutSurface(VADriverContextP ctx, VASurfaceID surface, void *draw,
+                short srcx, short srcy, unsigned short srcw, unsigned short srch,
+                short destx, short desty, unsigned short destw, unsigned short desth,
+                VARectangle *cliprects, unsigned int number_cliprects, unsigned int flags)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_surface *obj_surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, surface);
+
+    stub_spin(stub);
+    STUB_COUNT(put_surface);
+    if (!obj_surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    stub_surface_read(stub, obj_surface);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_QueryImageFormats(VADriverContextP ctx, VAImageFormat *format_list, int *num_formats)
+{
+    memset(&format_list[0], 0, sizeof(format_list[0]));
+    format_list[0].fourcc = VA_FOURCC_NV12;
+    format_list[0].bits_per_pixel = 12;
+    *num_formats = 1;
+    return VA_STATUS_SUCCESS;
+}
+
+static struct stub_image *
+stub_image_alloc(struct stub_driver_data *stub, int width, int height, unsigned int pitch,
+                 void *data, int fd, VAImage *out_image)
+{
+    struct stub_image *obj_image;
+    struct stub_buffer *buffer;
+    VAImageID image_id;
+    VABufferID buf_id;
+
+    obj_image = STUB_ALLOC(stub, images, IMAGE_ID_OFFSET, &image_id);
+    if (!obj_image)
+        return NULL;
+
+    buffer = STUB_ALLOC(stub, buffers, BUFFER_ID_OFFSET, &buf_id);
+    if (!buffer) {
+        obj_image->used = 0;
+        return NULL;
+    }
+
+    memset(&obj_image->image, 0, sizeof(obj_image->image));
+    obj_image->image.image_id = image_id;
+    obj_image->image.buf = buf_id;
+    obj_image->image.format.fourcc = VA_FOURCC_NV12;
+    obj_image->image.format.bits_per_pixel = 12;
+    obj_image->image.width = width;
+    obj_image->image.height = height;
+    obj_image->image.num_planes = 2;
+    obj_image->image.pitches[0] = pitch;
+    obj_image->image.pitches[1] = pitch;
+    obj_image->image.offsets[0] = 0;
+    obj_image->image.offsets[1] = pitch * ((height + 31) & ~31);
+    obj_image->image.data_size = obj_image->image.offsets[1] * 3 / 2;
+
+    buffer->type = VAImageBufferType;
+    buffer->size = obj_image->image.data_size;
+    buffer->num_elements = 1;
+    buffer->fd = fd;
+    if (data) {
+        buffer->data = data;
+    } else {
+        buffer->data = calloc(1, buffer->size);
+        buffer->owns_data = 1;
+    }
+
+    *out_image = obj_image->image;
+    return obj_image;
+}
+
+static VAStatus
+stub_CreateImage(VADriverContextP ctx, VAImageFormat *format, int width, int height, VAImage *image)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_image *obj_image;
+
+    stub_spin(stub);
+    pthread_mutex_lock(&stub->lock);
+    obj_image = stub_image_alloc(stub, width, height, (width + 63) & ~63, NULL, -1, image);
+    pthread_mutex_unlock(&stub->lock);
+
+    return obj_image ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+}
+
+static VAStatus
+stub_DeriveImage(VADriverContextP ctx, VASurfaceID surface_id, VAImage *image)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_surface *surface;
+    struct stub_image *obj_image = NULL;
+
+    stub_spin(stub);
+    STUB_COUNT(derive_image);
+    pthread_mutex_lock(&stub->lock);
+    surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, surface_id);
+    if (surface)
+        obj_image = stub_image_alloc(stub, surface->width, surface->height, surface->pitch,
+                                     surface->data, surface->fd, image);
+    pthread_mutex_unlock(&stub->lock);
+
+    if (!surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    stub_surface_read(stub, surface);
+    return obj_image ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+}
+
+static VAStatus
+stub_DestroyImage(VADriverContextP ctx, VAImageID image)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_image *obj_image;
+
+    stub_spin(stub);
+    pthread_mutex_lock(&stub->lock);
+    obj_image = STUB_LOOKUP(stub, images, IMAGE_ID_OFFSET, image);
+    if (obj_image) {
+        struct stub_buffer *buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, obj_image->image.buf);
+
+        if (buffer) {
+            if (buffer->owns_data)
+                free(buffer->data);
+            buffer->used = 0;
+        }
+        obj_image->used = 0;
+    }
+    pthread_mutex_unlock(&stub->lock);
+
+    return obj_image ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_IMAGE;
+}
+
+static VAStatus
+stub_SetImagePalette(VADriverContextP ctx, VAImageID image, unsigned char *palette)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static VAStatus
+stub_GetImage(VADriverContextP ctx, VASurfaceID surface, int x, int y,
+              unsigned int width, unsigned int height, VAImageID image)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_surface *obj_surface = STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, surface);
+
+    stub_spin(stub);
+    STUB_COUNT(get_image);
+    if (!obj_surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    if (!STUB_LOOKUP(stub, images, IMAGE_ID_OFFSET, image))
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+    stub_surface_read(stub, obj_surface);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_PutImage(VADriverContextP ctx, VASurfaceID surface, VAImageID image,
+              int src_x, int src_y, unsigned int src_width, unsigned int src_height,
+              int dest_x, int dest_y, unsigned int dest_width, unsigned int dest_height)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+
+    stub_spin(stub);
+    if (!STUB_LOOKUP(stub, surfaces, SURFACE_ID_OFFSET, surface))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    if (!STUB_LOOKUP(stub, images, IMAGE_ID_OFFSET, image))
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_QuerySubpictureFormats(VADriverContextP ctx, VAImageFormat *format_list,
+                            unsigned int *flags, unsigned int *num_formats)
+{
+    *num_formats = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_CreateSubpicture(VADriverContextP ctx, VAImageID image, VASubpictureID *subpicture)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    int i;
+
+    stub_spin(stub);
+    if (!STUB_LOOKUP(stub, images, IMAGE_ID_OFFSET, image))
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+
+    pthread_mutex_lock(&stub->lock);
+    for (i = 0; i < STUB_MAX_OBJECTS && stub->subpictures[i]; i++)
+        ;
+    if (i < STUB_MAX_OBJECTS)
+        stub->subpictures[i] = 1;
+    pthread_mutex_unlock(&stub->lock);
+
+    if (i == STUB_MAX_OBJECTS)
+        return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+    *subpicture = SUBPIC_ID_OFFSET + i;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_DestroySubpicture(VADriverContextP ctx, VASubpictureID subpicture)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    unsigned int i = subpicture - SUBPIC_ID_OFFSET;
+
+    if (i >= STUB_MAX_OBJECTS || !stub->subpictures[i])
+        return VA_STATUS_ERROR_INVALID_SUBPICTURE;
+    stub->subpictures[i] = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_SetSubpictureImage(VADriverContextP ctx, VASubpictureID subpicture, VAImageID image)
+{
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_SetSubpictureChromakey(VADriverContextP ctx, VASubpictureID subpicture,
+                            unsigned int chromakey_min, unsigned int chromakey_max,
+                            unsigned int chromakey_mask)
+{
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_SetSubpictureGlobalAlpha(VADriverContextP ctx, VASubpictureID subpicture, float global_alpha)
+{
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_AssociateSubpicture(VADriverContextP ctx, VASubpictureID subpicture,
+                         VASurfaceID *target_surfaces, int num_surfaces,
+                         short src_x, short src_y, unsigned short src_width, unsigned short src_height,
+                         short dest_x, short dest_y, unsigned short dest_width, unsigned short dest_height,
+                         unsigned int flags)
+{
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_DeassociateSubpicture(VADriverContextP ctx, VASubpictureID subpicture,
+                           VASurfaceID *target_surfaces, int num_surfaces)
+{
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_QueryDisplayAttributes(VADriverContextP ctx, VADisplayAttribute *attr_list, int *num_attributes)
+{
+    *num_attributes = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_GetDisplayAttributes(VADriverContextP ctx, VADisplayAttribute *attr_list, int num_attributes)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static VAStatus
+stub_SetDisplayAttributes(VADriverContextP ctx, VADisplayAttribute *attr_list, int num_attributes)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static VAStatus
+stub_LockSurface(VADriverContextP ctx, VASurfaceID surface, unsigned int *fourcc,
+                 unsigned int *luma_stride, unsigned int *chroma_u_stride, unsigned int *chroma_v_stride,
+                 unsigned int *luma_offset, unsigned int *chroma_u_offset, unsigned int *chroma_v_offset,
+                 unsigned int *buffer_name, void **buffer)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static VAStatus
+stub_UnlockSurface(VADriverContextP ctx, VASurfaceID surface)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static VAStatus
+stub_AcquireBufferHandle(VADriverContextP ctx, VABufferID buf_id, VABufferInfo *buf_info)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+    struct stub_buffer *buffer = STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buf_id);
+
+    stub_spin(stub);
+    STUB_COUNT(prime_exports);
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    if (buffer->fd < 0 || buf_info->mem_type != VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME)
+        return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+
+    buf_info->handle = buffer->fd;
+    buf_info->type = buffer->type;
+    buf_info->mem_size = buffer->size;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+stub_ReleaseBufferHandle(VADriverContextP ctx, VABufferID buf_id)
+{
+    struct stub_driver_data *stub = STUB_DATA(ctx);
+
+    return STUB_LOOKUP(stub, buffers, BUFFER_ID_OFFSET, buf_id) ?
+        VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_BUFFER;
+}
+
+static void
+stub_init_profiles(struct stub_driver_data *stub)
+{
+    char name[64];
+    const char *value;
+    int i;
+
+    snprintf(name, sizeof(name), "STUB_%s_PROFILES", STUB_NAME);
+    for (i = 0; name[i]; i++)
+        name[i] = toupper((unsigned char)name[i]);
+
+    value = getenv(name);
+    if (value) {
+        while (*value && stub->num_profiles < STUB_MAX_PROFILES) {
+            char *end;
+
+            stub->profiles[stub->num_profiles++] = strtol(value, &end, 0);
+            value = *end ? end + 1 : end;
+        }
+        return;
+    }
+
+#ifdef STUB_PVR
+    stub->profiles[stub->num_profiles++] = VAProfileVP8Version0_3;
+    stub->profiles[stub->num_profiles++] = VAProfileH264High;
+#else
+    stub->profiles[stub->num_profiles++] = VAProfileNone;
+    stub->profiles[stub->num_profiles++] = VAProfileMPEG2Simple;
+    stub->profiles[stub->num_profiles++] = VAProfileMPEG2Main;
+    stub->profiles[stub->num_profiles++] = VAProfileH264ConstrainedBaseline;
+    stub->profiles[stub->num_profiles++] = VAProfileH264Main;
+    stub->profiles[stub->num_profiles++] = VAProfileH264High;
+    stub->profiles[stub->num_profiles++] = VAProfileVC1Simple;
+    stub->profiles[stub->num_profiles++] = VAProfileVC1Main;
+    stub->profiles[stub->num_profiles++] = VAProfileVC1Advanced;
+    stub->profiles[stub->num_profiles++] = VAProfileJPEGBaseline;
+#endif
+}
+
+VAStatus DLL_EXPORT
+__vaDriverInit_0_32(VADriverContextP ctx);
+
+VAStatus
+__vaDriverInit_0_32(VADriverContextP ctx)
+{
+    struct VADriverVTable * const vtable = ctx->vtable;
+    struct stub_driver_data *stub;
+    uint64_t init_ms;
+
+    STUB_COUNT(init);
+    init_ms = stub_getenv_u64("INIT_MS", 0);
+    if (init_ms)
+        stub_sleep_ns(init_ms * 1000000ull);
+
+    stub = calloc(1, sizeof(*stub));
+    if (!stub)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    pthread_mutex_init(&stub->lock, NULL);
+    stub->call_ns = stub_getenv_u64("CALL_NS", 0);
+    stub->decode_ns = stub_getenv_u64("DECODE_US", 0) * 1000;
+    stub->end_picture_ns = stub_getenv_u64("END_PICTURE_US", 0) * 1000;
+    stub_init_profiles(stub);
+
+    /* Stand in for the memory a real driver has resident after init */
+    stub->init_size = stub_getenv_u64("INIT_KB", 0) * 1024;
+    if (stub->init_size) {
+        stub->init_data = mmap(NULL, stub->init_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (stub->init_data == MAP_FAILED) {
+            free(stub);
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        memset(stub->init_data, 1, stub->init_size);
+    }
+
+    ctx->pDriverData = stub;
+    ctx->version_major = VA_MAJOR_VERSION;
+    ctx->version_minor = VA_MINOR_VERSION;
+    ctx->max_profiles = STUB_MAX_PROFILES;
+    ctx->max_entrypoints = 1;
+    ctx->max_attributes = VAConfigAttribTypeMax;
+    ctx->max_image_formats = 1;
+    ctx->max_subpic_formats = 1;
+    ctx->max_display_attributes = 1;
+    ctx->str_vendor = "Stub " STUB_NAME " driver";
+
+    vtable->vaTerminate = stub_Terminate;
+    vtable->vaQueryConfigProfiles = stub_QueryConfigProfiles;
+    vtable->vaQueryConfigEntrypoints = stub_QueryConfigEntrypoints;
+    vtable->vaGetConfigAttributes = stub_GetConfigAttributes;
+    vtable->vaCreateConfig = stub_CreateConfig;
+    vtable->vaDestroyConfig = stub_DestroyConfig;
+    vtable->vaQueryConfigAttributes = stub_QueryConfigAttributes;
+    vtable->vaCreateSurfaces = stub_CreateSurfaces;
+    vtable->vaDestroySurfaces = stub_DestroySurfaces;
+    vtable->vaCreateContext = stub_CreateContext;
+    vtable->vaDestroyContext = stub_DestroyContext;
+    vtable->vaCreateBuffer = stub_CreateBuffer;
+    vtable->vaBufferSetNumElements = stub_BufferSetNumElements;
+    vtable->vaMapBuffer = stub_MapBuffer;
+    vtable->vaUnmapBuffer = stub_UnmapBuffer;
+    vtable->vaDestroyBuffer = stub_DestroyBuffer;
+    vtable->vaBeginPicture = stub_BeginPicture;
+    vtable->vaRenderPicture = stub_RenderPicture;
+    vtable->vaEndPicture = stub_EndPicture;
+    vtable->vaSyncSurface = stub_SyncSurface;
+    vtable->vaQuerySurfaceStatus = stub_QuerySurfaceStatus;
+    vtable->vaPutSurface = stub_PutSurface;
+    vtable->vaQueryImageFormats = stub_QueryImageFormats;
+    vtable->vaCreateImage = stub_CreateImage;
+    vtable->vaDeriveImage = stub_DeriveImage;
+    vtable->vaDestroyImage = stub_DestroyImage;
+    vtable->vaSetImagePalette = stub_SetImagePalette;
+    vtable->vaGetImage = stub_GetImage;
+    vtable->vaPutImage = stub_PutImage;
+    vtable->vaQuerySubpictureFormats = stub_QuerySubpictureFormats;
+    vtable->vaCreateSubpicture = stub_CreateSubpicture;
+    vtable->vaDestroySubpicture = stub_DestroySubpicture;
+    vtable->vaSetSubpictureImage = stub_SetSubpictureImage;
+    vtable->vaSetSubpictureChromakey = stub_SetSubpictureChromakey;
+    vtable->vaSetSubpictureGlobalAlpha = stub_SetSubpictureGlobalAlpha;
+    vtable->vaAssociateSubpicture = stub_AssociateSubpicture;
+    vtable->vaDeassociateSubpicture = stub_DeassociateSubpicture;
+    vtable->vaQueryDisplayAttributes = stub_QueryDisplayAttributes;
+    vtable->vaGetDisplayAttributes = stub_GetDisplayAttributes;
+    vtable->vaSetDisplayAttributes = stub_SetDisplayAttributes;
+    vtable->vaBufferInfo = stub_BufferInfo;
+    vtable->vaLockSurface = stub_LockSurface;
+    vtable->vaUnlockSurface = stub_UnlockSurface;
+    vtable->vaCreateSurfaces2 = stub_CreateSurfaces2;
+    vtable->vaAcquireBufferHandle = stub_AcquireBufferHandle;
+    vtable->vaReleaseBufferHandle = stub_ReleaseBufferHandle;
+
+    return VA_STATUS_SUCCESS;
+}
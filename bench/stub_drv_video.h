@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _STUB_DRV_VIDEO_H_
+#define _STUB_DRV_VIDEO_H_
+
+/* Counters kept by the stub drivers, read back through stub_drv_get_stats() */
+struct stub_stats {
+    unsigned long init;
+    unsigned long calls;
+    unsigned long query_config;
+    unsigned long create_surfaces;
+    unsigned long destroy_surfaces;
+    unsigned long create_buffer;
+    unsigned long map_buffer;
+    unsigned long unmap_buffer;
+    unsigned long begin_picture;
+    unsigned long render_picture;
+    unsigned long end_picture;
+    unsigned long sync_surface;
+    unsigned long query_surface_status;
+    unsigned long put_surface;
+    unsigned long derive_image;
+    unsigned long get_image;
+    unsigned long prime_exports;
+    unsigned long prime_imports;
+    unsigned long bad_references;
+    unsigned long early_reads;  /* of surfaces another driver is decoding */
+};
+
+typedef struct stub_stats *(*stub_drv_get_stats_func)(void);
+
+#endif
@@ -0,0 +1,1160 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Dispatch overhead benchmark for the wrapper.
+ *
+ * Every entry point is timed twice: once calling a stub driver directly and
+ * once through the wrapper loaded on top of the same stub drivers, so the
+ * difference is the cost the wrapper adds per call. Both are run for a
+ * profile decoded by i965 and for VP8, which the wrapper routes to pvr, and
+ * finish with a full decode loop per frame.
+ *
+ * Then VP8 is decoded with the render targets shared with pvr as PRIME fds
+ * and as user pointers, checking which way the stubs saw them go.
+ *
+ * Then H.264 is decoded on 1, 2, 4 and 8 threads sharing one display, which
+ * shows how the throughput of the wrapper grows with the thread count.
+ *
+ * Then a few H.264 streams are decoded at once, on a thread each, with the
+ * stubs taking different times per frame. Routed to only one of the stubs
+ * and balanced over both, which shows how well vawr_pickBackend spreads the
+ * contexts.
+ *
+ * Then a stream is decoded the way a player does, parsing the next frame
+ * before waiting for the previous one, on a stub whose vaEndPicture blocks,
+ * with and without LIBVA_WRAPPER_ASYNC.
+ *
+ * Then the time from the first VP8 config to the first frame is measured on
+ * a pvr that sleeps in its init, with and without LIBVA_WRAPPER_PREWARM.
+ *
+ * Then every VP8 frame is scaled by an i965 video processing pipeline as
+ * soon as it is submitted, checking that neither stub read a surface the
+ * other was still decoding.
+ *
+ * Last, the surface ID translation of the VP8 calls is timed on its own,
+ * the list GET_SURFACEID used to walk against object_map.
+ *
+ * The wrapper finds the stubs through LIBVA_DRIVERS_PATH exactly like it
+ * finds the real drivers, so this exercises vawr_openDriver unchanged. The
+ * stubs can be slowed down with the STUB_<NAME>_* variables documented in
+ * stub_drv_video.c.
+ */
+
+#include <va/va.h>
+#include <va/va_backend.h>
+#include <va/va_dec_vp8.h>
+#include <va/va_vpp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "stub_drv_video.h"
+#include "object_map.h"
+#include "list.h"
+
+#ifndef WRAPPER_PATH
+#define WRAPPER_PATH		"../src/.libs/wrapper_drv_video.so"
+#endif
+#ifndef STUB_DRIVERS_PATH
+#define STUB_DRIVERS_PATH	".libs"
+#endif
+
+#define BENCH_NUM_SURFACES	4
+#define BENCH_WIDTH		1920
+#define BENCH_HEIGHT		1088
+
+#define BENCH_STREAM_FRAMES	240	/* frames each stream decodes */
+#define BENCH_STREAM_STAGGER	16	/* frames of a stream before the next one starts */
+#define BENCH_SCALING_FRAMES	20000	/* frames each thread decodes */
+#define BENCH_PIPELINE_FRAMES	400
+#define BENCH_PARSE_US		300	/* parsing a frame, before it is submitted */
+#define BENCH_IN_FLIGHT		2	/* frames submitted and not synced yet */
+#define BENCH_CHECK_FRAMES	16	/* frames of each kind the backend's map calls are counted over */
+#define BENCH_STARTUP_MS	100	/* a player's work between vaInitialize and its first config */
+#define BENCH_SURFACE_ID_BASE	0x04000000	/* ID offset of i965's surface heap */
+
+#define CHECK(call)							\
+    do {								\
+        VAStatus check_status = (call);					\
+        if (check_status != VA_STATUS_SUCCESS) {			\
+            fprintf(stderr, "%s:%d: %s failed: 0x%x\n",		\
+                    __FILE__, __LINE__, #call, check_status);		\
+            exit(1);							\
+        }								\
+    } while (0)
+
+struct bench_driver {
+    const char *name;
+    void *handle;
+    struct VADriverContext ctx;
+    struct VADriverVTable vtable;
+};
+
+/* A decoder set up on one driver, the state every benchmark runs on */
+struct bench_session {
+    struct bench_driver *drv;
+    VAProfile profile;
+    VAConfigID config;
+    VAContextID context;
+    VASurfaceID surfaces[BENCH_NUM_SURFACES];
+    VABufferID buffer;
+    unsigned int frame;
+};
+
+struct bench_op {
+    const char *name;
+    void (*run)(struct bench_session *s);
+};
+
+static uint64_t
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+bench_load(struct bench_driver *drv, const char *name, const char *path)
+{
+    VADriverInit init;
+
+    memset(drv, 0, sizeof(*drv));
+    drv->name = name;
+    drv->ctx.vtable = &drv->vtable;
+
+    drv->handle = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
+    if (!drv->handle) {
+        fprintf(stderr, "dlopen of %s failed: %s\n", path, dlerror());
+        exit(1);
+    }
+
+    init = (VADriverInit)dlsym(drv->handle, "__vaDriverInit_0_32");
+    if (!init) {
+        fprintf(stderr, "%s has no function __vaDriverInit_0_32\n", path);
+        exit(1);
+    }
+    CHECK(init(&drv->ctx));
+}
+
+/* The counters of a stub driver loaded with bench_load */
+static struct stub_stats *
+bench_stub_stats(struct bench_driver *drv)
+{
+    stub_drv_get_stats_func get_stats;
+
+    get_stats = (stub_drv_get_stats_func)dlsym(drv->handle, "stub_drv_get_stats");
+    if (!get_stats) {
+        fprintf(stderr, "%s has no function stub_drv_get_stats\n", drv->name);
+        exit(1);
+    }
+
+    return get_stats();
+}
+
+static void
+bench_unload(struct bench_driver *drv)
+{
+    CHECK(drv->ctx.vtable->vaTerminate(&drv->ctx));
+    dlclose(drv->handle);
+}
+
+/* Like libva, go through ctx.vtable on every call, the wrapper switches it
+ * when the first config routed away from i965 is created.
+ */
+#define VT(s)	((s)->drv->ctx.vtable)
+#define CTX(s)	(&(s)->drv->ctx)
+
+static void
+bench_session_open(struct bench_session *s, struct bench_driver *drv, VAProfile profile)
+{
+    memset(s, 0, sizeof(*s));
+    s->drv = drv;
+    s->profile = profile;
+
+    CHECK(VT(s)->vaCreateConfig(CTX(s), profile, VAEntrypointVLD, NULL, 0, &s->config));
+    CHECK(VT(s)->vaCreateSurfaces(CTX(s), BENCH_WIDTH, BENCH_HEIGHT, VA_RT_FORMAT_YUV420,
+                                  BENCH_NUM_SURFACES, s->surfaces));
+    CHECK(VT(s)->vaCreateContext(CTX(s), s->config, BENCH_WIDTH, BENCH_HEIGHT, VA_PROGRESSIVE,
+                                 s->surfaces, BENCH_NUM_SURFACES, &s->context));
+    CHECK(VT(s)->vaCreateBuffer(CTX(s), s->context, VASliceDataBufferType, 4096, 1, NULL, &s->buffer));
+}
+
+static void
+bench_session_close(struct bench_session *s)
+{
+    CHECK(VT(s)->vaDestroyBuffer(CTX(s), s->buffer));
+    CHECK(VT(s)->vaDestroyContext(CTX(s), s->context));
+    CHECK(VT(s)->vaDestroySurfaces(CTX(s), s->surfaces, BENCH_NUM_SURFACES));
+    CHECK(VT(s)->vaDestroyConfig(CTX(s), s->config));
+}
+
+static void
+op_QueryConfigProfiles(struct bench_session *s)
+{
+    VAProfile profiles[64];
+    int num_profiles;
+
+    CHECK(VT(s)->vaQueryConfigProfiles(CTX(s), profiles, &num_profiles));
+}
+
+static void
+op_QueryConfigEntrypoints(struct bench_session *s)
+{
+    VAEntrypoint entrypoints[16];
+    int num_entrypoints;
+
+    CHECK(VT(s)->vaQueryConfigEntrypoints(CTX(s), s->profile, entrypoints, &num_entrypoints));
+}
+
+static void
+op_GetConfigAttributes(struct bench_session *s)
+{
+    VAConfigAttrib attrib = { VAConfigAttribRTFormat, 0 };
+
+    CHECK(VT(s)->vaGetConfigAttributes(CTX(s), s->profile, VAEntrypointVLD, &attrib, 1));
+}
+
+static void
+op_QueryConfigAttributes(struct bench_session *s)
+{
+    VAConfigAttrib attribs[VAConfigAttribTypeMax];
+    VAEntrypoint entrypoint;
+    VAProfile profile;
+    int num_attribs;
+
+    CHECK(VT(s)->vaQueryConfigAttributes(CTX(s), s->config, &profile, &entrypoint,
+                                         attribs, &num_attribs));
+}
+
+static void
+op_CreateDestroyConfig(struct bench_session *s)
+{
+    VAConfigID config;
+
+    CHECK(VT(s)->vaCreateConfig(CTX(s), s->profile, VAEntrypointVLD, NULL, 0, &config));
+    CHECK(VT(s)->vaDestroyConfig(CTX(s), config));
+}
+
+static void
+op_CreateDestroyBuffer(struct bench_session *s)
+{
+    VABufferID buffer;
+
+    CHECK(VT(s)->vaCreateBuffer(CTX(s), s->context, VASliceDataBufferType, 4096, 1, NULL, &buffer));
+    CHECK(VT(s)->vaDestroyBuffer(CTX(s), buffer));
+}
+
+static void
+op_MapUnmapBuffer(struct bench_session *s)
+{
+    void *data;
+
+    CHECK(VT(s)->vaMapBuffer(CTX(s), s->buffer, &data));
+    CHECK(VT(s)->vaUnmapBuffer(CTX(s), s->buffer));
+}
+
+static void
+op_BufferInfo(struct bench_session *s)
+{
+    VABufferType type;
+    unsigned int size, num_elements;
+
+    CHECK(VT(s)->vaBufferInfo(CTX(s), s->buffer, &type, &size, &num_elements));
+}
+
+static void
+op_BeginPicture(struct bench_session *s)
+{
+    CHECK(VT(s)->vaBeginPicture(CTX(s), s->context, s->surfaces[s->frame++ % BENCH_NUM_SURFACES]));
+}
+
+static void
+op_RenderPicture(struct bench_session *s)
+{
+    CHECK(VT(s)->vaRenderPicture(CTX(s), s->context, &s->buffer, 1));
+}
+
+static void
+op_EndPicture(struct bench_session *s)
+{
+    CHECK(VT(s)->vaEndPicture(CTX(s), s->context));
+}
+
+static void
+op_SyncSurface(struct bench_session *s)
+{
+    CHECK(VT(s)->vaSyncSurface(CTX(s), s->surfaces[0]));
+}
+
+static void
+op_QuerySurfaceStatus(struct bench_session *s)
+{
+    VASurfaceStatus status;
+
+    CHECK(VT(s)->vaQuerySurfaceStatus(CTX(s), s->surfaces[0], &status));
+}
+
+static void
+op_PutSurface(struct bench_session *s)
+{
+    CHECK(VT(s)->vaPutSurface(CTX(s), s->surfaces[0], NULL, 0, 0, BENCH_WIDTH, BENCH_HEIGHT,
+                              0, 0, BENCH_WIDTH, BENCH_HEIGHT, NULL, 0, 0));
+}
+
+static void
+op_DeriveDestroyImage(struct bench_session *s)
+{
+    VAImage image;
+
+    CHECK(VT(s)->vaDeriveImage(CTX(s), s->surfaces[0], &image));
+    CHECK(VT(s)->vaDestroyImage(CTX(s), image.image_id));
+}
+
+/* The surface of the last frame, which op_Frame has synced */
+static void
+op_SyncSurfaceDone(struct bench_session *s)
+{
+    CHECK(VT(s)->vaSyncSurface(CTX(s), s->surfaces[(s->frame - 1) % BENCH_NUM_SURFACES]));
+}
+
+static void
+op_QuerySurfaceStatusDone(struct bench_session *s)
+{
+    VASurfaceStatus status;
+
+    CHECK(VT(s)->vaQuerySurfaceStatus(CTX(s), s->surfaces[(s->frame - 1) % BENCH_NUM_SURFACES], &status));
+}
+
+/* What a player does on a seek, a new context over the surfaces it has */
+static void
+op_CreateDestroyContext(struct bench_session *s)
+{
+    VAContextID context;
+
+    CHECK(VT(s)->vaCreateContext(CTX(s), s->config, BENCH_WIDTH, BENCH_HEIGHT, VA_PROGRESSIVE,
+                                 s->surfaces, BENCH_NUM_SURFACES, &context));
+    CHECK(VT(s)->vaDestroyContext(CTX(s), context));
+}
+
+/* What a player does on a switch to another rendition of the stream */
+static void
+op_SwitchRendition(struct bench_session *s)
+{
+    VASurfaceID surfaces[BENCH_NUM_SURFACES];
+    VAContextID context;
+
+    CHECK(VT(s)->vaCreateSurfaces(CTX(s), BENCH_WIDTH, BENCH_HEIGHT, VA_RT_FORMAT_YUV420,
+                                  BENCH_NUM_SURFACES, surfaces));
+    CHECK(VT(s)->vaCreateContext(CTX(s), s->config, BENCH_WIDTH, BENCH_HEIGHT, VA_PROGRESSIVE,
+                                 surfaces, BENCH_NUM_SURFACES, &context));
+    CHECK(VT(s)->vaDestroyContext(CTX(s), context));
+    CHECK(VT(s)->vaDestroySurfaces(CTX(s), surfaces, BENCH_NUM_SURFACES));
+}
+
+/* Create a buffer holding data, or with map set fill it through vaMapBuffer
+ * like a decoder writing in place does
+ */
+static void
+bench_create_buffer(struct bench_session *s, VABufferType type, unsigned int size,
+                    void *data, int map, VABufferID *buffer)
+{
+    void *mapped;
+
+    if (!map) {
+        CHECK(VT(s)->vaCreateBuffer(CTX(s), s->context, type, size, 1, data, buffer));
+        return;
+    }
+
+    CHECK(VT(s)->vaCreateBuffer(CTX(s), s->context, type, size, 1, NULL, buffer));
+    CHECK(VT(s)->vaMapBuffer(CTX(s), *buffer, &mapped));
+    memcpy(mapped, data, size);
+    CHECK(VT(s)->vaUnmapBuffer(CTX(s), *buffer));
+}
+
+/* Create the picture parameters of the next frame, with the previous
+ * frames as references, the way a decoder does.
+ */
+static void
+bench_create_pic_param(struct bench_session *s, unsigned int frame, int map, VABufferID *buffer)
+{
+    VASurfaceID ref0 = s->surfaces[(frame + 3) % BENCH_NUM_SURFACES];
+    VASurfaceID ref1 = s->surfaces[(frame + 2) % BENCH_NUM_SURFACES];
+
+    if (s->profile == VAProfileVP8Version0_3) {
+        VAPictureParameterBufferVP8 pic_param;
+
+        memset(&pic_param, 0, sizeof(pic_param));
+        pic_param.frame_width = BENCH_WIDTH;
+        pic_param.frame_height = BENCH_HEIGHT;
+        pic_param.last_ref_frame = ref0;
+        pic_param.golden_ref_frame = ref1;
+        pic_param.alt_ref_frame = ref1;
+        pic_param.out_of_loop_frame = VA_INVALID_SURFACE;
+        bench_create_buffer(s, VAPictureParameterBufferType, sizeof(pic_param), &pic_param,
+                            map, buffer);
+    } else {
+        VAPictureParameterBufferH264 pic_param;
+        int i;
+
+        memset(&pic_param, 0, sizeof(pic_param));
+        pic_param.CurrPic.picture_id = s->surfaces[frame % BENCH_NUM_SURFACES];
+        for (i = 0; i < 16; i++)
+            pic_param.ReferenceFrames[i].picture_id = VA_INVALID_SURFACE;
+        pic_param.ReferenceFrames[0].picture_id = ref0;
+        pic_param.ReferenceFrames[1].picture_id = ref1;
+        bench_create_buffer(s, VAPictureParameterBufferType, sizeof(pic_param), &pic_param,
+                            map, buffer);
+    }
+}
+
+static void
+bench_frame(struct bench_session *s, int map)
+{
+    unsigned int frame = s->frame++;
+    VASurfaceID target = s->surfaces[frame % BENCH_NUM_SURFACES];
+    VABufferID buffers[2];
+
+    bench_create_pic_param(s, frame, map, &buffers[0]);
+    CHECK(VT(s)->vaCreateBuffer(CTX(s), s->context, VASliceDataBufferType, 4096, 1, NULL, &buffers[1]));
+    CHECK(VT(s)->vaBeginPicture(CTX(s), s->context, target));
+    CHECK(VT(s)->vaRenderPicture(CTX(s), s->context, buffers, 2));
+    CHECK(VT(s)->vaEndPicture(CTX(s), s->context));
+    CHECK(VT(s)->vaSyncSurface(CTX(s), target));
+    CHECK(VT(s)->vaDestroyBuffer(CTX(s), buffers[0]));
+    CHECK(VT(s)->vaDestroyBuffer(CTX(s), buffers[1]));
+}
+
+static void
+op_Frame(struct bench_session *s)
+{
+    bench_frame(s, 0);
+}
+
+/* A frame whose picture parameters are written through vaMapBuffer */
+static void
+op_FrameMapped(struct bench_session *s)
+{
+    bench_frame(s, 1);
+}
+
+static const struct bench_op bench_ops[] = {
+    { "vaQueryConfigProfiles", op_QueryConfigProfiles },
+    { "vaQueryConfigEntrypoints", op_QueryConfigEntrypoints },
+    { "vaGetConfigAttributes", op_GetConfigAttributes },
+    { "vaQueryConfigAttributes", op_QueryConfigAttributes },
+    { "vaCreateConfig+Destroy", op_CreateDestroyConfig },
+    { "vaCreateBuffer+Destroy", op_CreateDestroyBuffer },
+    { "vaMapBuffer+Unmap", op_MapUnmapBuffer },
+    { "vaBufferInfo", op_BufferInfo },
+    { "vaBeginPicture", op_BeginPicture },
+    { "vaRenderPicture", op_RenderPicture },
+    { "vaEndPicture", op_EndPicture },
+    { "vaSyncSurface", op_SyncSurface },
+    { "vaQuerySurfaceStatus", op_QuerySurfaceStatus },
+    { "vaPutSurface", op_PutSurface },
+    { "vaDeriveImage+Destroy", op_DeriveDestroyImage },
+    { "frame", op_Frame },
+    { "frame, mapped parameters", op_FrameMapped },
+    { "vaSyncSurface, done", op_SyncSurfaceDone },
+    { "vaQuerySurfaceStatus, done", op_QuerySurfaceStatusDone },
+    { "vaCreateContext+Destroy", op_CreateDestroyContext },
+    { "vaCreateSurfaces+Context", op_SwitchRendition },
+};
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+/* ns per call of op, the best of a few runs to keep scheduler noise out */
+static double
+bench_run(const struct bench_op *op, struct bench_session *s, unsigned int iterations)
+{
+    double best = 0;
+    uint64_t start;
+    unsigned int i;
+    int run;
+
+    for (i = 0; i < iterations / 10; i++)
+        op->run(s);
+
+    for (run = 0; run < 3; run++) {
+        double ns;
+
+        start = bench_now();
+        for (i = 0; i < iterations; i++)
+            op->run(s);
+        ns = (double)(bench_now() - start) / iterations;
+
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+
+    return best;
+}
+
+/* The wrapper must not map buffers in the backend on top of the maps of
+ * the application, to patch the picture parameters of a frame or else
+ */
+static void
+bench_check_maps(struct bench_driver *backend, struct bench_session *s)
+{
+    struct stub_stats *stats = bench_stub_stats(backend);
+    unsigned long map_buffer = stats->map_buffer;
+    unsigned long unmap_buffer = stats->unmap_buffer;
+    unsigned int i;
+
+    for (i = 0; i < BENCH_CHECK_FRAMES; i++) {
+        op_Frame(s);
+        op_FrameMapped(s);
+    }
+    map_buffer = stats->map_buffer - map_buffer;
+    unmap_buffer = stats->unmap_buffer - unmap_buffer;
+
+    printf("%-28s %12lu %12lu\n", "backend map/unmap calls", map_buffer, unmap_buffer);
+    if (map_buffer != BENCH_CHECK_FRAMES || unmap_buffer != BENCH_CHECK_FRAMES) {
+        fprintf(stderr, "%s saw %lu vaMapBuffer and %lu vaUnmapBuffer calls for the %d of the benchmark\n",
+                backend->name, map_buffer, unmap_buffer, BENCH_CHECK_FRAMES);
+        exit(1);
+    }
+}
+
+static void
+bench_profile(const char *title, VAProfile profile,
+              struct bench_driver *direct, struct bench_driver *wrapper,
+              unsigned int iterations)
+{
+    struct bench_session direct_session, wrapper_session;
+    unsigned int i;
+
+    bench_session_open(&direct_session, direct, profile);
+    bench_session_open(&wrapper_session, wrapper, profile);
+
+    printf("\n%s: %s direct vs. through the wrapper, ns per call\n", title, direct->name);
+    printf("%-28s %12s %12s %12s\n", "entry point", "direct", "wrapper", "overhead");
+
+    for (i = 0; i < ARRAY_SIZE(bench_ops); i++) {
+        const struct bench_op *op = &bench_ops[i];
+        double direct_ns = bench_run(op, &direct_session, iterations);
+        double wrapper_ns = bench_run(op, &wrapper_session, iterations);
+
+        printf("%-28s %12.1f %12.1f %12.1f\n", op->name, direct_ns, wrapper_ns,
+               wrapper_ns - direct_ns);
+    }
+    bench_check_maps(direct, &wrapper_session);
+
+    bench_session_close(&wrapper_session);
+    bench_session_close(&direct_session);
+}
+
+/* Set name to value unless the user did, return whether it was set */
+static int
+bench_setenv_default(const char *name, const char *value)
+{
+    if (getenv(name))
+        return 0;
+    setenv(name, value, 1);
+    return 1;
+}
+
+static void
+bench_spin(uint64_t ns)
+{
+    uint64_t end = bench_now() + ns;
+
+    while (bench_now() < end)
+        ;
+}
+
+/* A stream decoded on a thread of its own */
+struct bench_stream {
+    struct bench_session session;
+    pthread_t thread;
+    unsigned int frames;	/* decoded so far */
+};
+
+static void *
+bench_stream_thread(void *arg)
+{
+    struct bench_stream *stream = arg;
+    unsigned int i;
+
+    for (i = 0; i < BENCH_STREAM_FRAMES; i++) {
+        op_Frame(&stream->session);
+        __atomic_store_n(&stream->frames, i + 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+static void *
+bench_scaling_thread(void *arg)
+{
+    struct bench_stream *stream = arg;
+    unsigned int i;
+
+    for (i = 0; i < BENCH_SCALING_FRAMES; i++)
+        op_Frame(&stream->session);
+
+    return NULL;
+}
+
+/* Decode on num_threads threads at once, each with a context of its own on
+ * the same display. Returns frames per second over all threads.
+ */
+static double
+bench_threads(const char *wrapper_path, int num_threads)
+{
+    struct bench_driver wrapper;
+    struct bench_stream streams[num_threads];
+    uint64_t start, ns;
+    int i;
+
+    bench_load(&wrapper, "wrapper", wrapper_path);
+    for (i = 0; i < num_threads; i++)
+        bench_session_open(&streams[i].session, &wrapper, VAProfileH264High);
+
+    start = bench_now();
+    for (i = 0; i < num_threads; i++) {
+        if (pthread_create(&streams[i].thread, NULL, bench_scaling_thread, &streams[i])) {
+            fprintf(stderr, "failed to start thread %d\n", i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < num_threads; i++)
+        pthread_join(streams[i].thread, NULL);
+    ns = bench_now() - start;
+
+    for (i = 0; i < num_threads; i++)
+        bench_session_close(&streams[i].session);
+    bench_unload(&wrapper);
+
+    return (double)num_threads * BENCH_SCALING_FRAMES * 1e9 / ns;
+}
+
+/* How the throughput of one display grows with the threads decoding on it */
+static void
+bench_scaling(const char *wrapper_path)
+{
+    static const int threads[] = { 1, 2, 4, 8 };
+    /* Through the wrapper, rather than straight into i965 */
+    int set_direct = bench_setenv_default("LIBVA_WRAPPER_DIRECT", "0");
+    unsigned int i;
+
+    printf("\nH.264 frames on one display, %d per thread, LIBVA_WRAPPER_DIRECT=%s\n",
+           BENCH_SCALING_FRAMES, getenv("LIBVA_WRAPPER_DIRECT"));
+    printf("%-28s %12s %12s\n", "threads", "frames/s", "per thread");
+    for (i = 0; i < ARRAY_SIZE(threads); i++) {
+        double fps = bench_threads(wrapper_path, threads[i]);
+
+        printf("%-28d %12.1f %12.1f\n", threads[i], fps, fps / threads[i]);
+    }
+
+    if (set_direct)
+        unsetenv("LIBVA_WRAPPER_DIRECT");
+}
+
+/* Decode num_streams H.264 streams at once through a wrapper with routes,
+ * each starting once the previous one is under way, the way streams come
+ * and go on a media server. Returns frames per second.
+ */
+static double
+bench_streams(const char *routes, const char *wrapper_path, int num_streams)
+{
+    struct bench_driver wrapper;
+    struct bench_stream streams[num_streams];
+    uint64_t start, ns;
+    int i;
+
+    setenv("LIBVA_WRAPPER_ROUTES", routes, 1);
+    bench_load(&wrapper, "wrapper", wrapper_path);
+
+    start = bench_now();
+    for (i = 0; i < num_streams; i++) {
+        bench_session_open(&streams[i].session, &wrapper, VAProfileH264High);
+        streams[i].frames = 0;
+        if (pthread_create(&streams[i].thread, NULL, bench_stream_thread, &streams[i])) {
+            fprintf(stderr, "failed to start stream %d\n", i);
+            exit(1);
+        }
+        while (__atomic_load_n(&streams[i].frames, __ATOMIC_RELAXED) < BENCH_STREAM_STAGGER)
+            usleep(100);
+    }
+    for (i = 0; i < num_streams; i++)
+        pthread_join(streams[i].thread, NULL);
+    ns = bench_now() - start;
+
+    for (i = 0; i < num_streams; i++)
+        bench_session_close(&streams[i].session);
+    bench_unload(&wrapper);
+    unsetenv("LIBVA_WRAPPER_ROUTES");
+
+    return (double)num_streams * BENCH_STREAM_FRAMES * 1e9 / ns;
+}
+
+static void
+bench_balance(const char *wrapper_path, int num_streams)
+{
+    static const char *routes[] = {
+        "H264High=i965",
+        "H264High=pvr",
+        "H264High=i965,pvr",
+    };
+    unsigned int i;
+
+    /* A slower and a faster media block, the stubs read these on init */
+    int set_i965 = bench_setenv_default("STUB_I965_DECODE_US", "400");
+    int set_pvr = bench_setenv_default("STUB_PVR_DECODE_US", "200");
+
+    printf("\n%d H.264 streams of %d frames, decode %s/%s us per frame on i965/pvr\n",
+           num_streams, BENCH_STREAM_FRAMES, getenv("STUB_I965_DECODE_US"), getenv("STUB_PVR_DECODE_US"));
+    printf("%-28s %12s\n", "routes", "frames/s");
+    for (i = 0; i < ARRAY_SIZE(routes); i++)
+        printf("%-28s %12.1f\n", routes[i], bench_streams(routes[i], wrapper_path, num_streams));
+
+    if (set_i965)
+        unsetenv("STUB_I965_DECODE_US");
+    if (set_pvr)
+        unsetenv("STUB_PVR_DECODE_US");
+}
+
+/* Decode a stream keeping BENCH_IN_FLIGHT frames submitted, syncing each
+ * frame only after the next ones have been parsed and submitted. Returns
+ * frames per second.
+ */
+static double
+bench_pipelined(const char *wrapper_path, const char *async)
+{
+    struct bench_driver wrapper;
+    struct bench_session s;
+    VABufferID buffers[BENCH_NUM_SURFACES][2];
+    uint64_t start;
+    unsigned int frame;
+
+    setenv("LIBVA_WRAPPER_ASYNC", async, 1);
+    bench_load(&wrapper, "wrapper", wrapper_path);
+    bench_session_open(&s, &wrapper, VAProfileH264High);
+
+    start = bench_now();
+    for (frame = 0; frame < BENCH_PIPELINE_FRAMES + BENCH_IN_FLIGHT; frame++) {
+        unsigned int done = frame - BENCH_IN_FLIGHT;
+        VABufferID *b = buffers[frame % BENCH_NUM_SURFACES];
+        VABufferID *prev = buffers[done % BENCH_NUM_SURFACES];
+
+        if (frame < BENCH_PIPELINE_FRAMES) {
+            bench_spin(BENCH_PARSE_US * 1000ull);
+            bench_create_pic_param(&s, frame, 0, &b[0]);
+            CHECK(VT(&s)->vaCreateBuffer(CTX(&s), s.context, VASliceDataBufferType, 4096, 1, NULL, &b[1]));
+            CHECK(VT(&s)->vaBeginPicture(CTX(&s), s.context, s.surfaces[frame % BENCH_NUM_SURFACES]));
+            CHECK(VT(&s)->vaRenderPicture(CTX(&s), s.context, b, 2));
+            CHECK(VT(&s)->vaEndPicture(CTX(&s), s.context));
+        }
+        if (frame >= BENCH_IN_FLIGHT) {
+            CHECK(VT(&s)->vaSyncSurface(CTX(&s), s.surfaces[done % BENCH_NUM_SURFACES]));
+            CHECK(VT(&s)->vaDestroyBuffer(CTX(&s), prev[0]));
+            CHECK(VT(&s)->vaDestroyBuffer(CTX(&s), prev[1]));
+        }
+    }
+
+    start = bench_now() - start;
+    bench_session_close(&s);
+    bench_unload(&wrapper);
+    unsetenv("LIBVA_WRAPPER_ASYNC");
+
+    return BENCH_PIPELINE_FRAMES * 1e9 / start;
+}
+
+static void
+bench_pipeline(const char *wrapper_path)
+{
+    int set_end = bench_setenv_default("STUB_I965_END_PICTURE_US", "300");
+    int set_decode = bench_setenv_default("STUB_I965_DECODE_US", "200");
+
+    printf("\nH.264 stream parsing %d us per frame, vaEndPicture %s us, decode %s us on i965\n",
+           BENCH_PARSE_US, getenv("STUB_I965_END_PICTURE_US"), getenv("STUB_I965_DECODE_US"));
+    printf("%-28s %12s\n", "submission", "frames/s");
+    printf("%-28s %12.1f\n", "LIBVA_WRAPPER_ASYNC=0", bench_pipelined(wrapper_path, "0"));
+    printf("%-28s %12.1f\n", "LIBVA_WRAPPER_ASYNC=1", bench_pipelined(wrapper_path, "1"));
+
+    if (set_end)
+        unsetenv("STUB_I965_END_PICTURE_US");
+    if (set_decode)
+        unsetenv("STUB_I965_DECODE_US");
+}
+
+/* A surface record as GET_SURFACEID used to keep them, in a list */
+struct bench_lookup_entry {
+    VASurfaceID i965_surface;
+    VASurfaceID pvr_surface;
+    struct list link;
+};
+
+/* ns per lookup of each of num_surfaces IDs, walking the list like
+ * GET_SURFACEID did, to the end even after a match, or in an object_map
+ */
+static double
+bench_lookup_run(struct list *surfaces, struct object_map *map,
+                 unsigned int num_surfaces, unsigned int iterations)
+{
+    volatile VASurfaceID sink;
+    double best = 0;
+    unsigned int i, j;
+    int run;
+
+    for (run = 0; run < 3; run++) {
+        uint64_t start = bench_now();
+        double ns;
+
+        for (i = 0; i < iterations; i++) {
+            for (j = 0; j < num_surfaces; j++) {
+                VASurfaceID surface = BENCH_SURFACE_ID_BASE | j;
+                VASurfaceID surface_out = VA_INVALID_SURFACE;
+
+                if (map) {
+                    struct bench_lookup_entry *entry = object_map_lookup(map, surface);
+                    if (entry)
+                        surface_out = entry->pvr_surface;
+                } else {
+                    struct bench_lookup_entry *entry;
+                    list_for_each_entry(entry, surfaces, link)
+                        if (entry->i965_surface == surface)
+                            surface_out = entry->pvr_surface;
+                }
+                sink = surface_out;
+            }
+        }
+        ns = (double)(bench_now() - start) / ((double)iterations * num_surfaces);
+
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+    (void)sink;
+
+    return best;
+}
+
+/* Surface ID translation of the VP8 calls, the old list against object_map */
+static void
+bench_lookup(unsigned int iterations)
+{
+    static const unsigned int sizes[] = { 4, 20, 64, 256 };
+    unsigned int i, j;
+
+    printf("\nSurface ID translation, ns per lookup\n");
+    printf("%-28s %12s %12s\n", "surfaces", "list", "object_map");
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        unsigned int num_surfaces = sizes[i];
+        struct bench_lookup_entry entries[num_surfaces];
+        unsigned int n = iterations / num_surfaces ? iterations / num_surfaces : 1;
+        struct object_map map;
+        struct list surfaces;
+        char name[32];
+        double list_ns, map_ns;
+
+        list_init(&surfaces);
+        if (object_map_init(&map)) {
+            fprintf(stderr, "failed to create the object map\n");
+            exit(1);
+        }
+        for (j = 0; j < num_surfaces; j++) {
+            entries[j].i965_surface = BENCH_SURFACE_ID_BASE | j;
+            entries[j].pvr_surface = j;
+            list_add(&entries[j].link, &surfaces);
+            if (object_map_insert(&map, entries[j].i965_surface, &entries[j])) {
+                fprintf(stderr, "failed to insert surface %u\n", j);
+                exit(1);
+            }
+        }
+
+        list_ns = bench_lookup_run(&surfaces, NULL, num_surfaces, n);
+        map_ns = bench_lookup_run(NULL, &map, num_surfaces, n);
+        snprintf(name, sizeof(name), "%u", num_surfaces);
+        printf("%-28s %12.1f %12.1f\n", name, list_ns, map_ns);
+
+        object_map_fini(&map, NULL);
+    }
+}
+
+/* ms from the first VP8 vaCreateConfig to the first synced frame, on a
+ * display initialized BENCH_STARTUP_MS earlier
+ */
+static double
+bench_first_frame_run(const char *wrapper_path, const char *prewarm)
+{
+    struct bench_driver wrapper;
+    struct bench_session s;
+    uint64_t start;
+
+    setenv("LIBVA_WRAPPER_PREWARM", prewarm, 1);
+    bench_load(&wrapper, "wrapper", wrapper_path);
+    usleep(BENCH_STARTUP_MS * 1000);
+
+    start = bench_now();
+    bench_session_open(&s, &wrapper, VAProfileVP8Version0_3);
+    op_Frame(&s);
+    start = bench_now() - start;
+
+    bench_session_close(&s);
+    bench_unload(&wrapper);
+    unsetenv("LIBVA_WRAPPER_PREWARM");
+
+    return start / 1e6;
+}
+
+/* Time to the first frame of a live stream on a pvr that is slow to
+ * initialize, with and without LIBVA_WRAPPER_PREWARM
+ */
+static void
+bench_first_frame(const char *wrapper_path)
+{
+    int set_init = bench_setenv_default("STUB_PVR_INIT_MS", "200");
+
+    printf("\nVP8 vaCreateConfig to first frame, %d ms after vaInitialize, pvr init %s ms\n",
+           BENCH_STARTUP_MS, getenv("STUB_PVR_INIT_MS"));
+    printf("%-28s %12s\n", "pre-warming", "ms");
+    printf("%-28s %12.1f\n", "LIBVA_WRAPPER_PREWARM=0", bench_first_frame_run(wrapper_path, "0"));
+    printf("%-28s %12.1f\n", "LIBVA_WRAPPER_PREWARM=1", bench_first_frame_run(wrapper_path, "1"));
+
+    if (set_init)
+        unsetenv("STUB_PVR_INIT_MS");
+}
+
+/* Decode VP8 frames with LIBVA_WRAPPER_SURFACE_SHARING set to mode and
+ * check that the render targets reached pvr the way asked for
+ */
+static void
+bench_sharing_run(const char *wrapper_path, const char *mode,
+                  struct bench_driver *i965, struct bench_driver *pvr)
+{
+    unsigned long exports = bench_stub_stats(i965)->prime_exports;
+    unsigned long imports = bench_stub_stats(pvr)->prime_imports;
+    unsigned long expected = strcmp(mode, "prime") ? 0 : BENCH_NUM_SURFACES;
+    struct bench_driver wrapper;
+    struct bench_session s;
+    unsigned int i;
+
+    setenv("LIBVA_WRAPPER_SURFACE_SHARING", mode, 1);
+    bench_load(&wrapper, "wrapper", wrapper_path);
+    bench_session_open(&s, &wrapper, VAProfileVP8Version0_3);
+    for (i = 0; i < BENCH_CHECK_FRAMES; i++)
+        op_Frame(&s);
+    bench_session_close(&s);
+    bench_unload(&wrapper);
+    unsetenv("LIBVA_WRAPPER_SURFACE_SHARING");
+
+    exports = bench_stub_stats(i965)->prime_exports - exports;
+    imports = bench_stub_stats(pvr)->prime_imports - imports;
+    printf("%-28s %12lu %12lu\n", mode, exports, imports);
+    if (exports != expected || imports != expected) {
+        fprintf(stderr, "%s sharing exported %lu and imported %lu PRIME fds for %d surfaces\n",
+                mode, exports, imports, BENCH_NUM_SURFACES);
+        exit(1);
+    }
+}
+
+static void
+bench_sharing(const char *wrapper_path, struct bench_driver *i965, struct bench_driver *pvr)
+{
+    printf("\nVP8 render targets shared with pvr, %d surfaces\n", BENCH_NUM_SURFACES);
+    printf("%-28s %12s %12s\n", "LIBVA_WRAPPER_SURFACE_SHARING=", "exports", "imports");
+    bench_sharing_run(wrapper_path, "prime", i965, pvr);
+    bench_sharing_run(wrapper_path, "userptr", i965, pvr);
+}
+
+/* Decode VP8 frames on pvr and hand each one, with the frame before it as
+ * a reference, to a pipeline on i965 without waiting for it, like a player
+ * scaling its output does.
+ *
+ * @return The reads of unfinished surfaces the stubs counted.
+ */
+static unsigned long
+bench_fences_run(const char *wrapper_path, const char *async,
+                 struct bench_driver *i965, struct bench_driver *pvr)
+{
+    unsigned long early_reads = bench_stub_stats(i965)->early_reads + bench_stub_stats(pvr)->early_reads;
+    VAProcPipelineParameterBuffer pipeline;
+    struct bench_driver wrapper;
+    struct bench_session s;
+    VAConfigID vpp_config;
+    VAContextID vpp_context;
+    VASurfaceID output, target, reference;
+    VABufferID buffers[2], vpp_buffer;
+    unsigned int i;
+
+    setenv("LIBVA_WRAPPER_ASYNC", async, 1);
+    bench_load(&wrapper, "wrapper", wrapper_path);
+    bench_session_open(&s, &wrapper, VAProfileVP8Version0_3);
+    CHECK(VT(&s)->vaCreateConfig(CTX(&s), VAProfileNone, VAEntrypointVideoProc, NULL, 0, &vpp_config));
+    CHECK(VT(&s)->vaCreateSurfaces(CTX(&s), BENCH_WIDTH, BENCH_HEIGHT, VA_RT_FORMAT_YUV420, 1, &output));
+    CHECK(VT(&s)->vaCreateContext(CTX(&s), vpp_config, BENCH_WIDTH, BENCH_HEIGHT, VA_PROGRESSIVE,
+                                  &output, 1, &vpp_context));
+
+    for (i = 0; i < BENCH_CHECK_FRAMES; i++) {
+        target = s.surfaces[i % BENCH_NUM_SURFACES];
+        reference = s.surfaces[(i + BENCH_NUM_SURFACES - 1) % BENCH_NUM_SURFACES];
+
+        bench_create_pic_param(&s, i, 0, &buffers[0]);
+        CHECK(VT(&s)->vaCreateBuffer(CTX(&s), s.context, VASliceDataBufferType, 4096, 1, NULL, &buffers[1]));
+        CHECK(VT(&s)->vaBeginPicture(CTX(&s), s.context, target));
+        CHECK(VT(&s)->vaRenderPicture(CTX(&s), s.context, buffers, 2));
+        CHECK(VT(&s)->vaEndPicture(CTX(&s), s.context));
+
+        memset(&pipeline, 0, sizeof(pipeline));
+        pipeline.surface = target;
+        pipeline.forward_references = &reference;
+        pipeline.num_forward_references = 1;
+        CHECK(VT(&s)->vaCreateBuffer(CTX(&s), vpp_context, VAProcPipelineParameterBufferType,
+                                     sizeof(pipeline), 1, &pipeline, &vpp_buffer));
+        CHECK(VT(&s)->vaBeginPicture(CTX(&s), vpp_context, output));
+        CHECK(VT(&s)->vaRenderPicture(CTX(&s), vpp_context, &vpp_buffer, 1));
+        CHECK(VT(&s)->vaEndPicture(CTX(&s), vpp_context));
+        CHECK(VT(&s)->vaSyncSurface(CTX(&s), output));
+
+        CHECK(VT(&s)->vaDestroyBuffer(CTX(&s), vpp_buffer));
+        CHECK(VT(&s)->vaDestroyBuffer(CTX(&s), buffers[0]));
+        CHECK(VT(&s)->vaDestroyBuffer(CTX(&s), buffers[1]));
+    }
+
+    CHECK(VT(&s)->vaDestroyContext(CTX(&s), vpp_context));
+    CHECK(VT(&s)->vaDestroySurfaces(CTX(&s), &output, 1));
+    CHECK(VT(&s)->vaDestroyConfig(CTX(&s), vpp_config));
+    bench_session_close(&s);
+    bench_unload(&wrapper);
+    unsetenv("LIBVA_WRAPPER_ASYNC");
+
+    return bench_stub_stats(i965)->early_reads + bench_stub_stats(pvr)->early_reads - early_reads;
+}
+
+static void
+bench_fences(const char *wrapper_path, struct bench_driver *i965, struct bench_driver *pvr)
+{
+    int set_decode = bench_setenv_default("STUB_PVR_DECODE_US", "2000");
+    unsigned long sync_reads, async_reads;
+
+    printf("\nVP8 frames scaled on i965 as submitted, pvr decode %s us\n",
+           getenv("STUB_PVR_DECODE_US"));
+    printf("%-28s %12s\n", "LIBVA_WRAPPER_ASYNC=", "early reads");
+    sync_reads = bench_fences_run(wrapper_path, "0", i965, pvr);
+    printf("%-28s %12lu\n", "0", sync_reads);
+    async_reads = bench_fences_run(wrapper_path, "1", i965, pvr);
+    printf("%-28s %12lu\n", "1", async_reads);
+
+    if (set_decode)
+        unsetenv("STUB_PVR_DECODE_US");
+
+    if (sync_reads || async_reads) {
+        fprintf(stderr, "the stubs read %lu surfaces before they were decoded\n",
+                sync_reads + async_reads);
+        exit(1);
+    }
+}
+
+static void
+bench_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [-n iterations] [-s streams] [-w wrapper] [-d stub drivers directory]\n",
+            argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct bench_driver i965, pvr, wrapper;
+    const char *wrapper_path = WRAPPER_PATH;
+    const char *stub_dir = STUB_DRIVERS_PATH;
+    unsigned int iterations = 100000;
+    int num_streams = 4;
+    unsigned long bad_references;
+    char path[4096];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:w:d:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            num_streams = atoi(optarg);
+            break;
+        case 'w':
+            wrapper_path = optarg;
+            break;
+        case 'd':
+            stub_dir = optarg;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!iterations || num_streams <= 0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    /* The wrapper loads its backends from here, just as libva loads it */
+    setenv("LIBVA_DRIVERS_PATH", stub_dir, 1);
+
+    snprintf(path, sizeof(path), "%s/i965_drv_video.so", stub_dir);
+    bench_load(&i965, "i965", path);
+    snprintf(path, sizeof(path), "%s/pvr_drv_video.so", stub_dir);
+    bench_load(&pvr, "pvr", path);
+    bench_load(&wrapper, "wrapper", wrapper_path);
+
+    printf("%u iterations per entry point, best of 3 runs\n", iterations);
+    bench_profile("H.264 High", VAProfileH264High, &i965, &wrapper, iterations);
+    bench_profile("VP8", VAProfileVP8Version0_3, &pvr, &wrapper, iterations);
+    bench_unload(&wrapper);
+
+    bench_sharing(wrapper_path, &i965, &pvr);
+    bench_scaling(wrapper_path);
+    bench_balance(wrapper_path, num_streams);
+    bench_pipeline(wrapper_path);
+    bench_first_frame(wrapper_path);
+    bench_fences(wrapper_path, &i965, &pvr);
+    bench_lookup(iterations);
+
+    /* The wrapper must never have handed pvr a surface ID of i965 */
+    bad_references = bench_stub_stats(&pvr)->bad_references;
+
+    bench_unload(&pvr);
+    bench_unload(&i965);
+
+    if (bad_references) {
+        fprintf(stderr, "pvr saw %lu references to unknown surfaces\n", bad_references);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,826 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Replays a log written by the wrapper with LIBVA_WRAPPER_CAPTURE, see
+ * src/capture.h, against any driver: the wrapper on top of the stub drivers
+ * in this directory or of the real ones, or a single backend directly.
+ *
+ * Calls are made one after the other in the order they returned in the
+ * capture, as fast as possible or, with -t, at the times they were made.
+ * The IDs the driver returns are generally not the ones in the log, so
+ * every ID in the arguments, including the surface IDs inside parameter
+ * buffers, is translated to the object created by the replay of the call
+ * that returned it. Calls on drawables and palettes, which the log does not
+ * hold, are skipped.
+ */
+
+#include <va/va.h>
+#include <va/va_backend.h>
+#include <va/va_drmcommon.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include "call_stats.h"
+#include "capture.h"
+#include "param_buffer.h"
+
+#ifndef WRAPPER_PATH
+#define WRAPPER_PATH		"../src/.libs/wrapper_drv_video.so"
+#endif
+
+static const char * const replay_func_names[CALL_STATS_NUM_FUNCS] = {
+#define REPLAY_FUNC_NAME(func)	#func,
+    CALL_STATS_FUNCS(REPLAY_FUNC_NAME)
+#undef REPLAY_FUNC_NAME
+};
+
+/* An object created by the replay, found by the ID it had in the capture */
+struct replay_object {
+    VAGenericID captured_id;
+    VAGenericID id;
+    VAProfile profile;		/* configs and contexts */
+    VABufferType type;		/* buffers */
+    unsigned int size;
+    unsigned int num_elements;
+    void *mapped;
+};
+
+/* Open addressing on the captured ID. Objects are never removed: a captured
+ * ID the driver hands out again is simply pointed at the new object.
+ */
+struct replay_map {
+    struct replay_object **objects;
+    unsigned int capacity;		/* always a power of two */
+    unsigned int count;
+};
+
+struct replay {
+    struct VADriverContext ctx;
+    struct VADriverVTable vtable;
+    struct drm_state drm_state;
+    void *handle;
+    struct replay_map configs;
+    struct replay_map contexts;
+    struct replay_map surfaces;
+    struct replay_map buffers;
+    struct replay_map images;
+    struct replay_map subpictures;
+    unsigned long calls;
+    unsigned long skipped;
+    unsigned long mismatches;		/* status differs from the capture */
+    unsigned long pictures;
+};
+
+/* The arguments of a record, read front to back */
+struct replay_args {
+    uint8_t *next;
+    uint8_t *end;
+};
+
+static void
+replay_oom(void)
+{
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+}
+
+static unsigned int
+replay_hash(VAGenericID id)
+{
+    return id * 2654435761u;
+}
+
+static struct replay_object *
+replay_lookup(struct replay_map *map, VAGenericID captured_id)
+{
+    unsigned int i;
+
+    if (!map->capacity)
+        return NULL;
+
+    for (i = replay_hash(captured_id) & (map->capacity - 1); map->objects[i];
+         i = (i + 1) & (map->capacity - 1)) {
+        if (map->objects[i]->captured_id == captured_id)
+            return map->objects[i];
+    }
+
+    return NULL;
+}
+
+static void
+replay_map_add(struct replay_map *map, struct replay_object *object)
+{
+    unsigned int i;
+
+    for (i = replay_hash(object->captured_id) & (map->capacity - 1); map->objects[i];
+         i = (i + 1) & (map->capacity - 1))
+        ;
+    map->objects[i] = object;
+    map->count++;
+}
+
+/* Record that captured_id is id in the replay */
+static struct replay_object *
+replay_insert(struct replay_map *map, VAGenericID captured_id, VAGenericID id)
+{
+    struct replay_object **objects = map->objects;
+    unsigned int capacity = map->capacity;
+    struct replay_object *object;
+    unsigned int i;
+
+    object = replay_lookup(map, captured_id);
+    if (!object) {
+        if ((map->count + 1) * 2 > map->capacity) {
+            map->capacity = capacity ? capacity * 2 : 64;
+            map->objects = calloc(map->capacity, sizeof(*map->objects));
+            if (!map->objects)
+                replay_oom();
+            map->count = 0;
+            for (i = 0; i < capacity; i++) {
+                if (objects[i])
+                    replay_map_add(map, objects[i]);
+            }
+            free(objects);
+        }
+
+        object = calloc(1, sizeof(*object));
+        if (!object)
+            replay_oom();
+        object->captured_id = captured_id;
+        replay_map_add(map, object);
+    }
+
+    object->id = id;
+    object->mapped = NULL;
+
+    return object;
+}
+
+static void
+replay_map_fini(struct replay_map *map)
+{
+    unsigned int i;
+
+    for (i = 0; i < map->capacity; i++)
+        free(map->objects[i]);
+    free(map->objects);
+}
+
+/* The ID in the replay of captured_id, which is passed on as it is if the
+ * replay never saw it created, e.g. VA_INVALID_ID
+ */
+static VAGenericID
+replay_id(struct replay_map *map, VAGenericID captured_id)
+{
+    struct replay_object *object = replay_lookup(map, captured_id);
+
+    return object ? object->id : captured_id;
+}
+
+static void
+replay_ids(struct replay_map *map, VAGenericID *ids, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+        ids[i] = replay_id(map, ids[i]);
+}
+
+static VASurfaceID
+replay_surface(void *data, VASurfaceID surface)
+{
+    return replay_id(data, surface);
+}
+
+static uint32_t
+replay_u32(struct replay_args *args)
+{
+    uint32_t value = 0;
+
+    if (args->next + sizeof(value) <= args->end) {
+        memcpy(&value, args->next, sizeof(value));
+        args->next += sizeof(value);
+    }
+
+    return value;
+}
+
+/* A blob of the record, NULL if it is empty */
+static void *
+replay_blob(struct replay_args *args, uint32_t *size)
+{
+    uint32_t blob_size = replay_u32(args);
+    uint32_t padded = (blob_size + 3) & ~3u;
+    void *blob = args->next;
+
+    if (padded > (uint32_t)(args->end - args->next)) {
+        args->next = args->end;
+        blob_size = 0;
+    } else {
+        args->next += padded;
+    }
+
+    *size = blob_size;
+    return blob_size ? blob : NULL;
+}
+
+static void
+replay_translate_buffer(struct replay *replay, struct replay_object *buffer, void *data)
+{
+    const struct param_buffer_desc *desc = param_buffer_lookup(buffer->profile, buffer->type);
+
+    if (desc)
+        param_buffer_translate(desc, data, buffer->size, buffer->num_elements,
+                               replay_surface, &replay->surfaces);
+}
+
+static void
+replay_add_image(struct replay *replay, VAImage *captured, VAImage *image)
+{
+    struct replay_object *buffer;
+
+    replay_insert(&replay->images, captured->image_id, image->image_id);
+    buffer = replay_insert(&replay->buffers, captured->buf, image->buf);
+    buffer->profile = VAProfileNone;
+    buffer->type = VAImageBufferType;
+    buffer->size = image->data_size;
+    buffer->num_elements = 1;
+}
+
+/* Make the call of one record, return its status or -1 if it was skipped */
+static int
+replay_call(struct replay *replay, uint32_t func, struct replay_args *args)
+{
+    struct VADriverVTable *vt = replay->ctx.vtable;
+    VADriverContextP ctx = &replay->ctx;
+    struct replay_object *object;
+    VAStatus vaStatus;
+    uint32_t size, id;
+    void *blob;
+
+    switch (func) {
+    case CALL_STATS_vaQueryConfigProfiles: {
+        VAProfile profiles[ctx->max_profiles + 1];
+        int num_profiles;
+
+        return vt->vaQueryConfigProfiles(ctx, profiles, &num_profiles);
+    }
+    case CALL_STATS_vaQueryConfigEntrypoints: {
+        VAEntrypoint entrypoints[ctx->max_entrypoints + 1];
+        VAProfile profile = replay_u32(args);
+        int num_entrypoints;
+
+        return vt->vaQueryConfigEntrypoints(ctx, profile, entrypoints, &num_entrypoints);
+    }
+    case CALL_STATS_vaGetConfigAttributes: {
+        VAProfile profile = replay_u32(args);
+        VAEntrypoint entrypoint = replay_u32(args);
+
+        blob = replay_blob(args, &size);
+        return vt->vaGetConfigAttributes(ctx, profile, entrypoint, blob,
+                                         size / sizeof(VAConfigAttrib));
+    }
+    case CALL_STATS_vaCreateConfig: {
+        VAProfile profile = replay_u32(args);
+        VAEntrypoint entrypoint = replay_u32(args);
+        VAConfigID config;
+
+        blob = replay_blob(args, &size);
+        id = replay_u32(args);
+        vaStatus = vt->vaCreateConfig(ctx, profile, entrypoint, blob,
+                                      size / sizeof(VAConfigAttrib), &config);
+        if (vaStatus == VA_STATUS_SUCCESS) {
+            object = replay_insert(&replay->configs, id, config);
+            object->profile = profile;
+        }
+        return vaStatus;
+    }
+    case CALL_STATS_vaDestroyConfig:
+        return vt->vaDestroyConfig(ctx, replay_id(&replay->configs, replay_u32(args)));
+    case CALL_STATS_vaQueryConfigAttributes: {
+        VAConfigAttrib attribs[ctx->max_attributes + 1];
+        VAEntrypoint entrypoint;
+        VAProfile profile;
+        int num_attribs;
+
+        return vt->vaQueryConfigAttributes(ctx, replay_id(&replay->configs, replay_u32(args)),
+                                           &profile, &entrypoint, attribs, &num_attribs);
+    }
+    case CALL_STATS_vaCreateSurfaces: {
+        int width = replay_u32(args);
+        int height = replay_u32(args);
+        int format = replay_u32(args);
+        int num_surfaces = replay_u32(args);
+        VASurfaceID surfaces[num_surfaces > 0 ? num_surfaces : 1];
+        VASurfaceID *captured;
+        int i;
+
+        captured = replay_blob(args, &size);
+        vaStatus = vt->vaCreateSurfaces(ctx, width, height, format, num_surfaces, surfaces);
+        if (vaStatus == VA_STATUS_SUCCESS && captured) {
+            for (i = 0; i < num_surfaces && i < size / sizeof(*captured); i++)
+                replay_insert(&replay->surfaces, captured[i], surfaces[i]);
+        }
+        return vaStatus;
+    }
+    case CALL_STATS_vaDestroySurfaces:
+        blob = replay_blob(args, &size);
+        replay_ids(&replay->surfaces, blob, size / sizeof(VASurfaceID));
+        return vt->vaDestroySurfaces(ctx, blob, size / sizeof(VASurfaceID));
+    case CALL_STATS_vaCreateContext: {
+        struct replay_object *config = replay_lookup(&replay->configs, replay_u32(args));
+        int width = replay_u32(args);
+        int height = replay_u32(args);
+        int flag = replay_u32(args);
+        VAContextID context;
+
+        blob = replay_blob(args, &size);
+        id = replay_u32(args);
+        replay_ids(&replay->surfaces, blob, size / sizeof(VASurfaceID));
+        vaStatus = vt->vaCreateContext(ctx, config ? config->id : VA_INVALID_ID, width, height,
+                                       flag, blob, size / sizeof(VASurfaceID), &context);
+        if (vaStatus == VA_STATUS_SUCCESS) {
+            object = replay_insert(&replay->contexts, id, context);
+            object->profile = config ? config->profile : VAProfileNone;
+        }
+        return vaStatus;
+    }
+    case CALL_STATS_vaDestroyContext:
+        return vt->vaDestroyContext(ctx, replay_id(&replay->contexts, replay_u32(args)));
+    case CALL_STATS_vaCreateBuffer: {
+        struct replay_object *context = replay_lookup(&replay->contexts, replay_u32(args));
+        VABufferType type = replay_u32(args);
+        unsigned int buffer_size = replay_u32(args);
+        unsigned int num_elements = replay_u32(args);
+        struct replay_object buffer;
+        VABufferID buf_id;
+
+        blob = replay_blob(args, &size);
+        id = replay_u32(args);
+
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.profile = context ? context->profile : VAProfileNone;
+        buffer.type = type;
+        buffer.size = buffer_size;
+        buffer.num_elements = num_elements;
+        if (blob && size >= (uint64_t)buffer_size * num_elements)
+            replay_translate_buffer(replay, &buffer, blob);
+        else
+            blob = NULL;
+
+        vaStatus = vt->vaCreateBuffer(ctx, context ? context->id : VA_INVALID_ID, type,
+                                      buffer_size, num_elements, blob, &buf_id);
+        if (vaStatus == VA_STATUS_SUCCESS) {
+            buffer.captured_id = id;
+            buffer.id = buf_id;
+            *replay_insert(&replay->buffers, id, buf_id) = buffer;
+        }
+        return vaStatus;
+    }
+    case CALL_STATS_vaBufferSetNumElements: {
+        unsigned int num_elements;
+
+        object = replay_lookup(&replay->buffers, replay_u32(args));
+        num_elements = replay_u32(args);
+        vaStatus = vt->vaBufferSetNumElements(ctx, object ? object->id : VA_INVALID_ID, num_elements);
+        if (vaStatus == VA_STATUS_SUCCESS && object)
+            object->num_elements = num_elements;
+        return vaStatus;
+    }
+    case CALL_STATS_vaMapBuffer: {
+        void *mapped;
+
+        object = replay_lookup(&replay->buffers, replay_u32(args));
+        vaStatus = vt->vaMapBuffer(ctx, object ? object->id : VA_INVALID_ID, &mapped);
+        if (vaStatus == VA_STATUS_SUCCESS && object)
+            object->mapped = mapped;
+        return vaStatus;
+    }
+    case CALL_STATS_vaUnmapBuffer:
+        object = replay_lookup(&replay->buffers, replay_u32(args));
+        blob = replay_blob(args, &size);
+        if (object && object->mapped && blob &&
+            size == (uint64_t)object->size * object->num_elements) {
+            memcpy(object->mapped, blob, size);
+            replay_translate_buffer(replay, object, object->mapped);
+        }
+        if (object)
+            object->mapped = NULL;
+        return vt->vaUnmapBuffer(ctx, object ? object->id : VA_INVALID_ID);
+    case CALL_STATS_vaDestroyBuffer:
+        return vt->vaDestroyBuffer(ctx, replay_id(&replay->buffers, replay_u32(args)));
+    case CALL_STATS_vaBeginPicture: {
+        VAContextID context = replay_id(&replay->contexts, replay_u32(args));
+
+        return vt->vaBeginPicture(ctx, context, replay_id(&replay->surfaces, replay_u32(args)));
+    }
+    case CALL_STATS_vaRenderPicture: {
+        VAContextID context = replay_id(&replay->contexts, replay_u32(args));
+
+        blob = replay_blob(args, &size);
+        replay_ids(&replay->buffers, blob, size / sizeof(VABufferID));
+        return vt->vaRenderPicture(ctx, context, blob, size / sizeof(VABufferID));
+    }
+    case CALL_STATS_vaEndPicture:
+        replay->pictures++;
+        return vt->vaEndPicture(ctx, replay_id(&replay->contexts, replay_u32(args)));
+    case CALL_STATS_vaSyncSurface:
+        return vt->vaSyncSurface(ctx, replay_id(&replay->surfaces, replay_u32(args)));
+    case CALL_STATS_vaQuerySurfaceStatus: {
+        VASurfaceStatus status;
+
+        return vt->vaQuerySurfaceStatus(ctx, replay_id(&replay->surfaces, replay_u32(args)), &status);
+    }
+    case CALL_STATS_vaQueryImageFormats: {
+        VAImageFormat formats[ctx->max_image_formats + 1];
+        int num_formats;
+
+        return vt->vaQueryImageFormats(ctx, formats, &num_formats);
+    }
+    case CALL_STATS_vaCreateImage: {
+        VAImageFormat *format;
+        VAImage *captured;
+        VAImage image;
+        int width, height;
+
+        format = replay_blob(args, &size);
+        width = replay_u32(args);
+        height = replay_u32(args);
+        captured = replay_blob(args, &size);
+        if (!format)
+            return -1;
+
+        vaStatus = vt->vaCreateImage(ctx, format, width, height, &image);
+        if (vaStatus == VA_STATUS_SUCCESS && captured && size == sizeof(*captured))
+            replay_add_image(replay, captured, &image);
+        return vaStatus;
+    }
+    case CALL_STATS_vaDeriveImage: {
+        VASurfaceID surface = replay_id(&replay->surfaces, replay_u32(args));
+        VAImage *captured;
+        VAImage image;
+
+        captured = replay_blob(args, &size);
+        vaStatus = vt->vaDeriveImage(ctx, surface, &image);
+        if (vaStatus == VA_STATUS_SUCCESS && captured && size == sizeof(*captured))
+            replay_add_image(replay, captured, &image);
+        return vaStatus;
+    }
+    case CALL_STATS_vaDestroyImage:
+        return vt->vaDestroyImage(ctx, replay_id(&replay->images, replay_u32(args)));
+    case CALL_STATS_vaGetImage: {
+        VASurfaceID surface = replay_id(&replay->surfaces, replay_u32(args));
+        int x = replay_u32(args);
+        int y = replay_u32(args);
+        unsigned int width = replay_u32(args);
+        unsigned int height = replay_u32(args);
+
+        return vt->vaGetImage(ctx, surface, x, y, width, height,
+                              replay_id(&replay->images, replay_u32(args)));
+    }
+    case CALL_STATS_vaPutImage: {
+        VASurfaceID surface = replay_id(&replay->surfaces, replay_u32(args));
+        VAImageID image = replay_id(&replay->images, replay_u32(args));
+        int src_x = replay_u32(args);
+        int src_y = replay_u32(args);
+        unsigned int src_width = replay_u32(args);
+        unsigned int src_height = replay_u32(args);
+        int dest_x = replay_u32(args);
+        int dest_y = replay_u32(args);
+        unsigned int dest_width = replay_u32(args);
+        unsigned int dest_height = replay_u32(args);
+
+        return vt->vaPutImage(ctx, surface, image, src_x, src_y, src_width, src_height,
+                              dest_x, dest_y, dest_width, dest_height);
+    }
+    case CALL_STATS_vaQuerySubpictureFormats: {
+        VAImageFormat formats[ctx->max_subpic_formats + 1];
+        unsigned int flags[ctx->max_subpic_formats + 1];
+        unsigned int num_formats;
+
+        return vt->vaQuerySubpictureFormats(ctx, formats, flags, &num_formats);
+    }
+    case CALL_STATS_vaCreateSubpicture: {
+        VAImageID image = replay_id(&replay->images, replay_u32(args));
+        VASubpictureID subpicture;
+
+        id = replay_u32(args);
+        vaStatus = vt->vaCreateSubpicture(ctx, image, &subpicture);
+        if (vaStatus == VA_STATUS_SUCCESS)
+            replay_insert(&replay->subpictures, id, subpicture);
+        return vaStatus;
+    }
+    case CALL_STATS_vaDestroySubpicture:
+        return vt->vaDestroySubpicture(ctx, replay_id(&replay->subpictures, replay_u32(args)));
+    case CALL_STATS_vaSetSubpictureImage: {
+        VASubpictureID subpicture = replay_id(&replay->subpictures, replay_u32(args));
+
+        return vt->vaSetSubpictureImage(ctx, subpicture, replay_id(&replay->images, replay_u32(args)));
+    }
+    case CALL_STATS_vaSetSubpictureChromakey: {
+        VASubpictureID subpicture = replay_id(&replay->subpictures, replay_u32(args));
+        unsigned int chromakey_min = replay_u32(args);
+        unsigned int chromakey_max = replay_u32(args);
+        unsigned int chromakey_mask = replay_u32(args);
+
+        return vt->vaSetSubpictureChromakey(ctx, subpicture, chromakey_min, chromakey_max,
+                                            chromakey_mask);
+    }
+    case CALL_STATS_vaSetSubpictureGlobalAlpha: {
+        VASubpictureID subpicture = replay_id(&replay->subpictures, replay_u32(args));
+        uint32_t alpha = replay_u32(args);
+        float global_alpha;
+
+        memcpy(&global_alpha, &alpha, sizeof(global_alpha));
+        return vt->vaSetSubpictureGlobalAlpha(ctx, subpicture, global_alpha);
+    }
+    case CALL_STATS_vaAssociateSubpicture: {
+        VASubpictureID subpicture = replay_id(&replay->subpictures, replay_u32(args));
+        short src_x, src_y, dest_x, dest_y;
+        unsigned short src_width, src_height, dest_width, dest_height;
+
+        blob = replay_blob(args, &size);
+        replay_ids(&replay->surfaces, blob, size / sizeof(VASurfaceID));
+        src_x = replay_u32(args);
+        src_y = replay_u32(args);
+        src_width = replay_u32(args);
+        src_height = replay_u32(args);
+        dest_x = replay_u32(args);
+        dest_y = replay_u32(args);
+        dest_width = replay_u32(args);
+        dest_height = replay_u32(args);
+        return vt->vaAssociateSubpicture(ctx, subpicture, blob, size / sizeof(VASurfaceID),
+                                         src_x, src_y, src_width, src_height,
+                                         dest_x, dest_y, dest_width, dest_height,
+                                         replay_u32(args));
+    }
+    case CALL_STATS_vaDeassociateSubpicture: {
+        VASubpictureID subpicture = replay_id(&replay->subpictures, replay_u32(args));
+
+        blob = replay_blob(args, &size);
+        replay_ids(&replay->surfaces, blob, size / sizeof(VASurfaceID));
+        return vt->vaDeassociateSubpicture(ctx, subpicture, blob, size / sizeof(VASurfaceID));
+    }
+    case CALL_STATS_vaQueryDisplayAttributes: {
+        VADisplayAttribute attribs[ctx->max_display_attributes + 1];
+        int num_attribs;
+
+        return vt->vaQueryDisplayAttributes(ctx, attribs, &num_attribs);
+    }
+    case CALL_STATS_vaGetDisplayAttributes:
+        blob = replay_blob(args, &size);
+        return vt->vaGetDisplayAttributes(ctx, blob, size / sizeof(VADisplayAttribute));
+    case CALL_STATS_vaSetDisplayAttributes:
+        blob = replay_blob(args, &size);
+        return vt->vaSetDisplayAttributes(ctx, blob, size / sizeof(VADisplayAttribute));
+    case CALL_STATS_vaBufferInfo: {
+        unsigned int buffer_size, num_elements;
+        VABufferType type;
+
+        return vt->vaBufferInfo(ctx, replay_id(&replay->buffers, replay_u32(args)),
+                                &type, &buffer_size, &num_elements);
+    }
+    case CALL_STATS_vaLockSurface: {
+        unsigned int fourcc, luma_stride, chroma_u_stride, chroma_v_stride;
+        unsigned int luma_offset, chroma_u_offset, chroma_v_offset, buffer_name;
+        void *buffer;
+
+        return vt->vaLockSurface(ctx, replay_id(&replay->surfaces, replay_u32(args)), &fourcc,
+                                 &luma_stride, &chroma_u_stride, &chroma_v_stride,
+                                 &luma_offset, &chroma_u_offset, &chroma_v_offset,
+                                 &buffer_name, &buffer);
+    }
+    case CALL_STATS_vaUnlockSurface:
+        return vt->vaUnlockSurface(ctx, replay_id(&replay->surfaces, replay_u32(args)));
+    default:
+        /* vaPutSurface and vaSetImagePalette, and anything unknown */
+        return -1;
+    }
+}
+
+static uint64_t
+replay_now(void)
+{
+    return call_stats_now();
+}
+
+static void
+replay_wait(uint64_t until)
+{
+    uint64_t now = replay_now();
+    struct timespec ts;
+
+    if (until <= now)
+        return;
+
+    ts.tv_sec = (until - now) / 1000000000ull;
+    ts.tv_nsec = (until - now) % 1000000000ull;
+    nanosleep(&ts, NULL);
+}
+
+static void
+replay_load(struct replay *replay, const char *path, const char *device)
+{
+    VADriverInit init;
+    VAStatus vaStatus;
+
+    replay->ctx.vtable = &replay->vtable;
+
+    if (device) {
+        replay->drm_state.fd = open(device, O_RDWR);
+        if (replay->drm_state.fd < 0) {
+            perror(device);
+            exit(1);
+        }
+        replay->drm_state.auth_type = VA_DRM_AUTH_CUSTOM;
+        replay->ctx.drm_state = &replay->drm_state;
+        replay->ctx.display_type = VA_DISPLAY_DRM;
+    }
+
+    replay->handle = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
+    if (!replay->handle) {
+        fprintf(stderr, "dlopen of %s failed: %s\n", path, dlerror());
+        exit(1);
+    }
+
+    init = (VADriverInit)dlsym(replay->handle, "__vaDriverInit_0_32");
+    if (!init) {
+        fprintf(stderr, "%s has no function __vaDriverInit_0_32\n", path);
+        exit(1);
+    }
+
+    vaStatus = init(&replay->ctx);
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "%s init failed: 0x%x\n", path, vaStatus);
+        exit(1);
+    }
+}
+
+static void
+replay_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [-t] [-v] [-w driver] [-d drivers directory] [-r DRM device] capture\n"
+            "  -t  make the calls at the times they were captured\n"
+            "  -v  print every call whose status differs from the capture\n"
+            "  -w  driver to replay against, the wrapper by default\n"
+            "  -d  directories the wrapper loads its backends from\n"
+            "  -r  DRM device, e.g. /dev/dri/renderD128, for real drivers\n",
+            argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct capture_record_header header;
+    struct capture_file_header file_header;
+    const char *path = WRAPPER_PATH;
+    const char *device = NULL;
+    struct replay_args args;
+    struct replay replay;
+    uint64_t start, elapsed;
+    int timed = 0, verbose = 0;
+    uint8_t *record = NULL;
+    size_t record_size = 0;
+    FILE *file;
+    int status;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "tvw:d:r:h")) != -1) {
+        switch (opt) {
+        case 't':
+            timed = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'w':
+            path = optarg;
+            break;
+        case 'd':
+            setenv("LIBVA_DRIVERS_PATH", optarg, 1);
+            break;
+        case 'r':
+            device = optarg;
+            break;
+        default:
+            replay_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        replay_usage(argv[0]);
+        return 1;
+    }
+
+    file = fopen(argv[optind], "rb");
+    if (!file) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    if (fread(&file_header, sizeof(file_header), 1, file) != 1 ||
+        memcmp(file_header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) ||
+        file_header.version != CAPTURE_VERSION) {
+        fprintf(stderr, "%s is not a capture of version %d\n", argv[optind], CAPTURE_VERSION);
+        return 1;
+    }
+    if (!(file_header.flags & CAPTURE_FLAG_DATA))
+        fprintf(stderr, "The capture has no buffer contents, buffers are replayed uninitialized\n");
+
+    memset(&replay, 0, sizeof(replay));
+    replay_load(&replay, path, device);
+
+    start = replay_now();
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.size > record_size) {
+            free(record);
+            record_size = header.size;
+            record = malloc(record_size);
+            if (!record)
+                replay_oom();
+        }
+        if (header.size && fread(record, header.size, 1, file) != 1) {
+            fprintf(stderr, "Truncated record of %s\n",
+                    header.func < CALL_STATS_NUM_FUNCS ? replay_func_names[header.func] : "?");
+            break;
+        }
+
+        /* vaTerminate is made at the end in any case */
+        if (header.func == CALL_STATS_vaTerminate)
+            break;
+
+        if (timed)
+            replay_wait(start + header.time);
+
+        args.next = record;
+        args.end = record + header.size;
+        status = replay_call(&replay, header.func, &args);
+        if (status < 0) {
+            replay.skipped++;
+            continue;
+        }
+
+        replay.calls++;
+        if (status != header.status) {
+            replay.mismatches++;
+            if (verbose)
+                fprintf(stderr, "%s returned 0x%x, captured 0x%x\n",
+                        header.func < CALL_STATS_NUM_FUNCS ? replay_func_names[header.func] : "?",
+                        status, header.status);
+        }
+    }
+    elapsed = replay_now() - start;
+
+    replay.ctx.vtable->vaTerminate(&replay.ctx);
+    fclose(file);
+    free(record);
+
+    printf("%lu calls replayed in %.3f ms, %lu skipped, %lu returned another status\n",
+           replay.calls, elapsed / 1e6, replay.skipped, replay.mismatches);
+    if (replay.pictures)
+        printf("%lu pictures, %.1f per second, %.1f us per picture\n",
+               replay.pictures, replay.pictures * 1e9 / elapsed, elapsed / 1e3 / replay.pictures);
+
+    replay_map_fini(&replay.configs);
+    replay_map_fini(&replay.contexts);
+    replay_map_fini(&replay.surfaces);
+    replay_map_fini(&replay.buffers);
+    replay_map_fini(&replay.images);
+    replay_map_fini(&replay.subpictures);
+    if (device)
+        close(replay.drm_state.fd);
+
+    return replay.mismatches ? 1 : 0;
+}
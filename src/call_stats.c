@@ -0,0 +1,224 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "call_stats.h"
+
+#include <stdlib.h>
+
+static const char * const call_stats_names[CALL_STATS_NUM_FUNCS] = {
+#define CALL_STATS_NAME(func)	#func,
+    CALL_STATS_FUNCS(CALL_STATS_NAME)
+#undef CALL_STATS_NAME
+};
+
+static void
+call_stats_add(struct call_stats_entry *total, const struct call_stats_entry *entry)
+{
+    int i;
+
+    total->count += entry->count;
+    total->total_ns += entry->total_ns;
+    if (entry->max_ns > total->max_ns)
+        total->max_ns = entry->max_ns;
+    for (i = 0; i < CALL_STATS_NUM_BUCKETS; i++)
+        total->buckets[i] += entry->buckets[i];
+}
+
+static struct call_stats_thread *
+call_stats_alloc_thread(struct call_stats *stats)
+{
+    struct call_stats_thread *thread;
+
+    thread = calloc(1, sizeof(*thread) +
+                    stats->num_drv * CALL_STATS_NUM_FUNCS * sizeof(thread->entries[0]));
+    if (thread)
+        thread->stats = stats;
+
+    return thread;
+}
+
+/* Destructor of the key, run when a thread that recorded calls exits */
+static void
+call_stats_thread_exit(void *data)
+{
+    struct call_stats_thread *thread = data;
+    struct call_stats *stats = thread->stats;
+    int i;
+
+    pthread_mutex_lock(&stats->lock);
+    for (i = 0; i < stats->num_drv * CALL_STATS_NUM_FUNCS; i++)
+        call_stats_add(&stats->exited->entries[i], &thread->entries[i]);
+    list_del(&thread->link);
+    pthread_mutex_unlock(&stats->lock);
+
+    free(thread);
+}
+
+struct call_stats *
+call_stats_create(int num_drv)
+{
+    struct call_stats *stats;
+
+    stats = calloc(1, sizeof(*stats));
+    if (!stats)
+        return NULL;
+
+    stats->num_drv = num_drv;
+    stats->exited = call_stats_alloc_thread(stats);
+    if (!stats->exited) {
+        free(stats);
+        return NULL;
+    }
+
+    if (pthread_key_create(&stats->key, call_stats_thread_exit)) {
+        free(stats->exited);
+        free(stats);
+        return NULL;
+    }
+
+    pthread_mutex_init(&stats->lock, NULL);
+    list_init(&stats->threads);
+
+    return stats;
+}
+
+void
+call_stats_destroy(struct call_stats *stats)
+{
+    struct call_stats_thread *thread, *next;
+
+    if (!stats)
+        return;
+
+    /* No destructor runs once the key is gone, the blocks of the threads
+     * still alive are freed here.
+     */
+    pthread_key_delete(stats->key);
+
+    list_for_each_entry_safe(thread, next, &stats->threads, link) {
+        list_del(&thread->link);
+        free(thread);
+    }
+
+    pthread_mutex_destroy(&stats->lock);
+    free(stats->exited);
+    free(stats);
+}
+
+static struct call_stats_thread *
+call_stats_get_thread(struct call_stats *stats)
+{
+    struct call_stats_thread *thread = pthread_getspecific(stats->key);
+
+    if (thread)
+        return thread;
+
+    thread = call_stats_alloc_thread(stats);
+    if (!thread)
+        return NULL;
+
+    pthread_mutex_lock(&stats->lock);
+    list_add(&thread->link, &stats->threads);
+    pthread_mutex_unlock(&stats->lock);
+    pthread_setspecific(stats->key, thread);
+
+    return thread;
+}
+
+void
+call_stats_record(struct call_stats *stats, int drv, enum call_stats_func func, uint64_t start)
+{
+    struct call_stats_thread *thread = call_stats_get_thread(stats);
+    struct call_stats_entry *entry;
+    uint64_t ns = call_stats_now() - start;
+    int bucket;
+
+    if (!thread)
+        return;
+
+    bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= CALL_STATS_NUM_BUCKETS)
+        bucket = CALL_STATS_NUM_BUCKETS - 1;
+
+    entry = &thread->entries[drv * CALL_STATS_NUM_FUNCS + func];
+    entry->count++;
+    entry->total_ns += ns;
+    if (ns > entry->max_ns)
+        entry->max_ns = ns;
+    entry->buckets[bucket]++;
+}
+
+/* Upper bound of the bucket that holds the given fraction of the calls */
+static uint64_t
+call_stats_percentile(const struct call_stats_entry *entry, unsigned int percent)
+{
+    uint64_t target = (entry->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < CALL_STATS_NUM_BUCKETS - 1; i++) {
+        seen += entry->buckets[i];
+        if (seen >= target)
+            return (uint64_t)1 << i;
+    }
+
+    return entry->max_ns;
+}
+
+void
+call_stats_dump(struct call_stats *stats,
+                const char * const *drv_names,
+                void (*print)(const char *msg, ...))
+{
+    struct call_stats_thread *thread;
+    struct call_stats_entry total;
+    int drv, func;
+
+    if (!stats)
+        return;
+
+    pthread_mutex_lock(&stats->lock);
+    for (drv = 0; drv < stats->num_drv; drv++) {
+        print("%s call statistics (count, mean, p50, p99, max in ns):\n", drv_names[drv]);
+
+        for (func = 0; func < CALL_STATS_NUM_FUNCS; func++) {
+            total = stats->exited->entries[drv * CALL_STATS_NUM_FUNCS + func];
+            list_for_each_entry(thread, &stats->threads, link)
+                call_stats_add(&total, &thread->entries[drv * CALL_STATS_NUM_FUNCS + func]);
+
+            if (!total.count)
+                continue;
+
+            print("  %-28s %10llu %10llu %10llu %10llu %10llu\n",
+                  call_stats_names[func],
+                  (unsigned long long)total.count,
+                  (unsigned long long)(total.total_ns / total.count),
+                  (unsigned long long)call_stats_percentile(&total, 50),
+                  (unsigned long long)call_stats_percentile(&total, 99),
+                  (unsigned long long)total.max_ns);
+        }
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
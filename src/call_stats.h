@@ -0,0 +1,174 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CALL_STATS_H_
+#define _CALL_STATS_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "list.h"
+
+/**
+ * @file Call counters and latency histograms for the backend vtables.
+ *
+ * Every thread that calls into a backend gets its own block of counters,
+ * found through a pthread key, so recording a call takes no lock and
+ * touches no cache line shared with another thread. Blocks are only linked
+ * into a list, under a mutex, the first time a thread records a call, and
+ * are summed up by call_stats_dump. When a thread exits, its counters are
+ * added to those of the threads that exited before and its block is freed,
+ * so threads that come and go do not grow the statistics.
+ *
+ * Latencies go into power-of-two buckets: bucket i counts calls that took
+ * less than 2^i ns and at least 2^(i-1) ns.
+ *
+ * Example:
+ *
+ *     stats = call_stats_create(num_drv);
+ *     start = call_stats_now();
+ *     vtable->vaBeginPicture(...);
+ *     call_stats_record(stats, drv, CALL_STATS_vaBeginPicture, start);
+ *     call_stats_dump(stats, drv_names, vawr_infoMessage);
+ *     call_stats_destroy(stats);
+ */
+
+#define CALL_STATS_FUNCS(X)		\
+    X(vaTerminate)			\
+    X(vaQueryConfigProfiles)		\
+    X(vaQueryConfigEntrypoints)		\
+    X(vaGetConfigAttributes)		\
+    X(vaCreateConfig)			\
+    X(vaDestroyConfig)			\
+    X(vaQueryConfigAttributes)		\
+    X(vaCreateSurfaces)			\
+    X(vaDestroySurfaces)		\
+    X(vaCreateContext)			\
+    X(vaDestroyContext)			\
+    X(vaCreateBuffer)			\
+    X(vaBufferSetNumElements)		\
+    X(vaMapBuffer)			\
+    X(vaUnmapBuffer)			\
+    X(vaDestroyBuffer)			\
+    X(vaBeginPicture)			\
+    X(vaRenderPicture)			\
+    X(vaEndPicture)			\
+    X(vaSyncSurface)			\
+    X(vaQuerySurfaceStatus)		\
+    X(vaQuerySurfaceError)		\
+    X(vaPutSurface)			\
+    X(vaQueryImageFormats)		\
+    X(vaCreateImage)			\
+    X(vaDeriveImage)			\
+    X(vaDestroyImage)			\
+    X(vaSetImagePalette)		\
+    X(vaGetImage)			\
+    X(vaPutImage)			\
+    X(vaQuerySubpictureFormats)		\
+    X(vaCreateSubpicture)		\
+    X(vaDestroySubpicture)		\
+    X(vaSetSubpictureImage)		\
+    X(vaSetSubpictureChromakey)		\
+    X(vaSetSubpictureGlobalAlpha)	\
+    X(vaAssociateSubpicture)		\
+    X(vaDeassociateSubpicture)		\
+    X(vaQueryDisplayAttributes)		\
+    X(vaGetDisplayAttributes)		\
+    X(vaSetDisplayAttributes)		\
+    X(vaBufferInfo)			\
+    X(vaLockSurface)			\
+    X(vaUnlockSurface)			\
+    X(vaGetSurfaceAttributes)		\
+    X(vaCreateSurfaces2)		\
+    X(vaQuerySurfaceAttributes)		\
+    X(vaAcquireBufferHandle)		\
+    X(vaReleaseBufferHandle)
+
+enum call_stats_func {
+#define CALL_STATS_ENUM(func)	CALL_STATS_##func,
+    CALL_STATS_FUNCS(CALL_STATS_ENUM)
+#undef CALL_STATS_ENUM
+    CALL_STATS_NUM_FUNCS
+};
+
+#define CALL_STATS_NUM_BUCKETS	32
+
+struct call_stats_entry {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[CALL_STATS_NUM_BUCKETS];
+};
+
+struct call_stats_thread {
+    struct list link;
+    struct call_stats *stats;
+    struct call_stats_entry entries[];	/* num_drv * CALL_STATS_NUM_FUNCS */
+};
+
+struct call_stats {
+    int num_drv;
+    pthread_key_t key;
+    pthread_mutex_t lock;		/* protects threads and exited */
+    struct list threads;
+    struct call_stats_thread *exited;	/* totals of the threads that exited */
+};
+
+static inline uint64_t
+call_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @return The new statistics or NULL if they could not be allocated.
+ */
+struct call_stats *
+call_stats_create(int num_drv);
+
+void
+call_stats_destroy(struct call_stats *stats);
+
+/**
+ * Record a call to func of backend drv that started at start, a time
+ * returned by call_stats_now.
+ */
+void
+call_stats_record(struct call_stats *stats, int drv, enum call_stats_func func, uint64_t start);
+
+/**
+ * Print the totals over all threads, one line per function that was
+ * called, grouped by backend. drv_names holds num_drv names.
+ */
+void
+call_stats_dump(struct call_stats *stats,
+                const char * const *drv_names,
+                void (*print)(const char *msg, ...));
+
+#endif
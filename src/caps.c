@@ -0,0 +1,225 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "caps.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CAPS_FILE_MAGIC		"VAWRCAPS"
+
+/* The layout of a cache file, written and mapped as is */
+struct caps_file {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;		/* of the whole file, changes with the headers built against */
+    uint64_t key;
+    struct caps_limits limits;
+    struct caps_table caps;
+};
+
+static int
+caps_table_has_profile(const struct caps_table *caps, VAProfile profile)
+{
+    int i;
+
+    for (i = 0; i < caps->num_profiles; i++) {
+        if (caps->profiles[i] == profile)
+            return 1;
+    }
+
+    return 0;
+}
+
+struct caps_table *
+caps_table_create(void)
+{
+    return calloc(1, sizeof(struct caps_table));
+}
+
+void
+caps_table_destroy(struct caps_table *caps)
+{
+    free(caps);
+}
+
+int
+caps_table_add_profile(struct caps_table *caps, VAProfile profile)
+{
+    if (caps_table_has_profile(caps, profile))
+        return 0;
+    if (caps->num_profiles == CAPS_MAX_PROFILES)
+        return -1;
+
+    caps->profiles[caps->num_profiles++] = profile;
+    return 0;
+}
+
+struct caps_config *
+caps_table_add(struct caps_table *caps, VAProfile profile, VAEntrypoint entrypoint)
+{
+    struct caps_config *config = (struct caps_config *)caps_table_find(caps, profile, entrypoint);
+    int i;
+
+    if (config)
+        return config;
+    if (caps->num_configs == CAPS_MAX_CONFIGS ||
+        caps_table_add_profile(caps, profile))
+        return NULL;
+
+    config = &caps->configs[caps->num_configs++];
+    config->profile = profile;
+    config->entrypoint = entrypoint;
+    for (i = 0; i < CAPS_NUM_ATTRIBS; i++)
+        config->attribs[i] = VA_ATTRIB_NOT_SUPPORTED;
+
+    return config;
+}
+
+int
+caps_table_entrypoints(const struct caps_table *caps, VAProfile profile,
+                       VAEntrypoint *entrypoint_list)
+{
+    int num_entrypoints = 0;
+    int i;
+
+    for (i = 0; i < caps->num_configs; i++) {
+        if (caps->configs[i].profile == profile)
+            entrypoint_list[num_entrypoints++] = caps->configs[i].entrypoint;
+    }
+
+    /* A profile can be listed without any entrypoint */
+    return num_entrypoints || caps_table_has_profile(caps, profile) ? num_entrypoints : -1;
+}
+
+VAStatus
+caps_table_attributes(const struct caps_table *caps, VAProfile profile, VAEntrypoint entrypoint,
+                      VAConfigAttrib *attrib_list, int num_attribs)
+{
+    const struct caps_config *config = caps_table_find(caps, profile, entrypoint);
+    int i;
+
+    if (!config)
+        return caps_table_has_profile(caps, profile) ?
+            VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT : VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+
+    for (i = 0; i < num_attribs; i++) {
+        if ((unsigned int)attrib_list[i].type < CAPS_NUM_ATTRIBS)
+            attrib_list[i].value = config->attribs[attrib_list[i].type];
+        else
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+int
+caps_table_save(const struct caps_table *caps, const struct caps_limits *limits,
+                uint64_t key, const char *path)
+{
+    struct caps_file *file;
+    char tmp_path[4096];
+    ssize_t written;
+    int fd;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid()) >= (int)sizeof(tmp_path))
+        return -1;
+
+    file = calloc(1, sizeof(*file));
+    if (!file)
+        return -1;
+    memcpy(file->magic, CAPS_FILE_MAGIC, sizeof(file->magic));
+    file->version = CAPS_FILE_VERSION;
+    file->size = sizeof(*file);
+    file->key = key;
+    file->limits = *limits;
+    file->caps = *caps;
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(file);
+        return -1;
+    }
+    written = write(fd, file, sizeof(*file));
+    free(file);
+    if (close(fd) || written != (ssize_t)sizeof(struct caps_file) ||
+        rename(tmp_path, path)) {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+struct caps_table *
+caps_table_map(const char *path, uint64_t key, struct caps_limits *limits)
+{
+    struct caps_file *file;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) || st.st_size != (off_t)sizeof(*file)) {
+        close(fd);
+        return NULL;
+    }
+    file = mmap(NULL, sizeof(*file), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        return NULL;
+
+    if (memcmp(file->magic, CAPS_FILE_MAGIC, sizeof(file->magic)) ||
+        file->version != CAPS_FILE_VERSION ||
+        file->size != sizeof(*file) ||
+        file->key != key ||
+        file->caps.num_profiles < 0 || file->caps.num_profiles > CAPS_MAX_PROFILES ||
+        file->caps.num_configs < 0 || file->caps.num_configs > CAPS_MAX_CONFIGS ||
+        file->limits.max_profiles < 0 || file->limits.max_entrypoints < 0 ||
+        file->limits.max_attributes < 0 || file->limits.max_image_formats < 0 ||
+        file->limits.max_subpic_formats < 0 || file->limits.max_display_attributes < 0) {
+        munmap(file, sizeof(*file));
+        return NULL;
+    }
+
+    *limits = file->limits;
+    limits->vendor[CAPS_VENDOR_SIZE - 1] = '\0';
+
+    return &file->caps;
+}
+
+void
+caps_table_unmap(struct caps_table *caps)
+{
+    if (caps)
+        munmap((char *)caps - offsetof(struct caps_file, caps), sizeof(struct caps_file));
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CAPS_H_
+#define _CAPS_H_
+
+#include <stdint.h>
+#include <va/va.h>
+
+/**
+ * @file Table of the profiles, entrypoints and config attributes of all
+ * backends, merged into what the wrapper as a whole supports.
+ *
+ * It is filled once, when the driver is initialized, and answers
+ * vaQueryConfigProfiles, vaQueryConfigEntrypoints and vaGetConfigAttributes
+ * from then on, which frameworks call many times while probing a device.
+ * Profiles keep the order they are added in, and every (profile, entrypoint)
+ * pair holds the value of each VAConfigAttribType, VA_ATTRIB_NOT_SUPPORTED
+ * unless set. The table is a single block without pointers.
+ *
+ * It can be saved to a cache file along with the limits the primary backend
+ * reported at init, and mapped back by later processes, which then need not
+ * load any backend to answer the queries. The file is tagged with a key the
+ * caller derives from whatever the table depends on, and is ignored unless
+ * the key, the layout and the version match.
+ *
+ * Example:
+ *
+ *     caps = caps_table_create();
+ *     config = caps_table_add(caps, VAProfileVP8Version0_3, VAEntrypointVLD);
+ *     config->attribs[VAConfigAttribRTFormat] = VA_RT_FORMAT_YUV420;
+ *     num_entrypoints = caps_table_entrypoints(caps, profile, entrypoint_list);
+ *     caps_table_save(caps, &limits, key, path);
+ *     caps_table_destroy(caps);
+ *
+ *     caps = caps_table_map(path, key, &limits);
+ *     caps_table_unmap(caps);
+ */
+
+#define CAPS_FILE_VERSION	2	/* bumped when what a table holds changes */
+
+#define CAPS_MAX_PROFILES	64
+#define CAPS_MAX_CONFIGS	256
+#define CAPS_NUM_ATTRIBS	VAConfigAttribTypeMax
+
+struct caps_config {
+    VAProfile profile;
+    VAEntrypoint entrypoint;
+    unsigned int attribs[CAPS_NUM_ATTRIBS];	/* indexed by VAConfigAttribType */
+};
+
+#define CAPS_VENDOR_SIZE	256
+
+/* What the primary backend publishes in VADriverContext */
+struct caps_limits {
+    int version_major;
+    int version_minor;
+    int max_profiles;
+    int max_entrypoints;
+    int max_attributes;
+    int max_image_formats;
+    int max_subpic_formats;
+    int max_display_attributes;
+    char vendor[CAPS_VENDOR_SIZE];
+};
+
+struct caps_table {
+    int num_profiles;
+    VAProfile profiles[CAPS_MAX_PROFILES];
+    int num_configs;
+    struct caps_config configs[CAPS_MAX_CONFIGS];
+};
+
+struct caps_table *
+caps_table_create(void);
+
+void
+caps_table_destroy(struct caps_table *caps);
+
+/**
+ * Save caps and limits to the file at path, tagged with key. The file is
+ * replaced as a whole, so processes mapping it at the same time see either
+ * the old or the new one.
+ *
+ * @return 0, or -1 if it could not be written.
+ */
+int
+caps_table_save(const struct caps_table *caps, const struct caps_limits *limits,
+                uint64_t key, const char *path);
+
+/**
+ * Map the table saved to the file at path, and copy its limits to limits.
+ *
+ * @return The table, to be released with caps_table_unmap and not to be
+ * changed, or NULL if there is no file saved with key.
+ */
+struct caps_table *
+caps_table_map(const char *path, uint64_t key, struct caps_limits *limits);
+
+void
+caps_table_unmap(struct caps_table *caps);
+
+/**
+ * Add profile with no entrypoints, if it is not in caps yet.
+ *
+ * @return 0, or -1 if caps is full.
+ */
+int
+caps_table_add_profile(struct caps_table *caps, VAProfile profile);
+
+/**
+ * Add profile and entrypoint, with no attributes supported, if they are not
+ * in caps yet.
+ *
+ * @return Their entry, NULL if caps is full.
+ */
+struct caps_config *
+caps_table_add(struct caps_table *caps, VAProfile profile, VAEntrypoint entrypoint);
+
+/**
+ * @return The entry of profile and entrypoint, NULL if they are not in caps.
+ */
+static inline const struct caps_config *
+caps_table_find(const struct caps_table *caps, VAProfile profile, VAEntrypoint entrypoint)
+{
+    int i;
+
+    for (i = 0; i < caps->num_configs; i++) {
+        if (caps->configs[i].profile == profile &&
+            caps->configs[i].entrypoint == entrypoint)
+            return &caps->configs[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * Write the entrypoints of profile to entrypoint_list, which has room for
+ * CAPS_MAX_CONFIGS of them.
+ *
+ * @return How many were written, -1 if profile is not in caps.
+ */
+int
+caps_table_entrypoints(const struct caps_table *caps, VAProfile profile,
+                       VAEntrypoint *entrypoint_list);
+
+/**
+ * Fill in the value of every attribute in attrib_list for profile and
+ * entrypoint, like vaGetConfigAttributes.
+ */
+VAStatus
+caps_table_attributes(const struct caps_table *caps, VAProfile profile, VAEntrypoint entrypoint,
+                      VAConfigAttrib *attrib_list, int num_attribs);
+
+#endif
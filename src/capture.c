@@ -0,0 +1,1074 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "capture.h"
+#include "wrapper_drv_video.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define CAPTURE_GET(ctx)	(((struct vawr_driver_data *)GET_VAWRDATA(ctx))->capture)
+
+/* The record of one call, collected in memory and written out in one go so
+ * records of concurrent calls never interleave
+ */
+struct capture_record {
+    struct capture_record_header header;
+    uint8_t *args;
+    size_t capacity;
+    int failed;			/* out of memory, the record is dropped */
+    uint8_t inline_args[256];	/* enough for anything but buffer contents */
+};
+
+static __thread uint32_t capture_thread;
+
+static void
+capture_begin(struct capture *capture, struct capture_record *record, int func)
+{
+    if (!capture_thread)
+        capture_thread = syscall(SYS_gettid);
+
+    record->header.func = func;
+    record->header.size = 0;
+    record->header.time = call_stats_now() - capture->start;
+    record->header.thread = capture_thread;
+    record->header.status = VA_STATUS_SUCCESS;
+    record->args = record->inline_args;
+    record->capacity = sizeof(record->inline_args);
+    record->failed = 0;
+}
+
+static void *
+capture_reserve(struct capture_record *record, size_t size)
+{
+    size_t capacity = record->capacity;
+    uint8_t *args;
+
+    if (record->failed)
+        return NULL;
+
+    /* The header holds the size of the arguments in 32 bits */
+    if (size > UINT32_MAX - record->header.size) {
+        record->failed = 1;
+        return NULL;
+    }
+
+    if (record->header.size + size > capacity) {
+        while (record->header.size + size > capacity)
+            capacity *= 2;
+
+        if (record->args == record->inline_args) {
+            args = malloc(capacity);
+            if (args)
+                memcpy(args, record->args, record->header.size);
+        } else {
+            args = realloc(record->args, capacity);
+        }
+        if (!args) {
+            record->failed = 1;
+            return NULL;
+        }
+
+        record->args = args;
+        record->capacity = capacity;
+    }
+
+    args = record->args + record->header.size;
+    record->header.size += size;
+
+    return args;
+}
+
+static void
+capture_u32(struct capture_record *record, uint32_t value)
+{
+    void *args = capture_reserve(record, sizeof(value));
+
+    if (args)
+        memcpy(args, &value, sizeof(value));
+}
+
+/* Log count elements of size bytes each, a negative count as none */
+static void
+capture_blob(struct capture_record *record, const void *data, int count, size_t size)
+{
+    size_t padded;
+    uint8_t *args;
+
+    if (!data || count < 0)
+        count = 0;
+    if (count && size > (UINT32_MAX - 3) / count) {
+        record->failed = 1;
+        return;
+    }
+    size *= count;
+    padded = (size + 3) & ~(size_t)3;
+
+    capture_u32(record, (uint32_t)size);
+    args = capture_reserve(record, padded);
+    if (args) {
+        memcpy(args, data, size);
+        memset(args + size, 0, padded - size);
+    }
+}
+
+/* Write the record out, with capture->lock held */
+static void
+capture_write(struct capture *capture, struct capture_record *record, VAStatus status)
+{
+    record->header.status = status;
+
+    if (!capture->failed && !record->failed) {
+        if (fwrite(&record->header, sizeof(record->header), 1, capture->file) != 1 ||
+            (record->header.size &&
+             fwrite(record->args, record->header.size, 1, capture->file) != 1)) {
+            vawr_errorMessage("capture write failed, no more calls are logged\n");
+            capture->failed = 1;
+        }
+    }
+
+    if (record->args != record->inline_args)
+        free(record->args);
+}
+
+static void
+capture_end(struct capture *capture, struct capture_record *record, VAStatus status)
+{
+    pthread_mutex_lock(&capture->lock);
+    capture_write(capture, record, status);
+    pthread_mutex_unlock(&capture->lock);
+}
+
+/* Destroys keep the log locked while they run. Once the backend has freed
+ * the ID, a create on another thread can get it back, and its record must
+ * not go into the log before the one of the destroy.
+ */
+#define CAPTURE_DESTROY(capture, record, status, func, ...)	\
+    do {	\
+        pthread_mutex_lock(&(capture)->lock);	\
+        status = (capture)->next.func(ctx, ##__VA_ARGS__);	\
+        capture_write(capture, record, status);	\
+        pthread_mutex_unlock(&(capture)->lock);	\
+    } while (0)
+
+/* Take the mapping of buf_id out of the list, NULL if it is not mapped */
+static struct capture_mapping *
+capture_unmap(struct capture *capture, VABufferID buf_id)
+{
+    struct capture_mapping *mapping, *found = NULL;
+
+    pthread_mutex_lock(&capture->mappings_lock);
+    LIST_FOR_EACH_ENTRY(mapping, &capture->mappings, link) {
+        if (mapping->buf_id == buf_id) {
+            LIST_DEL(&mapping->link);
+            found = mapping;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&capture->mappings_lock);
+
+    return found;
+}
+
+static VAStatus
+capture_Terminate(VADriverContextP ctx)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    /* The wrapper's driver data is gone after this */
+    capture_begin(capture, &record, CALL_STATS_vaTerminate);
+    vaStatus = capture->next.vaTerminate(ctx);
+    capture_end(capture, &record, vaStatus);
+
+    capture_destroy(capture);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_QueryConfigProfiles(VADriverContextP ctx, VAProfile *profile_list, int *num_profiles)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaQueryConfigProfiles);
+    vaStatus = capture->next.vaQueryConfigProfiles(ctx, profile_list, num_profiles);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_QueryConfigEntrypoints(VADriverContextP ctx, VAProfile profile,
+                               VAEntrypoint *entrypoint_list, int *num_entrypoints)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaQueryConfigEntrypoints);
+    capture_u32(&record, profile);
+    vaStatus = capture->next.vaQueryConfigEntrypoints(ctx, profile, entrypoint_list, num_entrypoints);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_GetConfigAttributes(VADriverContextP ctx, VAProfile profile, VAEntrypoint entrypoint,
+                            VAConfigAttrib *attrib_list, int num_attribs)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaGetConfigAttributes);
+    capture_u32(&record, profile);
+    capture_u32(&record, entrypoint);
+    capture_blob(&record, attrib_list, num_attribs, sizeof(*attrib_list));
+    vaStatus = capture->next.vaGetConfigAttributes(ctx, profile, entrypoint, attrib_list, num_attribs);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_CreateConfig(VADriverContextP ctx, VAProfile profile, VAEntrypoint entrypoint,
+                     VAConfigAttrib *attrib_list, int num_attribs, VAConfigID *config_id)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaCreateConfig);
+    capture_u32(&record, profile);
+    capture_u32(&record, entrypoint);
+    capture_blob(&record, attrib_list, num_attribs, sizeof(*attrib_list));
+    vaStatus = capture->next.vaCreateConfig(ctx, profile, entrypoint, attrib_list, num_attribs, config_id);
+    capture_u32(&record, vaStatus == VA_STATUS_SUCCESS ? *config_id : VA_INVALID_ID);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DestroyConfig(VADriverContextP ctx, VAConfigID config_id)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaDestroyConfig);
+    capture_u32(&record, config_id);
+    CAPTURE_DESTROY(capture, &record, vaStatus, vaDestroyConfig, config_id);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_QueryConfigAttributes(VADriverContextP ctx, VAConfigID config_id, VAProfile *profile,
+                              VAEntrypoint *entrypoint, VAConfigAttrib *attrib_list, int *num_attribs)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaQueryConfigAttributes);
+    capture_u32(&record, config_id);
+    vaStatus = capture->next.vaQueryConfigAttributes(ctx, config_id, profile, entrypoint,
+                                                     attrib_list, num_attribs);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_CreateSurfaces(VADriverContextP ctx, int width, int height, int format,
+                       int num_surfaces, VASurfaceID *surfaces)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaCreateSurfaces);
+    capture_u32(&record, width);
+    capture_u32(&record, height);
+    capture_u32(&record, format);
+    capture_u32(&record, num_surfaces);
+    vaStatus = capture->next.vaCreateSurfaces(ctx, width, height, format, num_surfaces, surfaces);
+    capture_blob(&record, vaStatus == VA_STATUS_SUCCESS ? surfaces : NULL,
+                 num_surfaces, sizeof(*surfaces));
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DestroySurfaces(VADriverContextP ctx, VASurfaceID *surface_list, int num_surfaces)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaDestroySurfaces);
+    capture_blob(&record, surface_list, num_surfaces, sizeof(*surface_list));
+    CAPTURE_DESTROY(capture, &record, vaStatus, vaDestroySurfaces, surface_list, num_surfaces);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_CreateContext(VADriverContextP ctx, VAConfigID config_id, int picture_width,
+                      int picture_height, int flag, VASurfaceID *render_targets,
+                      int num_render_targets, VAContextID *context)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaCreateContext);
+    capture_u32(&record, config_id);
+    capture_u32(&record, picture_width);
+    capture_u32(&record, picture_height);
+    capture_u32(&record, flag);
+    capture_blob(&record, render_targets, num_render_targets, sizeof(*render_targets));
+    vaStatus = capture->next.vaCreateContext(ctx, config_id, picture_width, picture_height, flag,
+                                             render_targets, num_render_targets, context);
+    capture_u32(&record, vaStatus == VA_STATUS_SUCCESS ? *context : VA_INVALID_ID);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DestroyContext(VADriverContextP ctx, VAContextID context)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaDestroyContext);
+    capture_u32(&record, context);
+    CAPTURE_DESTROY(capture, &record, vaStatus, vaDestroyContext, context);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_CreateBuffer(VADriverContextP ctx, VAContextID context, VABufferType type,
+                     unsigned int size, unsigned int num_elements, void *data, VABufferID *buf_id)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaCreateBuffer);
+    capture_u32(&record, context);
+    capture_u32(&record, type);
+    capture_u32(&record, size);
+    capture_u32(&record, num_elements);
+    capture_blob(&record, capture->flags & CAPTURE_FLAG_DATA ? data : NULL,
+                 1, (size_t)size * num_elements);
+    vaStatus = capture->next.vaCreateBuffer(ctx, context, type, size, num_elements, data, buf_id);
+    capture_u32(&record, vaStatus == VA_STATUS_SUCCESS ? *buf_id : VA_INVALID_ID);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_BufferSetNumElements(VADriverContextP ctx, VABufferID buf_id, unsigned int num_elements)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaBufferSetNumElements);
+    capture_u32(&record, buf_id);
+    capture_u32(&record, num_elements);
+    vaStatus = capture->next.vaBufferSetNumElements(ctx, buf_id, num_elements);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_MapBuffer(VADriverContextP ctx, VABufferID buf_id, void **pbuf)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_mapping *mapping;
+    struct capture_record record;
+    unsigned int size, num_elements;
+    VABufferType type;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaMapBuffer);
+    capture_u32(&record, buf_id);
+    vaStatus = capture->next.vaMapBuffer(ctx, buf_id, pbuf);
+    capture_end(capture, &record, vaStatus);
+
+    /* Remember where the application writes, to log it at vaUnmapBuffer */
+    if (vaStatus == VA_STATUS_SUCCESS && (capture->flags & CAPTURE_FLAG_DATA) &&
+        capture->next.vaBufferInfo(ctx, buf_id, &type, &size, &num_elements) == VA_STATUS_SUCCESS) {
+        mapping = capture_unmap(capture, buf_id);
+        if (!mapping)
+            mapping = malloc(sizeof(*mapping));
+        if (mapping) {
+            mapping->buf_id = buf_id;
+            mapping->data = *pbuf;
+            mapping->size = size * num_elements;
+            pthread_mutex_lock(&capture->mappings_lock);
+            LIST_ADD(&mapping->link, &capture->mappings);
+            pthread_mutex_unlock(&capture->mappings_lock);
+        }
+    }
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_UnmapBuffer(VADriverContextP ctx, VABufferID buf_id)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_mapping *mapping = capture_unmap(capture, buf_id);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaUnmapBuffer);
+    capture_u32(&record, buf_id);
+    capture_blob(&record, mapping ? mapping->data : NULL, 1, mapping ? mapping->size : 0);
+    vaStatus = capture->next.vaUnmapBuffer(ctx, buf_id);
+    capture_end(capture, &record, vaStatus);
+
+    free(mapping);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DestroyBuffer(VADriverContextP ctx, VABufferID buffer_id)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    free(capture_unmap(capture, buffer_id));
+
+    capture_begin(capture, &record, CALL_STATS_vaDestroyBuffer);
+    capture_u32(&record, buffer_id);
+    CAPTURE_DESTROY(capture, &record, vaStatus, vaDestroyBuffer, buffer_id);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_BeginPicture(VADriverContextP ctx, VAContextID context, VASurfaceID render_target)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaBeginPicture);
+    capture_u32(&record, context);
+    capture_u32(&record, render_target);
+    vaStatus = capture->next.vaBeginPicture(ctx, context, render_target);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_RenderPicture(VADriverContextP ctx, VAContextID context, VABufferID *buffers, int num_buffers)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaRenderPicture);
+    capture_u32(&record, context);
+    capture_blob(&record, buffers, num_buffers, sizeof(*buffers));
+    vaStatus = capture->next.vaRenderPicture(ctx, context, buffers, num_buffers);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_EndPicture(VADriverContextP ctx, VAContextID context)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaEndPicture);
+    capture_u32(&record, context);
+    vaStatus = capture->next.vaEndPicture(ctx, context);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_SyncSurface(VADriverContextP ctx, VASurfaceID render_target)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaSyncSurface);
+    capture_u32(&record, render_target);
+    vaStatus = capture->next.vaSyncSurface(ctx, render_target);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_QuerySurfaceStatus(VADriverContextP ctx, VASurfaceID render_target, VASurfaceStatus *status)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaQuerySurfaceStatus);
+    capture_u32(&record, render_target);
+    vaStatus = capture->next.vaQuerySurfaceStatus(ctx, render_target, status);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_PutSurface(VADriverContextP ctx, VASurfaceID surface, void *draw,
+                   short srcx, short srcy, unsigned short srcw, unsigned short srch,
+                   short destx, short desty, unsigned short destw, unsigned short desth,
+                   VARectangle *cliprects, unsigned int number_cliprects, unsigned int flags)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaPutSurface);
+    capture_u32(&record, surface);
+    capture_u32(&record, srcx);
+    capture_u32(&record, srcy);
+    capture_u32(&record, srcw);
+    capture_u32(&record, srch);
+    capture_u32(&record, destx);
+    capture_u32(&record, desty);
+    capture_u32(&record, destw);
+    capture_u32(&record, desth);
+    capture_blob(&record, cliprects, number_cliprects, sizeof(*cliprects));
+    capture_u32(&record, flags);
+    vaStatus = capture->next.vaPutSurface(ctx, surface, draw, srcx, srcy, srcw, srch,
+                                          destx, desty, destw, desth,
+                                          cliprects, number_cliprects, flags);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_QueryImageFormats(VADriverContextP ctx, VAImageFormat *format_list, int *num_formats)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaQueryImageFormats);
+    vaStatus = capture->next.vaQueryImageFormats(ctx, format_list, num_formats);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_CreateImage(VADriverContextP ctx, VAImageFormat *format, int width, int height, VAImage *image)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaCreateImage);
+    capture_blob(&record, format, 1, sizeof(*format));
+    capture_u32(&record, width);
+    capture_u32(&record, height);
+    vaStatus = capture->next.vaCreateImage(ctx, format, width, height, image);
+    capture_blob(&record, vaStatus == VA_STATUS_SUCCESS ? image : NULL, 1, sizeof(*image));
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DeriveImage(VADriverContextP ctx, VASurfaceID surface, VAImage *image)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaDeriveImage);
+    capture_u32(&record, surface);
+    vaStatus = capture->next.vaDeriveImage(ctx, surface, image);
+    capture_blob(&record, vaStatus == VA_STATUS_SUCCESS ? image : NULL, 1, sizeof(*image));
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DestroyImage(VADriverContextP ctx, VAImageID image)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaDestroyImage);
+    capture_u32(&record, image);
+    CAPTURE_DESTROY(capture, &record, vaStatus, vaDestroyImage, image);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_SetImagePalette(VADriverContextP ctx, VAImageID image, unsigned char *palette)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaSetImagePalette);
+    capture_u32(&record, image);
+    vaStatus = capture->next.vaSetImagePalette(ctx, image, palette);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_GetImage(VADriverContextP ctx, VASurfaceID surface, int x, int y,
+                 unsigned int width, unsigned int height, VAImageID image)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaGetImage);
+    capture_u32(&record, surface);
+    capture_u32(&record, x);
+    capture_u32(&record, y);
+    capture_u32(&record, width);
+    capture_u32(&record, height);
+    capture_u32(&record, image);
+    vaStatus = capture->next.vaGetImage(ctx, surface, x, y, width, height, image);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_PutImage(VADriverContextP ctx, VASurfaceID surface, VAImageID image,
+                 int src_x, int src_y, unsigned int src_width, unsigned int src_height,
+                 int dest_x, int dest_y, unsigned int dest_width, unsigned int dest_height)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaPutImage);
+    capture_u32(&record, surface);
+    capture_u32(&record, image);
+    capture_u32(&record, src_x);
+    capture_u32(&record, src_y);
+    capture_u32(&record, src_width);
+    capture_u32(&record, src_height);
+    capture_u32(&record, dest_x);
+    capture_u32(&record, dest_y);
+    capture_u32(&record, dest_width);
+    capture_u32(&record, dest_height);
+    vaStatus = capture->next.vaPutImage(ctx, surface, image, src_x, src_y, src_width, src_height,
+                                        dest_x, dest_y, dest_width, dest_height);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_QuerySubpictureFormats(VADriverContextP ctx, VAImageFormat *format_list,
+                               unsigned int *flags, unsigned int *num_formats)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaQuerySubpictureFormats);
+    vaStatus = capture->next.vaQuerySubpictureFormats(ctx, format_list, flags, num_formats);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_CreateSubpicture(VADriverContextP ctx, VAImageID image, VASubpictureID *subpicture)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaCreateSubpicture);
+    capture_u32(&record, image);
+    vaStatus = capture->next.vaCreateSubpicture(ctx, image, subpicture);
+    capture_u32(&record, vaStatus == VA_STATUS_SUCCESS ? *subpicture : VA_INVALID_ID);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DestroySubpicture(VADriverContextP ctx, VASubpictureID subpicture)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaDestroySubpicture);
+    capture_u32(&record, subpicture);
+    CAPTURE_DESTROY(capture, &record, vaStatus, vaDestroySubpicture, subpicture);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_SetSubpictureImage(VADriverContextP ctx, VASubpictureID subpicture, VAImageID image)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaSetSubpictureImage);
+    capture_u32(&record, subpicture);
+    capture_u32(&record, image);
+    vaStatus = capture->next.vaSetSubpictureImage(ctx, subpicture, image);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_SetSubpictureChromakey(VADriverContextP ctx, VASubpictureID subpicture,
+                               unsigned int chromakey_min, unsigned int chromakey_max,
+                               unsigned int chromakey_mask)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaSetSubpictureChromakey);
+    capture_u32(&record, subpicture);
+    capture_u32(&record, chromakey_min);
+    capture_u32(&record, chromakey_max);
+    capture_u32(&record, chromakey_mask);
+    vaStatus = capture->next.vaSetSubpictureChromakey(ctx, subpicture, chromakey_min,
+                                                      chromakey_max, chromakey_mask);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_SetSubpictureGlobalAlpha(VADriverContextP ctx, VASubpictureID subpicture, float global_alpha)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+    uint32_t alpha;
+
+    memcpy(&alpha, &global_alpha, sizeof(alpha));
+
+    capture_begin(capture, &record, CALL_STATS_vaSetSubpictureGlobalAlpha);
+    capture_u32(&record, subpicture);
+    capture_u32(&record, alpha);
+    vaStatus = capture->next.vaSetSubpictureGlobalAlpha(ctx, subpicture, global_alpha);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_AssociateSubpicture(VADriverContextP ctx, VASubpictureID subpicture,
+                            VASurfaceID *target_surfaces, int num_surfaces,
+                            short src_x, short src_y, unsigned short src_width, unsigned short src_height,
+                            short dest_x, short dest_y, unsigned short dest_width, unsigned short dest_height,
+                            unsigned int flags)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaAssociateSubpicture);
+    capture_u32(&record, subpicture);
+    capture_blob(&record, target_surfaces, num_surfaces, sizeof(*target_surfaces));
+    capture_u32(&record, src_x);
+    capture_u32(&record, src_y);
+    capture_u32(&record, src_width);
+    capture_u32(&record, src_height);
+    capture_u32(&record, dest_x);
+    capture_u32(&record, dest_y);
+    capture_u32(&record, dest_width);
+    capture_u32(&record, dest_height);
+    capture_u32(&record, flags);
+    vaStatus = capture->next.vaAssociateSubpicture(ctx, subpicture, target_surfaces, num_surfaces,
+                                                   src_x, src_y, src_width, src_height,
+                                                   dest_x, dest_y, dest_width, dest_height, flags);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_DeassociateSubpicture(VADriverContextP ctx, VASubpictureID subpicture,
+                              VASurfaceID *target_surfaces, int num_surfaces)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaDeassociateSubpicture);
+    capture_u32(&record, subpicture);
+    capture_blob(&record, target_surfaces, num_surfaces, sizeof(*target_surfaces));
+    vaStatus = capture->next.vaDeassociateSubpicture(ctx, subpicture, target_surfaces, num_surfaces);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_QueryDisplayAttributes(VADriverContextP ctx, VADisplayAttribute *attr_list, int *num_attributes)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaQueryDisplayAttributes);
+    vaStatus = capture->next.vaQueryDisplayAttributes(ctx, attr_list, num_attributes);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_GetDisplayAttributes(VADriverContextP ctx, VADisplayAttribute *attr_list, int num_attributes)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaGetDisplayAttributes);
+    capture_blob(&record, attr_list, num_attributes, sizeof(*attr_list));
+    vaStatus = capture->next.vaGetDisplayAttributes(ctx, attr_list, num_attributes);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_SetDisplayAttributes(VADriverContextP ctx, VADisplayAttribute *attr_list, int num_attributes)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaSetDisplayAttributes);
+    capture_blob(&record, attr_list, num_attributes, sizeof(*attr_list));
+    vaStatus = capture->next.vaSetDisplayAttributes(ctx, attr_list, num_attributes);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_BufferInfo(VADriverContextP ctx, VABufferID buf_id, VABufferType *type,
+                   unsigned int *size, unsigned int *num_elements)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaBufferInfo);
+    capture_u32(&record, buf_id);
+    vaStatus = capture->next.vaBufferInfo(ctx, buf_id, type, size, num_elements);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_LockSurface(VADriverContextP ctx, VASurfaceID surface, unsigned int *fourcc,
+                    unsigned int *luma_stride, unsigned int *chroma_u_stride,
+                    unsigned int *chroma_v_stride, unsigned int *luma_offset,
+                    unsigned int *chroma_u_offset, unsigned int *chroma_v_offset,
+                    unsigned int *buffer_name, void **buffer)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaLockSurface);
+    capture_u32(&record, surface);
+    vaStatus = capture->next.vaLockSurface(ctx, surface, fourcc, luma_stride, chroma_u_stride,
+                                           chroma_v_stride, luma_offset, chroma_u_offset,
+                                           chroma_v_offset, buffer_name, buffer);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+static VAStatus
+capture_UnlockSurface(VADriverContextP ctx, VASurfaceID surface)
+{
+    struct capture *capture = CAPTURE_GET(ctx);
+    struct capture_record record;
+    VAStatus vaStatus;
+
+    capture_begin(capture, &record, CALL_STATS_vaUnlockSurface);
+    capture_u32(&record, surface);
+    vaStatus = capture->next.vaUnlockSurface(ctx, surface);
+    capture_end(capture, &record, vaStatus);
+
+    return vaStatus;
+}
+
+#define CAPTURE_INSTALL(vtable, func)	\
+    do {	\
+        if ((vtable)->va##func)	\
+            (vtable)->va##func = capture_##func;	\
+    } while (0)
+
+struct capture *
+capture_create(const char *path, uint32_t flags, struct VADriverVTable *vtable)
+{
+    struct capture_file_header header;
+    struct capture *capture;
+
+    capture = calloc(1, sizeof(*capture));
+    if (!capture)
+        return NULL;
+
+    capture->file = fopen(path, "wb");
+    if (!capture->file) {
+        vawr_errorMessage("can not open capture file %s\n", path);
+        free(capture);
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header.version = CAPTURE_VERSION;
+    header.flags = flags;
+    if (fwrite(&header, sizeof(header), 1, capture->file) != 1) {
+        vawr_errorMessage("can not write capture file %s\n", path);
+        fclose(capture->file);
+        free(capture);
+        return NULL;
+    }
+
+    capture->flags = flags;
+    capture->start = call_stats_now();
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_mutex_init(&capture->mappings_lock, NULL);
+    LIST_INIT(&capture->mappings);
+
+    capture->next = *vtable;
+    CAPTURE_INSTALL(vtable, Terminate);
+    CAPTURE_INSTALL(vtable, QueryConfigProfiles);
+    CAPTURE_INSTALL(vtable, QueryConfigEntrypoints);
+    CAPTURE_INSTALL(vtable, GetConfigAttributes);
+    CAPTURE_INSTALL(vtable, CreateConfig);
+    CAPTURE_INSTALL(vtable, DestroyConfig);
+    CAPTURE_INSTALL(vtable, QueryConfigAttributes);
+    CAPTURE_INSTALL(vtable, CreateSurfaces);
+    CAPTURE_INSTALL(vtable, DestroySurfaces);
+    CAPTURE_INSTALL(vtable, CreateContext);
+    CAPTURE_INSTALL(vtable, DestroyContext);
+    CAPTURE_INSTALL(vtable, CreateBuffer);
+    CAPTURE_INSTALL(vtable, BufferSetNumElements);
+    CAPTURE_INSTALL(vtable, MapBuffer);
+    CAPTURE_INSTALL(vtable, UnmapBuffer);
+    CAPTURE_INSTALL(vtable, DestroyBuffer);
+    CAPTURE_INSTALL(vtable, BeginPicture);
+    CAPTURE_INSTALL(vtable, RenderPicture);
+    CAPTURE_INSTALL(vtable, EndPicture);
+    CAPTURE_INSTALL(vtable, SyncSurface);
+    CAPTURE_INSTALL(vtable, QuerySurfaceStatus);
+    CAPTURE_INSTALL(vtable, PutSurface);
+    CAPTURE_INSTALL(vtable, QueryImageFormats);
+    CAPTURE_INSTALL(vtable, CreateImage);
+    CAPTURE_INSTALL(vtable, DeriveImage);
+    CAPTURE_INSTALL(vtable, DestroyImage);
+    CAPTURE_INSTALL(vtable, SetImagePalette);
+    CAPTURE_INSTALL(vtable, GetImage);
+    CAPTURE_INSTALL(vtable, PutImage);
+    CAPTURE_INSTALL(vtable, QuerySubpictureFormats);
+    CAPTURE_INSTALL(vtable, CreateSubpicture);
+    CAPTURE_INSTALL(vtable, DestroySubpicture);
+    CAPTURE_INSTALL(vtable, SetSubpictureImage);
+    CAPTURE_INSTALL(vtable, SetSubpictureChromakey);
+    CAPTURE_INSTALL(vtable, SetSubpictureGlobalAlpha);
+    CAPTURE_INSTALL(vtable, AssociateSubpicture);
+    CAPTURE_INSTALL(vtable, DeassociateSubpicture);
+    CAPTURE_INSTALL(vtable, QueryDisplayAttributes);
+    CAPTURE_INSTALL(vtable, GetDisplayAttributes);
+    CAPTURE_INSTALL(vtable, SetDisplayAttributes);
+    CAPTURE_INSTALL(vtable, BufferInfo);
+    CAPTURE_INSTALL(vtable, LockSurface);
+    CAPTURE_INSTALL(vtable, UnlockSurface);
+
+    return capture;
+}
+
+void
+capture_destroy(struct capture *capture)
+{
+    struct capture_mapping *mapping, *next;
+
+    if (!capture)
+        return;
+
+    LIST_FOR_EACH_ENTRY_SAFE(mapping, next, &capture->mappings, link) {
+        LIST_DEL(&mapping->link);
+        free(mapping);
+    }
+
+    if (fclose(capture->file))
+        vawr_errorMessage("capture write failed\n");
+    pthread_mutex_destroy(&capture->mappings_lock);
+    pthread_mutex_destroy(&capture->lock);
+    free(capture);
+}
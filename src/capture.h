@@ -0,0 +1,125 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <va/va.h>
+#include <va/va_backend.h>
+
+#include "call_stats.h"
+#include "list.h"
+
+/**
+ * @file Capture of the calls an application makes into the wrapper.
+ *
+ * The capture sits in front of the wrapper: capture_create saves the
+ * wrapper's vtable and points every entry of it at a function that records
+ * the call and then makes it. With capture off the vtable is left alone and
+ * costs nothing.
+ *
+ * The log is a struct capture_file_header followed by one record per call,
+ * in the order the calls returned, so an ID is logged as created before it
+ * is used and as destroyed before it is created again. A record is a struct
+ * capture_record_header and the arguments of the call:
+ *
+ * - arguments in the order of the vtable entry, scalars as one 32 bit word,
+ *   arrays and structures as a 32 bit length in bytes followed by the bytes,
+ *   padded to 32 bits,
+ * - then the IDs and structures the call returned, in the same encoding.
+ *
+ * Pointers that mean nothing outside the application, like drawables and
+ * image palettes, are not recorded. Buffer contents, given to vaCreateBuffer
+ * or written between vaMapBuffer and vaUnmapBuffer, are recorded with
+ * CAPTURE_FLAG_DATA only, and are empty blobs otherwise. The vaUnmapBuffer
+ * record carries what was written to the mapping.
+ *
+ * bench/vawr_replay.c reads the log back.
+ *
+ * Example:
+ *
+ *     capture = capture_create(path, CAPTURE_FLAG_DATA, ctx->vtable);
+ *     ...
+ *     capture_destroy(capture);
+ */
+
+#define CAPTURE_MAGIC		"VAWRCAP"
+#define CAPTURE_VERSION		1
+
+#define CAPTURE_FLAG_DATA	(1 << 0)	/* record buffer contents */
+
+struct capture_file_header {
+    char magic[8];		/* CAPTURE_MAGIC */
+    uint32_t version;		/* CAPTURE_VERSION */
+    uint32_t flags;		/* CAPTURE_FLAG_* */
+};
+
+struct capture_record_header {
+    uint32_t func;		/* CALL_STATS_* index of the vtable entry */
+    uint32_t size;		/* bytes of arguments following the header */
+    uint64_t time;		/* ns from the start of the capture to the call */
+    uint32_t thread;		/* kernel thread ID of the caller */
+    int32_t status;		/* VAStatus the call returned */
+};
+
+/* A buffer the application has mapped, whose contents go into the log when
+ * it is unmapped
+ */
+struct capture_mapping {
+    struct list link;
+    VABufferID buf_id;
+    void *data;
+    unsigned int size;
+};
+
+struct capture {
+    FILE *file;
+    pthread_mutex_t lock;		/* serializes writes to file */
+    uint64_t start;
+    uint32_t flags;
+    int failed;			/* a write failed, nothing more is logged */
+    struct VADriverVTable next;	/* the entry points being captured */
+    pthread_mutex_t mappings_lock;
+    struct list mappings;		/* struct capture_mapping */
+};
+
+/**
+ * Start capturing the calls made through vtable into the file at path.
+ * The entries of vtable that are set are replaced. They find the capture
+ * through the capture member of the wrapper's driver data, which has to be
+ * set before the first call.
+ *
+ * @return The capture or NULL if the file can not be written.
+ */
+struct capture *
+capture_create(const char *path, uint32_t flags, struct VADriverVTable *vtable);
+
+void
+capture_destroy(struct capture *capture);
+
+#endif
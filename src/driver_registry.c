@@ -0,0 +1,175 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "driver_registry.h"
+#include "wrapper_drv_video.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_mutex_t driver_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct driver_entry *driver_registry;	/* protected by driver_registry_lock */
+
+static inline int
+va_getDriverInitName(char *name, int namelen, int major, int minor)
+{
+    int ret = snprintf(name, namelen, "__vaDriverInit_%d_%d", major, minor);
+    return ret > 0 && ret < namelen;
+}
+
+static VAStatus
+driver_registry_load(struct driver_entry *entry)
+{
+    char *search_dirs, *driver_dir, *saveptr;
+    char *driver_path = NULL;
+    char init_func_s[256];
+    int i;
+
+    static const struct {
+        int major;
+        int minor;
+    } compatible_versions[] = {
+        { VA_MAJOR_VERSION, VA_MINOR_VERSION },
+        { 0, 33 },
+        { 0, 32 },
+        { -1, }
+    };
+
+    search_dirs = strdup(entry->search_path);
+    if (!search_dirs)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    for (driver_dir = strtok_r(search_dirs, ":", &saveptr); driver_dir;
+         driver_dir = strtok_r(NULL, ":", &saveptr)) {
+        driver_path = (char *) calloc(1, strlen(driver_dir) + 1 +
+                                         strlen(entry->name) +
+                                         strlen(DRIVER_EXTENSION) + 1 );
+        if (!driver_path) {
+            free(search_dirs);
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+
+        sprintf(driver_path, "%s/%s%s", driver_dir, entry->name, DRIVER_EXTENSION);
+        entry->handle = dlopen( driver_path, RTLD_NOW| RTLD_GLOBAL);
+        if (entry->handle)
+            break;
+
+        /* Manage error if the file exists or not we need to know what's going
+	 * on */
+        vawr_errorMessage("dlopen of %s failed: %s\n", driver_path, dlerror());
+        free(driver_path);
+        driver_path = NULL;
+    }
+    free(search_dirs);
+
+    if (!entry->handle)
+        return VA_STATUS_ERROR_UNKNOWN;
+    entry->path = driver_path;
+
+    for (i = 0; compatible_versions[i].major >= 0; i++) {
+        if (va_getDriverInitName(init_func_s, sizeof(init_func_s),
+                                 compatible_versions[i].major,
+                                 compatible_versions[i].minor)) {
+            entry->init = (VADriverInit)dlsym(entry->handle, init_func_s);
+            if (entry->init) {
+                vawr_infoMessage("Found init function %s\n", init_func_s);
+                return VA_STATUS_SUCCESS;
+            }
+        }
+    }
+
+    vawr_errorMessage("%s has no function %s\n", driver_path, init_func_s);
+    dlclose(entry->handle);
+    return VA_STATUS_ERROR_UNKNOWN;
+}
+
+static void
+driver_registry_free(struct driver_entry *entry)
+{
+    free(entry->search_path);
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+}
+
+VAStatus
+driver_registry_open(const char *search_path, const char *name, struct driver_entry **entry)
+{
+    struct driver_entry *driver;
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&driver_registry_lock);
+    for (driver = driver_registry; driver; driver = driver->next) {
+        if (!strcmp(driver->name, name) && !strcmp(driver->search_path, search_path))
+            break;
+    }
+
+    /* The lock is held while loading, so a driver is only loaded once */
+    if (!driver) {
+        driver = calloc(1, sizeof(*driver));
+        if (driver) {
+            driver->search_path = strdup(search_path);
+            driver->name = strdup(name);
+        }
+        if (!driver || !driver->search_path || !driver->name)
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+        else
+            vaStatus = driver_registry_load(driver);
+
+        if (vaStatus == VA_STATUS_SUCCESS) {
+            driver->next = driver_registry;
+            driver_registry = driver;
+        } else if (driver) {
+            driver_registry_free(driver);
+            driver = NULL;
+        }
+    }
+
+    if (driver)
+        driver->refs++;
+    pthread_mutex_unlock(&driver_registry_lock);
+
+    *entry = driver;
+    return vaStatus;
+}
+
+void
+driver_registry_close(struct driver_entry *entry)
+{
+    struct driver_entry **link;
+
+    pthread_mutex_lock(&driver_registry_lock);
+    if (--entry->refs == 0) {
+        for (link = &driver_registry; *link != entry; link = &(*link)->next)
+            ;
+        *link = entry->next;
+        dlclose(entry->handle);
+        driver_registry_free(entry);
+    }
+    pthread_mutex_unlock(&driver_registry_lock);
+}
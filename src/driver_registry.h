@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _DRIVER_REGISTRY_H_
+#define _DRIVER_REGISTRY_H_
+
+#include <va/va.h>
+#include <va/va_backend.h>
+
+/**
+ * @file Process wide registry of the backend libraries the wrapper loaded.
+ *
+ * A process may open several VADisplays, e.g. one per GPU or per worker,
+ * each with its own instance of the wrapper and its own backends. The
+ * backend libraries and their init functions are the same for all of them,
+ * so the first display to need one dlopens it and looks up its init
+ * function, and later ones take a reference on that entry. The library is
+ * closed when the last display holding it terminates. Entries are looked up
+ * by driver name and search path, under a lock of their own, so displays
+ * can be opened and terminated on any thread.
+ *
+ * Example:
+ *
+ *     status = driver_registry_open(search_path, "pvr", &driver);
+ *     status = driver->init(ctx);
+ *     ctx->vtable->vaTerminate(ctx);
+ *     driver_registry_close(driver);
+ */
+
+#define DRIVER_EXTENSION	"_drv_video.so"
+
+struct driver_entry {
+    struct driver_entry *next;
+    char *search_path;		/* as passed to driver_registry_open */
+    char *name;
+    char *path;			/* of the library that was loaded */
+    void *handle;
+    VADriverInit init;
+    int refs;			/* displays holding the entry */
+};
+
+/* Take a reference on the entry of driver name, loading it from the first
+ * directory of the colon separated search_path that has it if no display
+ * holds it yet.
+ */
+VAStatus
+driver_registry_open(const char *search_path, const char *name, struct driver_entry **entry);
+
+/* Drop a reference, closing the library with the last one */
+void
+driver_registry_close(struct driver_entry *entry);
+
+#endif /* _DRIVER_REGISTRY_H_ */
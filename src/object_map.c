@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "object_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define OBJECT_MAP_MIN_CAPACITY	64
+
+static int
+object_map_resize(struct object_map *map, unsigned int capacity)
+{
+    struct object_map_entry *entries;
+
+    entries = realloc(map->entries, capacity * sizeof(*entries));
+    if (!entries)
+        return -1;
+
+    memset(entries + map->capacity, 0,
+           (capacity - map->capacity) * sizeof(*entries));
+    map->entries = entries;
+    map->capacity = capacity;
+
+    return 0;
+}
+
+int
+object_map_init(struct object_map *map)
+{
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+
+    return object_map_resize(map, OBJECT_MAP_MIN_CAPACITY);
+}
+
+void
+object_map_fini(struct object_map *map, void (*destroy)(void *data))
+{
+    unsigned int i;
+
+    if (destroy) {
+        for (i = 0; i < map->capacity; i++) {
+            if (map->entries[i].data)
+                destroy(map->entries[i].data);
+        }
+    }
+
+    free(map->entries);
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+int
+object_map_insert(struct object_map *map, VAGenericID id, void *data)
+{
+    unsigned int i = id & OBJECT_MAP_INDEX_MASK;
+    unsigned int capacity = map->capacity;
+
+    assert(data);
+
+    if (i >= capacity) {
+        while (i >= capacity)
+            capacity *= 2;
+        if (object_map_resize(map, capacity))
+            return -1;
+    }
+
+    if (map->entries[i].data) {
+        /* Overwriting a live object of another heap or generation would
+         * lose its record
+         */
+        if (map->entries[i].id != id)
+            return -1;
+    } else
+        map->count++;
+    map->entries[i].id = id;
+    map->entries[i].data = data;
+
+    return 0;
+}
+
+void *
+object_map_remove(struct object_map *map, VAGenericID id)
+{
+    void *data = object_map_lookup(map, id);
+
+    if (data) {
+        map->entries[id & OBJECT_MAP_INDEX_MASK].data = NULL;
+        map->count--;
+    }
+
+    return data;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _OBJECT_MAP_H_
+#define _OBJECT_MAP_H_
+
+#include <stddef.h>
+#include <va/va.h>
+
+/**
+ * @file Dense map from a backend's VA object ID to a private pointer.
+ *
+ * Backend drivers build their IDs from an object heap, as a per-type offset
+ * plus the index of the object in the heap, with the index in the low
+ * OBJECT_MAP_INDEX_BITS bits. The heap reuses freed indices, so the indices
+ * of the live objects of one type stay dense and the map is simply an array
+ * indexed by them. Lookups, inserts and removals are O(1) without hashing or
+ * probing.
+ *
+ * A map holds the objects of one type from one backend only; IDs from
+ * different heaps may share an index. A slot is free when its data pointer
+ * is NULL, which means NULL can not be stored as a value.
+ *
+ * Example:
+ *
+ *     struct object_map map;
+ *     object_map_init(&map);
+ *     object_map_insert(&map, surface_id, record);
+ *     record = object_map_lookup(&map, surface_id);
+ *     object_map_remove(&map, surface_id);
+ *     object_map_fini(&map, free);
+ */
+
+#define OBJECT_MAP_INDEX_BITS	24
+#define OBJECT_MAP_INDEX_MASK	((1u << OBJECT_MAP_INDEX_BITS) - 1)
+
+struct object_map_entry {
+    VAGenericID id;
+    void *data;
+};
+
+struct object_map {
+    struct object_map_entry *entries;
+    unsigned int capacity;      /* always a power of two */
+    unsigned int count;
+};
+
+/**
+ * Look up the data stored for id.
+ *
+ * @return The stored pointer or NULL if id is not in the map.
+ */
+static inline void *
+object_map_lookup(const struct object_map *map, VAGenericID id)
+{
+    unsigned int i = id & OBJECT_MAP_INDEX_MASK;
+
+    /* The index alone does not tell a stale or foreign ID apart */
+    if (i >= map->capacity || map->entries[i].id != id)
+        return NULL;
+
+    return map->entries[i].data;
+}
+
+int
+object_map_init(struct object_map *map);
+
+/**
+ * Free the table. If destroy is not NULL it is called on every stored
+ * pointer first.
+ */
+void
+object_map_fini(struct object_map *map, void (*destroy)(void *data));
+
+/**
+ * Insert or replace the data stored for id. The map is left unchanged if
+ * another ID is stored at the same index.
+ *
+ * @return 0 on success, -1 if the table could not be grown or the index is
+ * held by another ID.
+ */
+int
+object_map_insert(struct object_map *map, VAGenericID id, void *data);
+
+/**
+ * Remove id from the map.
+ *
+ * @return The pointer that was stored for id or NULL if id was not found.
+ */
+void *
+object_map_remove(struct object_map *map, VAGenericID id);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stddef.h>
+
+#include <va/va.h>
+#include <va/va_dec_vp8.h>
+#include <va/va_vpp.h>
+#if VA_CHECK_VERSION(0,37,0)
+#include <va/va_dec_hevc.h>
+#endif
+
+#include "param_buffer.h"
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+/* A single VASurfaceID member */
+#define FIELD(type, member) \
+    { offsetof(type, member), 1, sizeof(VASurfaceID), -1 }
+
+/* The picture_id of every entry of an array of VAPicture* structures */
+#define PICTURE_ARRAY(type, member) \
+    { offsetof(type, member[0].picture_id), \
+      ARRAY_SIZE(((type *)0)->member), \
+      sizeof(((type *)0)->member[0]), -1 }
+
+/* An array of count_member surface IDs that member points to */
+#define SURFACE_POINTER(type, member, count_member) \
+    { offsetof(type, member), 0, sizeof(VASurfaceID), \
+      offsetof(type, count_member) }
+
+#define DESC(type, fields) \
+    { type, fields, ARRAY_SIZE(fields) }
+
+static const struct param_buffer_field mpeg2_pic_fields[] = {
+    FIELD(VAPictureParameterBufferMPEG2, forward_reference_picture),
+    FIELD(VAPictureParameterBufferMPEG2, backward_reference_picture),
+};
+
+static const struct param_buffer_desc mpeg2_descs[] = {
+    DESC(VAPictureParameterBufferType, mpeg2_pic_fields),
+};
+
+/* H.263 is decoded through the MPEG-4 parameter buffers */
+static const struct param_buffer_field mpeg4_pic_fields[] = {
+    FIELD(VAPictureParameterBufferMPEG4, forward_reference_picture),
+    FIELD(VAPictureParameterBufferMPEG4, backward_reference_picture),
+};
+
+static const struct param_buffer_desc mpeg4_descs[] = {
+    DESC(VAPictureParameterBufferType, mpeg4_pic_fields),
+};
+
+static const struct param_buffer_field h264_pic_fields[] = {
+    FIELD(VAPictureParameterBufferH264, CurrPic.picture_id),
+    PICTURE_ARRAY(VAPictureParameterBufferH264, ReferenceFrames),
+};
+
+static const struct param_buffer_field h264_slice_fields[] = {
+    PICTURE_ARRAY(VASliceParameterBufferH264, RefPicList0),
+    PICTURE_ARRAY(VASliceParameterBufferH264, RefPicList1),
+};
+
+static const struct param_buffer_desc h264_descs[] = {
+    DESC(VAPictureParameterBufferType, h264_pic_fields),
+    DESC(VASliceParameterBufferType, h264_slice_fields),
+};
+
+static const struct param_buffer_field vc1_pic_fields[] = {
+    FIELD(VAPictureParameterBufferVC1, forward_reference_picture),
+    FIELD(VAPictureParameterBufferVC1, backward_reference_picture),
+    FIELD(VAPictureParameterBufferVC1, inloop_decoded_picture),
+};
+
+static const struct param_buffer_desc vc1_descs[] = {
+    DESC(VAPictureParameterBufferType, vc1_pic_fields),
+};
+
+static const struct param_buffer_field vp8_pic_fields[] = {
+    FIELD(VAPictureParameterBufferVP8, last_ref_frame),
+    FIELD(VAPictureParameterBufferVP8, golden_ref_frame),
+    FIELD(VAPictureParameterBufferVP8, alt_ref_frame),
+    FIELD(VAPictureParameterBufferVP8, out_of_loop_frame),
+};
+
+static const struct param_buffer_desc vp8_descs[] = {
+    DESC(VAPictureParameterBufferType, vp8_pic_fields),
+};
+
+/* The input of a video processing pipeline and the frames around it */
+static const struct param_buffer_field vpp_pipeline_fields[] = {
+    FIELD(VAProcPipelineParameterBuffer, surface),
+    SURFACE_POINTER(VAProcPipelineParameterBuffer, forward_references,
+                    num_forward_references),
+    SURFACE_POINTER(VAProcPipelineParameterBuffer, backward_references,
+                    num_backward_references),
+};
+
+static const struct param_buffer_desc vpp_descs[] = {
+    DESC(VAProcPipelineParameterBufferType, vpp_pipeline_fields),
+};
+
+#if VA_CHECK_VERSION(0,37,0)
+/* HEVC slice parameters refer to ReferenceFrames by index only */
+static const struct param_buffer_field hevc_pic_fields[] = {
+    FIELD(VAPictureParameterBufferHEVC, CurrPic.picture_id),
+    PICTURE_ARRAY(VAPictureParameterBufferHEVC, ReferenceFrames),
+};
+
+static const struct param_buffer_desc hevc_descs[] = {
+    DESC(VAPictureParameterBufferType, hevc_pic_fields),
+};
+#endif
+
+#define SELECT(table) \
+    do { \
+        descs = table; \
+        num_descs = ARRAY_SIZE(table); \
+    } while (0)
+
+const struct param_buffer_desc *
+param_buffer_lookup(VAProfile profile, VABufferType type)
+{
+    const struct param_buffer_desc *descs;
+    unsigned int num_descs;
+    unsigned int i;
+
+    switch (profile) {
+    case VAProfileMPEG2Simple:
+    case VAProfileMPEG2Main:
+        SELECT(mpeg2_descs);
+        break;
+
+    case VAProfileMPEG4Simple:
+    case VAProfileMPEG4AdvancedSimple:
+    case VAProfileMPEG4Main:
+    case VAProfileH263Baseline:
+        SELECT(mpeg4_descs);
+        break;
+
+    case VAProfileH264ConstrainedBaseline:
+    case VAProfileH264Baseline:
+    case VAProfileH264Main:
+    case VAProfileH264High:
+    case VAProfileH264MultiviewHigh:
+    case VAProfileH264StereoHigh:
+        SELECT(h264_descs);
+        break;
+
+    case VAProfileVC1Simple:
+    case VAProfileVC1Main:
+    case VAProfileVC1Advanced:
+        SELECT(vc1_descs);
+        break;
+
+    case VAProfileVP8Version0_3:
+        SELECT(vp8_descs);
+        break;
+
+    case VAProfileNone:
+        SELECT(vpp_descs);
+        break;
+
+#if VA_CHECK_VERSION(0,37,0)
+    case VAProfileHEVCMain:
+    case VAProfileHEVCMain10:
+        SELECT(hevc_descs);
+        break;
+#endif
+
+    default:
+        return NULL;
+    }
+
+    for (i = 0; i < num_descs; i++) {
+        if (descs[i].type == type)
+            return &descs[i];
+    }
+
+    return NULL;
+}
+
+void
+param_buffer_translate(const struct param_buffer_desc *desc,
+                       void *buffer,
+                       unsigned int size,
+                       unsigned int num_elements,
+                       param_buffer_translate_func translate,
+                       void *data)
+{
+    const struct param_buffer_field *field;
+    unsigned char *element = buffer;
+    VASurfaceID *surface;
+    unsigned int offset;
+    unsigned int i, j, k;
+
+    for (i = 0; i < num_elements; i++, element += size) {
+        for (j = 0; j < desc->num_fields; j++) {
+            field = &desc->fields[j];
+            if (field->count_offset >= 0)
+                continue;
+
+            for (k = 0; k < field->count; k++) {
+                offset = field->offset + k * field->stride;
+                if (offset + sizeof(VASurfaceID) > size)
+                    break;
+
+                surface = (VASurfaceID *)(element + offset);
+                if (*surface != VA_INVALID_SURFACE)
+                    *surface = translate(data, *surface);
+            }
+        }
+    }
+}
+
+void
+param_buffer_for_each(const struct param_buffer_desc *desc,
+                      const void *buffer,
+                      unsigned int size,
+                      unsigned int num_elements,
+                      param_buffer_visit_func visit,
+                      void *data)
+{
+    const struct param_buffer_field *field;
+    const unsigned char *element = buffer;
+    const unsigned char *base;
+    const VASurfaceID *surface;
+    unsigned int count, offset;
+    unsigned int i, j, k;
+
+    for (i = 0; i < num_elements; i++, element += size) {
+        for (j = 0; j < desc->num_fields; j++) {
+            field = &desc->fields[j];
+            base = element;
+            count = field->count;
+            offset = field->offset;
+            if (field->count_offset >= 0) {
+                if (field->offset + sizeof(void *) > size ||
+                    field->count_offset + sizeof(unsigned int) > size)
+                    continue;
+
+                base = *(const unsigned char * const *)(element + field->offset);
+                count = *(const unsigned int *)(element + field->count_offset);
+                if (!base)
+                    continue;
+
+                offset = 0;
+            }
+
+            for (k = 0; k < count; k++, offset += field->stride) {
+                if (base == element && offset + sizeof(VASurfaceID) > size)
+                    break;
+
+                surface = (const VASurfaceID *)(base + offset);
+                if (*surface != VA_INVALID_SURFACE)
+                    visit(data, *surface);
+            }
+        }
+    }
+}
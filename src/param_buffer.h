@@ -0,0 +1,105 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _PARAM_BUFFER_H_
+#define _PARAM_BUFFER_H_
+
+#include <va/va.h>
+
+/**
+ * @file Descriptions of the VASurfaceID fields in decoder parameter buffers.
+ *
+ * A parameter buffer routed to a backend other than the one that allocated
+ * its surfaces has to have every surface ID in it rewritten. Instead of
+ * hand-written code per codec, each (profile, buffer type) pair is described
+ * by a table of the places the IDs live in one element of the buffer, and a
+ * single loop walks the table. The cost is O(number of references) per
+ * buffer.
+ *
+ * Example:
+ *
+ *     desc = param_buffer_lookup(profile, type);
+ *     if (desc)
+ *         param_buffer_translate(desc, data, size, num_elements,
+ *                                translate, translate_data);
+ */
+
+/*
+ * A run of count surface IDs, stride bytes apart, starting at offset. If
+ * count_offset is not negative, offset instead holds a pointer to the IDs
+ * and their number is the unsigned int at count_offset.
+ */
+struct param_buffer_field {
+    unsigned int offset;
+    unsigned int count;
+    unsigned int stride;
+    int count_offset;
+};
+
+struct param_buffer_desc {
+    VABufferType type;
+    const struct param_buffer_field *fields;
+    unsigned int num_fields;
+};
+
+typedef VASurfaceID (*param_buffer_translate_func)(void *data, VASurfaceID surface);
+typedef void (*param_buffer_visit_func)(void *data, VASurfaceID surface);
+
+/**
+ * Look up the description of a buffer of type created for profile.
+ *
+ * @return The description or NULL if the buffer holds no surface IDs.
+ */
+const struct param_buffer_desc *
+param_buffer_lookup(VAProfile profile, VABufferType type);
+
+/**
+ * Pass every surface ID in the num_elements elements of size bytes at
+ * buffer through translate and store the result back. Fields that do not
+ * fit in size, e.g. because the application was built against older
+ * headers, are left alone, and so are the IDs behind pointer fields, which
+ * live in the application's memory.
+ */
+void
+param_buffer_translate(const struct param_buffer_desc *desc,
+                       void *buffer,
+                       unsigned int size,
+                       unsigned int num_elements,
+                       param_buffer_translate_func translate,
+                       void *data);
+
+/**
+ * Call visit on every surface ID in the num_elements elements of size bytes
+ * at buffer, including those behind pointer fields.
+ */
+void
+param_buffer_for_each(const struct param_buffer_desc *desc,
+                      const void *buffer,
+                      unsigned int size,
+                      unsigned int num_elements,
+                      param_buffer_visit_func visit,
+                      void *data);
+
+#endif
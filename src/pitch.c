@@ -0,0 +1,215 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "pitch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+#define PITCH_DEFAULT_ALIGN	64
+
+static const struct {
+    const char *driver;
+    struct pitch_rule rule;
+} pitch_defaults[] = {
+    /* What psb's memory tiling supports */
+    { "pvr", { 64, 5, { 512, 1024, 1280, 2048, 4096 } } },
+};
+
+static unsigned int
+pitch_gcd(unsigned int a, unsigned int b)
+{
+    while (b) {
+        unsigned int t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+static int
+pitch_accepted(const struct pitch_rule *rule, unsigned int pitch)
+{
+    unsigned int i;
+
+    if (pitch % rule->align)
+        return 0;
+    if (!rule->num_pitches)
+        return 1;
+
+    for (i = 0; i < rule->num_pitches; i++) {
+        if (rule->pitches[i] == pitch)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int
+pitch_compare(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Parse the <pitch>[,<pitch>...] or align:<alignment> of an entry */
+static int
+pitch_parse_rule(struct pitch_rule *rule, char *value)
+{
+    char *item, *end, *saveptr;
+    unsigned long l;
+
+    memset(rule, 0, sizeof(*rule));
+
+    if (!strncmp(value, "align:", 6)) {
+        l = strtoul(value + 6, &end, 0);
+        if (!value[6] || *end || !l || l > 65536)
+            return -1;
+        rule->align = l;
+        return 0;
+    }
+
+    rule->align = 1;
+    for (item = strtok_r(value, ",", &saveptr); item;
+         item = strtok_r(NULL, ",", &saveptr)) {
+        l = strtoul(item, &end, 0);
+        if (*end || !l || l > 65536 || rule->num_pitches == PITCH_MAX_PITCHES)
+            return -1;
+        rule->pitches[rule->num_pitches++] = l;
+    }
+    if (!rule->num_pitches)
+        return -1;
+
+    qsort(rule->pitches, rule->num_pitches, sizeof(rule->pitches[0]), pitch_compare);
+    return 0;
+}
+
+struct pitch_table *
+pitch_table_create(const char *spec, const char * const *drv_names, int num_drvs,
+                   void (*print)(const char *msg, ...))
+{
+    struct pitch_table *pitches;
+    struct pitch_rule rule;
+    char *copy = NULL, *entry, *value, *saveptr;
+    unsigned int i;
+    int drv;
+
+    pitches = calloc(1, sizeof(*pitches) + num_drvs * sizeof(pitches->rules[0]));
+    if (!pitches)
+        return NULL;
+    pitches->num_drvs = num_drvs;
+
+    for (drv = 0; drv < num_drvs; drv++) {
+        pitches->rules[drv].align = PITCH_DEFAULT_ALIGN;
+        for (i = 0; i < ARRAY_SIZE(pitch_defaults); i++) {
+            if (!strcmp(drv_names[drv], pitch_defaults[i].driver))
+                pitches->rules[drv] = pitch_defaults[i].rule;
+        }
+    }
+
+    if (!spec)
+        return pitches;
+    copy = strdup(spec);
+    if (!copy)
+        goto error;
+
+    for (entry = strtok_r(copy, " \t\r\n;", &saveptr); entry;
+         entry = strtok_r(NULL, " \t\r\n;", &saveptr)) {
+        value = strchr(entry, '=');
+        if (!value) {
+            print("pitches of %s missing\n", entry);
+            goto error;
+        }
+        *value++ = '\0';
+
+        if (pitch_parse_rule(&rule, value)) {
+            print("invalid pitches %s for %s\n", value, entry);
+            goto error;
+        }
+
+        /* Drivers that are not routed to are no error, just of no use */
+        for (drv = 0; drv < num_drvs; drv++) {
+            if (!strcmp(drv_names[drv], entry))
+                pitches->rules[drv] = rule;
+        }
+    }
+
+    free(copy);
+    return pitches;
+
+error:
+    free(copy);
+    free(pitches);
+    return NULL;
+}
+
+void
+pitch_table_destroy(struct pitch_table *pitches)
+{
+    free(pitches);
+}
+
+unsigned int
+pitch_table_pick(const struct pitch_table *pitches, unsigned int drvs, unsigned int width)
+{
+    const struct pitch_rule *list = NULL;
+    unsigned long long align = 1;
+    unsigned int i;
+    int drv;
+
+    for (drv = 0; drv < pitches->num_drvs; drv++) {
+        const struct pitch_rule *rule = &pitches->rules[drv];
+
+        if (!(drvs & (1u << drv)))
+            continue;
+        align = align / pitch_gcd(align, rule->align) * rule->align;
+        if (align > 65536)
+            return 0;
+        if (rule->num_pitches && !list)
+            list = rule;
+    }
+
+    /* Without a list the alignments of all are all there is to it */
+    if (!list)
+        return (width + align - 1) / align * align;
+
+    for (i = 0; i < list->num_pitches; i++) {
+        if (list->pitches[i] < width || list->pitches[i] % align)
+            continue;
+        for (drv = 0; drv < pitches->num_drvs; drv++) {
+            if ((drvs & (1u << drv)) && !pitch_accepted(&pitches->rules[drv], list->pitches[i]))
+                break;
+        }
+        if (drv == pitches->num_drvs)
+            return list->pitches[i];
+    }
+
+    return 0;
+}
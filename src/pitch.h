@@ -0,0 +1,88 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _PITCH_H_
+#define _PITCH_H_
+
+/**
+ * @file Table of the surface pitches each backend accepts.
+ *
+ * A surface decoded by a backend other than i965 is allocated by i965 and
+ * imported by the other backend, so its pitch has to suit both. Each
+ * backend has a rule: its pitches are a multiple of an alignment and, for
+ * hardware with a fixed set of pitches like psb, one of a list. The rules
+ * come from a built-in table of the known drivers, where any other driver
+ * gets an alignment of 64, and can be overridden by a spec of entries
+ * separated by white space or ';', each
+ *
+ *     <driver>=<pitch>[,<pitch>...]
+ *     <driver>=align:<alignment>
+ *
+ * The pitch of a surface is the smallest one at least its width that every
+ * backend touching it accepts.
+ *
+ * Example:
+ *
+ *     pitches = pitch_table_create("pvr=align:64", routes->drv_names, routes->num_drvs, print);
+ *     pitch = pitch_table_pick(pitches, 1u << 0 | 1u << drv, width);
+ *     pitch_table_destroy(pitches);
+ */
+
+#define PITCH_MAX_PITCHES	16
+
+struct pitch_rule {
+    unsigned int align;		/* pitches are a multiple of it */
+    unsigned int num_pitches;	/* if not 0, only pitches are accepted */
+    unsigned int pitches[PITCH_MAX_PITCHES];	/* ascending */
+};
+
+struct pitch_table {
+    int num_drvs;
+    struct pitch_rule rules[];	/* one per backend */
+};
+
+/**
+ * Build the rules of the num_drvs backends named in drv_names, with spec
+ * applied on top of the built-in ones. spec may be NULL. Errors are
+ * reported through print.
+ *
+ * @return The new table or NULL if spec is not valid or the table could not
+ * be allocated.
+ */
+struct pitch_table *
+pitch_table_create(const char *spec, const char * const *drv_names, int num_drvs,
+                   void (*print)(const char *msg, ...));
+
+void
+pitch_table_destroy(struct pitch_table *pitches);
+
+/**
+ * @return The smallest pitch of at least width bytes that every backend in
+ * drvs, a bit per backend, accepts, or 0 if there is none.
+ */
+unsigned int
+pitch_table_pick(const struct pitch_table *pitches, unsigned int drvs, unsigned int width);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "route.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+struct route_name {
+    const char *name;
+    int value;
+};
+
+#define NAME(prefix, name)	{ #name, prefix##name }
+
+static const struct route_name route_profiles[] = {
+    NAME(VAProfile, MPEG2Simple),
+    NAME(VAProfile, MPEG2Main),
+    NAME(VAProfile, MPEG4Simple),
+    NAME(VAProfile, MPEG4AdvancedSimple),
+    NAME(VAProfile, MPEG4Main),
+    NAME(VAProfile, H264Baseline),
+    NAME(VAProfile, H264Main),
+    NAME(VAProfile, H264High),
+    NAME(VAProfile, VC1Simple),
+    NAME(VAProfile, VC1Main),
+    NAME(VAProfile, VC1Advanced),
+    NAME(VAProfile, H263Baseline),
+    NAME(VAProfile, JPEGBaseline),
+    NAME(VAProfile, H264ConstrainedBaseline),
+    NAME(VAProfile, VP8Version0_3),
+    NAME(VAProfile, H264MultiviewHigh),
+    NAME(VAProfile, H264StereoHigh),
+#if VA_CHECK_VERSION(0,37,0)
+    NAME(VAProfile, HEVCMain),
+    NAME(VAProfile, HEVCMain10),
+#endif
+};
+
+static const struct route_name route_entrypoints[] = {
+    NAME(VAEntrypoint, VLD),
+    NAME(VAEntrypoint, IZZ),
+    NAME(VAEntrypoint, IDCT),
+    NAME(VAEntrypoint, MoComp),
+    NAME(VAEntrypoint, Deblocking),
+    NAME(VAEntrypoint, EncSlice),
+    NAME(VAEntrypoint, EncPicture),
+    NAME(VAEntrypoint, VideoProc),
+};
+
+static int
+route_parse_name(const struct route_name *names, unsigned int num_names,
+                 const char *s, int *value)
+{
+    unsigned int i;
+    char *end;
+    long l;
+
+    for (i = 0; i < num_names; i++) {
+        if (!strcmp(s, names[i].name)) {
+            *value = names[i].value;
+            return 0;
+        }
+    }
+
+    l = strtol(s, &end, 0);
+    if (!*s || *end)
+        return -1;
+
+    *value = l;
+    return 0;
+}
+
+/* Driver names end up in a file name, so keep them to a plain word */
+static int
+route_valid_driver(const char *s)
+{
+    if (!*s)
+        return 0;
+
+    for (; *s; s++) {
+        if (!isalnum((unsigned char)*s) && *s != '_' && *s != '-')
+            return 0;
+    }
+
+    return 1;
+}
+
+static int
+route_find_driver(struct route_table *routes, const char *name, int max_drvs)
+{
+    int drv;
+
+    for (drv = 0; drv < routes->num_drvs; drv++) {
+        if (!strcmp(routes->drv_names[drv], name))
+            return drv;
+    }
+
+    if (routes->num_drvs == max_drvs)
+        return -1;
+
+    routes->drv_names[drv] = strdup(name);
+    if (!routes->drv_names[drv])
+        return -1;
+    routes->num_drvs++;
+
+    return drv;
+}
+
+/* Parse one <profile>[:<entrypoint>]=<driver>[,<driver>...] entry, which
+ * is modified
+ */
+static int
+route_parse_entry(struct route_table *routes, char *entry, int max_drvs,
+                  void (*print)(const char *msg, ...))
+{
+    struct route *route = &routes->routes[routes->num_routes];
+    char *entrypoint, *drivers, *driver, *saveptr;
+    int profile_value, entrypoint_value = VAEntrypointVLD;
+    int drv;
+
+    drivers = strchr(entry, '=');
+    if (!drivers) {
+        print("route %s has no driver\n", entry);
+        return -1;
+    }
+    *drivers++ = '\0';
+
+    entrypoint = strchr(entry, ':');
+    if (entrypoint)
+        *entrypoint++ = '\0';
+
+    if (route_parse_name(route_profiles, ARRAY_SIZE(route_profiles), entry, &profile_value)) {
+        print("unknown profile %s in route\n", entry);
+        return -1;
+    }
+    if (entrypoint &&
+        route_parse_name(route_entrypoints, ARRAY_SIZE(route_entrypoints), entrypoint, &entrypoint_value)) {
+        print("unknown entrypoint %s in route\n", entrypoint);
+        return -1;
+    }
+    if (route_table_find(routes, profile_value, entrypoint_value)) {
+        print("more than one route for %s\n", entry);
+        return -1;
+    }
+
+    route->profile = profile_value;
+    route->entrypoint = entrypoint_value;
+    route->drvs = 0;
+    for (driver = strtok_r(drivers, ",", &saveptr); driver;
+         driver = strtok_r(NULL, ",", &saveptr)) {
+        if (!route_valid_driver(driver)) {
+            print("invalid driver name %s in route\n", driver);
+            return -1;
+        }
+
+        drv = route_find_driver(routes, driver, max_drvs);
+        if (drv < 0) {
+            print("route to %s exceeds the limit of %d backends\n", driver, max_drvs);
+            return -1;
+        }
+        if (!route->drvs)
+            route->drv = drv;
+        route->drvs |= 1u << drv;
+    }
+    if (!route->drvs) {
+        print("route %s has no driver\n", entry);
+        return -1;
+    }
+    routes->num_routes++;
+
+    return 0;
+}
+
+struct route_table *
+route_table_create(const char *spec, const char *primary, int max_drvs,
+                   void (*print)(const char *msg, ...))
+{
+    struct route_table *routes;
+    char *copy, *line, *entry, *comment, *line_save, *entry_save;
+    int ret = 0;
+
+    routes = calloc(1, sizeof(*routes));
+    copy = strdup(spec);
+    if (!routes || !copy)
+        goto error;
+
+    /* No more entries than characters */
+    routes->drv_names = calloc(max_drvs, sizeof(*routes->drv_names));
+    routes->routes = calloc(strlen(spec) / 2 + 1, sizeof(*routes->routes));
+    if (!routes->drv_names || !routes->routes)
+        goto error;
+
+    if (route_find_driver(routes, primary, max_drvs) != 0)
+        goto error;
+
+    for (line = strtok_r(copy, "\n", &line_save); line && !ret;
+         line = strtok_r(NULL, "\n", &line_save)) {
+        comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        for (entry = strtok_r(line, " \t\r;", &entry_save); entry && !ret;
+             entry = strtok_r(NULL, " \t\r;", &entry_save))
+            ret = route_parse_entry(routes, entry, max_drvs, print);
+    }
+    if (ret)
+        goto error;
+
+    free(copy);
+    return routes;
+
+error:
+    free(copy);
+    route_table_destroy(routes);
+    return NULL;
+}
+
+struct route_table *
+route_table_load(const char *path, const char *primary, int max_drvs,
+                 void (*print)(const char *msg, ...))
+{
+    struct route_table *routes = NULL;
+    FILE *file;
+    char *spec = NULL;
+    long size;
+
+    file = fopen(path, "r");
+    if (!file) {
+        print("could not open route table %s\n", path);
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 &&
+        fseek(file, 0, SEEK_SET) == 0 && (spec = malloc(size + 1)) &&
+        fread(spec, 1, size, file) == (size_t)size) {
+        spec[size] = '\0';
+        routes = route_table_create(spec, primary, max_drvs, print);
+    } else {
+        print("could not read route table %s\n", path);
+    }
+
+    free(spec);
+    fclose(file);
+
+    return routes;
+}
+
+void
+route_table_destroy(struct route_table *routes)
+{
+    int drv;
+
+    if (!routes)
+        return;
+
+    for (drv = 0; drv < routes->num_drvs; drv++)
+        free((char *)routes->drv_names[drv]);
+    free(routes->drv_names);
+    free(routes->routes);
+    free(routes);
+}
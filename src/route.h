@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _ROUTE_H_
+#define _ROUTE_H_
+
+#include <va/va.h>
+
+/**
+ * @file Table of the backend that decodes each (profile, entrypoint).
+ *
+ * A table is written as entries separated by white space or ';', each
+ *
+ *     <profile>[:<entrypoint>]=<driver>[,<driver>...]
+ *
+ * where profile and entrypoint are VAProfile and VAEntrypoint values
+ * without the prefix, e.g. VP8Version0_3 and VLD, or their numbers, and
+ * driver is the name of the backend's <driver>_drv_video.so. The entrypoint
+ * is VLD if left out. '#' starts a comment that runs to the end of the line.
+ * A pair with several drivers can be decoded by any of them, the first one
+ * answers the queries about it.
+ *
+ * Backend 0 is the primary backend, every pair without an entry goes to it.
+ * The other drivers are numbered in the order they first appear.
+ *
+ * Example:
+ *
+ *     routes = route_table_create("VP8Version0_3=pvr HEVCMain=pvr,vxd", "i965", max_drvs, print);
+ *     drv = route_table_lookup(routes, profile, entrypoint);
+ *     load(routes->drv_names[drv]);
+ *     route_table_destroy(routes);
+ */
+
+struct route {
+    VAProfile profile;
+    VAEntrypoint entrypoint;
+    int drv;			/* the first driver listed */
+    unsigned int drvs;		/* bit per backend listed, drv included */
+};
+
+struct route_table {
+    int num_drvs;
+    const char **drv_names;	/* num_drvs names, the primary backend first */
+    int num_routes;
+    struct route *routes;
+};
+
+/**
+ * Parse the table in spec. Errors are reported through print.
+ *
+ * @return The new table or NULL if spec is not valid, names more than
+ * max_drvs backends or the table could not be allocated.
+ */
+struct route_table *
+route_table_create(const char *spec, const char *primary, int max_drvs,
+                   void (*print)(const char *msg, ...));
+
+/**
+ * Like route_table_create, with the table read from the file at path.
+ */
+struct route_table *
+route_table_load(const char *path, const char *primary, int max_drvs,
+                 void (*print)(const char *msg, ...));
+
+void
+route_table_destroy(struct route_table *routes);
+
+/**
+ * @return The route of profile and entrypoint, NULL if they have none.
+ */
+static inline const struct route *
+route_table_find(const struct route_table *routes, VAProfile profile, VAEntrypoint entrypoint)
+{
+    int i;
+
+    for (i = 0; i < routes->num_routes; i++) {
+        if (routes->routes[i].profile == profile &&
+            routes->routes[i].entrypoint == entrypoint)
+            return &routes->routes[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @return The first backend of profile and entrypoint.
+ */
+static inline int
+route_table_lookup(const struct route_table *routes, VAProfile profile, VAEntrypoint entrypoint)
+{
+    const struct route *route = route_table_find(routes, profile, entrypoint);
+
+    return route ? route->drv : 0;
+}
+
+#endif
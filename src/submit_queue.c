@@ -0,0 +1,335 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "submit_queue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static struct submit_fence *
+submit_queue_find_fence(struct submit_queue *queue, VASurfaceID surface)
+{
+    int i;
+
+    for (i = 0; i < queue->num_fences; i++) {
+        if (queue->fences[i].surface == surface)
+            return &queue->fences[i];
+    }
+
+    return NULL;
+}
+
+/* Leave a fence on surface for the call seq, keeping a failure not returned yet */
+static VAStatus
+submit_queue_fence(struct submit_queue *queue, VASurfaceID surface, uint64_t seq)
+{
+    struct submit_fence *fence = submit_queue_find_fence(queue, surface);
+
+    if (!fence) {
+        if (queue->num_fences == queue->max_fences) {
+            int max_fences = queue->max_fences ? 2 * queue->max_fences : 16;
+            struct submit_fence *fences = realloc(queue->fences, max_fences * sizeof(*fences));
+
+            if (!fences)
+                return VA_STATUS_ERROR_ALLOCATION_FAILED;
+            queue->fences = fences;
+            queue->max_fences = max_fences;
+        }
+        fence = &queue->fences[queue->num_fences++];
+        fence->surface = surface;
+        fence->status = VA_STATUS_SUCCESS;
+    }
+    fence->seq = seq;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Keep the failure of the call of entry for whoever asks about its surface */
+static void
+submit_queue_fail(struct submit_queue *queue, struct submit_queue_entry *entry, VAStatus status)
+{
+    struct submit_fence *fence = NULL;
+
+    if (entry->surface != VA_INVALID_SURFACE) {
+        /* No fence, the surface was destroyed and nobody is left to tell */
+        fence = submit_queue_find_fence(queue, entry->surface);
+        if (fence && fence->status == VA_STATUS_SUCCESS)
+            fence->status = status;
+    } else if (queue->status == VA_STATUS_SUCCESS) {
+        queue->status = status;
+    }
+}
+
+/* Move the failure kept for surface to the caller */
+static VAStatus
+submit_queue_take_status(struct submit_queue *queue, VASurfaceID surface)
+{
+    struct submit_fence *fence = submit_queue_find_fence(queue, surface);
+    VAStatus status = VA_STATUS_SUCCESS;
+
+    if (fence) {
+        status = fence->status;
+        fence->status = VA_STATUS_SUCCESS;
+    }
+
+    return status;
+}
+
+static void *
+submit_queue_worker(void *arg)
+{
+    struct submit_queue *queue = arg;
+    struct submit_queue_entry *entry;
+    VAStatus status;
+
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while (queue->tail == queue->head && !queue->stop)
+            pthread_cond_wait(&queue->pushed, &queue->lock);
+        if (queue->tail == queue->head)
+            break;
+
+        /* The entry is not reused before tail moves past it */
+        entry = &queue->entries[queue->tail % SUBMIT_QUEUE_SIZE];
+        pthread_mutex_unlock(&queue->lock);
+
+        status = queue->submit(queue->data, &entry->op);
+
+        pthread_mutex_lock(&queue->lock);
+        if (status != VA_STATUS_SUCCESS)
+            submit_queue_fail(queue, entry, status);
+        if (entry->op.buffers != entry->inline_buffers)
+            free(entry->op.buffers);
+        queue->tail++;
+        pthread_cond_broadcast(&queue->done);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return NULL;
+}
+
+struct submit_queue *
+submit_queue_create(VAStatus (*submit)(void *data, const struct submit_op *op), void *data,
+                    uint64_t *clock)
+{
+    struct submit_queue *queue;
+
+    queue = calloc(1, sizeof(*queue));
+    if (!queue)
+        return NULL;
+
+    queue->submit = submit;
+    queue->data = data;
+    queue->clock = clock;
+    queue->render_target = VA_INVALID_SURFACE;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->pushed, NULL);
+    pthread_cond_init(&queue->done, NULL);
+
+    if (pthread_create(&queue->worker, NULL, submit_queue_worker, queue)) {
+        pthread_cond_destroy(&queue->done);
+        pthread_cond_destroy(&queue->pushed);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void
+submit_queue_destroy(struct submit_queue *queue)
+{
+    if (!queue)
+        return;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->stop = 1;
+    pthread_cond_signal(&queue->pushed);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(queue->worker, NULL);
+
+    pthread_cond_destroy(&queue->done);
+    pthread_cond_destroy(&queue->pushed);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->fences);
+    free(queue);
+}
+
+VAStatus
+submit_queue_push(struct submit_queue *queue, const struct submit_op *op)
+{
+    struct submit_queue_entry *entry;
+    VABufferID *buffers = NULL;
+    VAStatus status = VA_STATUS_SUCCESS;
+
+    if (op->type == SUBMIT_RENDER_PICTURE && op->num_buffers > SUBMIT_INLINE_BUFFERS) {
+        buffers = malloc(2 * op->num_buffers * sizeof(*buffers));
+        if (!buffers)
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    if (op->type == SUBMIT_BEGIN_PICTURE)
+        status = submit_queue_fence(queue, op->render_target, queue->head);
+    else if (op->type == SUBMIT_END_PICTURE && queue->render_target != VA_INVALID_SURFACE)
+        status = submit_queue_fence(queue, queue->render_target, queue->head);
+    if (status != VA_STATUS_SUCCESS) {
+        if (op->type == SUBMIT_BEGIN_PICTURE)
+            queue->render_target = VA_INVALID_SURFACE;
+        pthread_mutex_unlock(&queue->lock);
+        return status;
+    }
+
+    while (queue->head - queue->tail >= SUBMIT_QUEUE_SIZE)
+        pthread_cond_wait(&queue->done, &queue->lock);
+
+    entry = &queue->entries[queue->head % SUBMIT_QUEUE_SIZE];
+    entry->op = *op;
+    entry->seq = queue->head;
+    entry->surface = op->type == SUBMIT_BEGIN_PICTURE ? op->render_target : queue->render_target;
+    /* Under the lock, so the stamps of a queue go up */
+    entry->op.stamp = __atomic_add_fetch(queue->clock, 1, __ATOMIC_SEQ_CST);
+    if (op->type == SUBMIT_RENDER_PICTURE) {
+        if (!buffers)
+            buffers = entry->inline_buffers;
+        entry->op.buffers = buffers;
+        entry->op.drv_buffers = buffers + op->num_buffers;
+        memcpy(entry->op.buffers, op->buffers, op->num_buffers * sizeof(*buffers));
+        memcpy(entry->op.drv_buffers, op->drv_buffers, op->num_buffers * sizeof(*buffers));
+    } else {
+        entry->op.buffers = entry->op.drv_buffers = entry->inline_buffers;
+    }
+    if (op->type == SUBMIT_BEGIN_PICTURE)
+        queue->render_target = op->render_target;
+    else if (op->type == SUBMIT_END_PICTURE)
+        queue->render_target = VA_INVALID_SURFACE;
+
+    queue->head++;
+    pthread_cond_signal(&queue->pushed);
+
+    /* A new picture does not answer for the last one on its surface */
+    status = queue->status;
+    queue->status = VA_STATUS_SUCCESS;
+    if (status == VA_STATUS_SUCCESS && op->type != SUBMIT_BEGIN_PICTURE &&
+        entry->surface != VA_INVALID_SURFACE)
+        status = submit_queue_take_status(queue, entry->surface);
+    pthread_mutex_unlock(&queue->lock);
+
+    return status;
+}
+
+int
+submit_queue_wait_surface(struct submit_queue *queue, VASurfaceID surface, VAStatus *status)
+{
+    struct submit_fence *fence;
+    uint64_t seq;
+
+    pthread_mutex_lock(&queue->lock);
+    fence = submit_queue_find_fence(queue, surface);
+    if (!fence) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+
+    seq = fence->seq;
+    while (queue->tail <= seq)
+        pthread_cond_wait(&queue->done, &queue->lock);
+
+    if (status)
+        *status = submit_queue_take_status(queue, surface);
+    pthread_mutex_unlock(&queue->lock);
+
+    return 1;
+}
+
+void
+submit_queue_wait_before(struct submit_queue *queue, VASurfaceID surface, uint64_t stamp)
+{
+    struct submit_fence *fence;
+
+    /* The call at tail is the oldest pending, once it was pushed after
+     * stamp, so were all the others.
+     */
+    pthread_mutex_lock(&queue->lock);
+    while ((fence = submit_queue_find_fence(queue, surface)) &&
+           queue->tail <= fence->seq &&
+           queue->entries[queue->tail % SUBMIT_QUEUE_SIZE].op.stamp < stamp)
+        pthread_cond_wait(&queue->done, &queue->lock);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void
+submit_queue_forget_surface(struct submit_queue *queue, VASurfaceID surface)
+{
+    struct submit_fence *fence;
+
+    pthread_mutex_lock(&queue->lock);
+    fence = submit_queue_find_fence(queue, surface);
+    if (fence)
+        *fence = queue->fences[--queue->num_fences];
+    pthread_mutex_unlock(&queue->lock);
+}
+
+int
+submit_queue_surface_pending(struct submit_queue *queue, VASurfaceID surface)
+{
+    struct submit_fence *fence;
+    int pending;
+
+    pthread_mutex_lock(&queue->lock);
+    fence = submit_queue_find_fence(queue, surface);
+    pending = fence && queue->tail <= fence->seq;
+    pthread_mutex_unlock(&queue->lock);
+
+    return pending;
+}
+
+void
+submit_queue_wait_buffer(struct submit_queue *queue, VABufferID buffer)
+{
+    struct submit_queue_entry *entry;
+    uint64_t seq, last = 0;
+    int found = 0;
+    int i;
+
+    pthread_mutex_lock(&queue->lock);
+    for (seq = queue->tail; seq < queue->head; seq++) {
+        entry = &queue->entries[seq % SUBMIT_QUEUE_SIZE];
+        if (entry->op.type != SUBMIT_RENDER_PICTURE)
+            continue;
+        for (i = 0; i < entry->op.num_buffers; i++) {
+            if (entry->op.buffers[i] == buffer) {
+                last = seq;
+                found = 1;
+                break;
+            }
+        }
+    }
+
+    while (found && queue->tail <= last)
+        pthread_cond_wait(&queue->done, &queue->lock);
+    pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _SUBMIT_QUEUE_H_
+#define _SUBMIT_QUEUE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <va/va.h>
+
+/**
+ * @file Queue of the picture calls of one context, made on a worker thread.
+ *
+ * vaBeginPicture, vaRenderPicture and vaEndPicture are pushed in the order
+ * the application makes them and return right away, while the worker hands
+ * them to the backend one after another. Every picture pushed leaves a
+ * fence on its render target, calls that read the surface wait for the
+ * fence before going to the backend. Buffers rendered are in use until
+ * their vaRenderPicture has been made.
+ *
+ * A call the worker makes that fails is kept on the fence of its picture's
+ * surface, and returned by the next push for the surface or wait on the
+ * fence that asks for it, as there is no one else to return it to. The
+ * fence is dropped with the surface, so an ID the backend hands out again
+ * does not inherit it.
+ *
+ * Queues created with the same clock stamp their calls in the order they
+ * were pushed to any of them, for the worker of one to wait for the calls
+ * on a surface another was handed first, see submit_queue_wait_before.
+ *
+ * Example:
+ *
+ *     queue = submit_queue_create(submit, data, &clock);
+ *     op.type = SUBMIT_BEGIN_PICTURE;
+ *     op.render_target = surface;
+ *     submit_queue_push(queue, &op);
+ *     ...
+ *     submit_queue_wait_surface(queue, surface);
+ *     submit_queue_destroy(queue);
+ */
+
+#define SUBMIT_QUEUE_SIZE	64	/* calls pushed ahead of the worker before a push waits */
+#define SUBMIT_INLINE_BUFFERS	8	/* buffers of a vaRenderPicture held without allocating */
+
+enum submit_op_type {
+    SUBMIT_BEGIN_PICTURE,
+    SUBMIT_RENDER_PICTURE,
+    SUBMIT_END_PICTURE,
+};
+
+struct submit_op {
+    enum submit_op_type type;
+    VASurfaceID render_target;	/* vaBeginPicture, as the application knows it */
+    VASurfaceID drv_render_target;	/* vaBeginPicture, as the backend knows it */
+    int num_buffers;		/* vaRenderPicture */
+    VABufferID *buffers;	/* as the application knows them */
+    VABufferID *drv_buffers;	/* as the backend knows them */
+    uint64_t stamp;		/* order of the push on the clock, set by submit_queue_push */
+};
+
+/* The last picture pushed for a surface */
+struct submit_fence {
+    VASurfaceID surface;
+    uint64_t seq;		/* of its vaEndPicture, or vaBeginPicture until pushed */
+    VAStatus status;		/* first failure of its pictures not returned yet */
+};
+
+struct submit_queue_entry {
+    struct submit_op op;
+    uint64_t seq;
+    VASurfaceID surface;	/* render target of the picture of op */
+    VABufferID inline_buffers[2 * SUBMIT_INLINE_BUFFERS];
+};
+
+struct submit_queue {
+    VAStatus (*submit)(void *data, const struct submit_op *op);
+    void *data;
+    uint64_t *clock;		/* shared with the queues of other contexts */
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t pushed;	/* signalled on a push and on destroy */
+    pthread_cond_t done;	/* signalled each time the worker made a call */
+    uint64_t head;		/* seq of the next push */
+    uint64_t tail;		/* seq of the next call the worker makes */
+    struct submit_queue_entry entries[SUBMIT_QUEUE_SIZE];
+    VASurfaceID render_target;	/* of the last vaBeginPicture pushed */
+    struct submit_fence *fences;
+    int num_fences;
+    int max_fences;
+    VAStatus status;		/* first failure outside a picture not returned yet */
+    int stop;
+};
+
+/**
+ * Start the worker, which makes each call with submit(data, op). Calls are
+ * stamped by incrementing clock, shared by the queues that wait for each
+ * other.
+ *
+ * @return The queue or NULL if it could not be allocated or the worker
+ * could not be started.
+ */
+struct submit_queue *
+submit_queue_create(VAStatus (*submit)(void *data, const struct submit_op *op), void *data,
+                    uint64_t *clock);
+
+/**
+ * Wait for the calls pushed to be made, and stop the worker.
+ */
+void
+submit_queue_destroy(struct submit_queue *queue);
+
+/**
+ * Push a copy of op, waiting if SUBMIT_QUEUE_SIZE calls are pending.
+ *
+ * @return A failure of an earlier call for the surface of the picture of op,
+ * or VA_STATUS_SUCCESS.
+ */
+VAStatus
+submit_queue_push(struct submit_queue *queue, const struct submit_op *op);
+
+/**
+ * Wait for the vaEndPicture of the last picture pushed for surface.
+ *
+ * @return 1 if surface is a render target of the queue, 0 otherwise. Unless
+ * status is NULL, the failure of an earlier call for surface, if any, is
+ * moved to status.
+ */
+int
+submit_queue_wait_surface(struct submit_queue *queue, VASurfaceID surface, VAStatus *status);
+
+/**
+ * Wait for the calls of the pictures on surface pushed before stamp, a
+ * stamp of another queue of the same clock, to be made. The worker of that
+ * queue waits this way, as waiting for calls pushed after its own could
+ * make two workers wait for each other.
+ */
+void
+submit_queue_wait_before(struct submit_queue *queue, VASurfaceID surface, uint64_t stamp);
+
+/**
+ * Drop the fence of surface, and the failure kept on it, once the surface
+ * is destroyed. Its calls must have been waited for.
+ */
+void
+submit_queue_forget_surface(struct submit_queue *queue, VASurfaceID surface);
+
+/**
+ * @return 1 if the vaEndPicture of the last picture pushed for surface is
+ * still pending, 0 otherwise.
+ */
+int
+submit_queue_surface_pending(struct submit_queue *queue, VASurfaceID surface);
+
+/**
+ * Wait until buffer is no longer in a pending vaRenderPicture.
+ */
+void
+submit_queue_wait_buffer(struct submit_queue *queue, VABufferID buffer);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "surface_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN(i, n)    (((i) + (n) - 1) & ~((n) - 1))
+
+struct surface_pool *
+surface_pool_create(uint64_t max_size, surface_pool_free_func free_surface, void *data)
+{
+    struct surface_pool *pool;
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    list_init(&pool->buckets);
+    list_init(&pool->lru);
+    pool->max_size = max_size;
+    pool->free_surface = free_surface;
+    pool->data = data;
+
+    return pool;
+}
+
+static void
+surface_pool_remove(struct surface_pool *pool, struct surface_pool_entry *entry)
+{
+    list_del(&entry->link);
+    list_del(&entry->lru);
+    pool->size -= entry->size;
+
+    /* A bucket goes with its last surface, or every size ever seen stays */
+    if (list_is_empty(&entry->bucket->surfaces)) {
+        list_del(&entry->bucket->link);
+        free(entry->bucket);
+    }
+}
+
+/* Free the surfaces taken out of the pool onto dropped */
+static void
+surface_pool_free(struct surface_pool *pool, struct list *dropped)
+{
+    struct surface_pool_entry *entry, *next;
+
+    list_for_each_entry_safe(entry, next, dropped, lru) {
+        pool->free_surface(pool->data, entry->surface, entry->data);
+        free(entry);
+    }
+}
+
+void
+surface_pool_destroy(struct surface_pool *pool)
+{
+    struct surface_pool_bucket *bucket, *next;
+
+    if (!pool)
+        return;
+
+    surface_pool_free(pool, &pool->lru);
+    list_for_each_entry_safe(bucket, next, &pool->buckets, link)
+        free(bucket);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+static int
+surface_pool_same_layout(const struct surface_pool_key *a, const struct surface_pool_key *b)
+{
+    return a->format == b->format && a->width == b->width &&
+           a->height == b->height && a->stride == b->stride;
+}
+
+int
+surface_pool_get(struct surface_pool *pool, const struct surface_pool_key *key,
+                 VASurfaceID *surface, void **data)
+{
+    struct surface_pool_bucket *bucket, *found = NULL;
+    struct surface_pool_entry *entry = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    list_for_each_entry(bucket, &pool->buckets, link) {
+        if (!surface_pool_same_layout(&bucket->key, key))
+            continue;
+        found = bucket;
+        if (bucket->key.mapping == key->mapping)
+            break;
+    }
+
+    if (found) {
+        entry = list_first_entry(&found->surfaces, struct surface_pool_entry, link);
+        surface_pool_remove(pool, entry);
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!entry)
+        return 0;
+
+    *surface = entry->surface;
+    *data = entry->data;
+    free(entry);
+    return 1;
+}
+
+void
+surface_pool_put(struct surface_pool *pool, const struct surface_pool_key *key,
+                 uint64_t size, VASurfaceID surface, void *data)
+{
+    struct surface_pool_bucket *bucket;
+    struct surface_pool_entry *entry, *oldest;
+    struct list dropped;
+
+    list_init(&dropped);
+
+    entry = size <= pool->max_size ? calloc(1, sizeof(*entry)) : NULL;
+    if (!entry) {
+        pool->free_surface(pool->data, surface, data);
+        return;
+    }
+    entry->size = size;
+    entry->surface = surface;
+    entry->data = data;
+
+    pthread_mutex_lock(&pool->lock);
+    list_for_each_entry(bucket, &pool->buckets, link) {
+        if (!memcmp(&bucket->key, key, sizeof(*key)))
+            break;
+    }
+    if (&bucket->link == &pool->buckets) {
+        bucket = calloc(1, sizeof(*bucket));
+        if (!bucket) {
+            pthread_mutex_unlock(&pool->lock);
+            pool->free_surface(pool->data, surface, data);
+            free(entry);
+            return;
+        }
+        bucket->key = *key;
+        list_init(&bucket->surfaces);
+        list_add(&bucket->link, &pool->buckets);
+    }
+
+    entry->bucket = bucket;
+    list_add(&entry->link, &bucket->surfaces);
+    list_add(&entry->lru, &pool->lru);
+    pool->size += size;
+
+    /* Drop the least recently released surfaces to get below max_size */
+    while (pool->size > pool->max_size) {
+        oldest = container_of(pool->lru.prev, struct surface_pool_entry, lru);
+        surface_pool_remove(pool, oldest);
+        list_add(&oldest->lru, &dropped);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    surface_pool_free(pool, &dropped);
+}
+
+uint64_t
+surface_pool_size(const struct surface_pool_key *key)
+{
+    uint64_t pitch = key->stride ? key->stride : ALIGN(key->width, 128);
+    uint64_t rows = ALIGN(key->height, 32);
+
+    switch (key->format) {
+    case VA_RT_FORMAT_YUV422:
+        return pitch * rows * 2;
+    case VA_RT_FORMAT_YUV444:
+        return pitch * rows * 3;
+    default:
+        return pitch * rows * 3 / 2;
+    }
+}
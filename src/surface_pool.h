@@ -0,0 +1,134 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _SURFACE_POOL_H_
+#define _SURFACE_POOL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <va/va.h>
+
+#include "list.h"
+
+/**
+ * @file Pool of released surfaces, to be handed out again by vaCreateSurfaces.
+ *
+ * Players switching between renditions of a stream destroy their surfaces
+ * and create new ones of another size, often one they had before. Creating
+ * a surface means allocating and clearing its memory, and for a context of
+ * another backend also sharing it with that backend. So instead of being
+ * destroyed, released surfaces are kept with whatever the caller needs to
+ * use them again, e.g. their mappings into the other backends.
+ *
+ * Surfaces are bucketed by everything that decides whether one can stand in
+ * for another: format, size, pitch and the backends it is mapped into. A
+ * request is served from the bucket with the same mapping if there is one,
+ * from one with another mapping of the same layout otherwise. The pool holds
+ * at most max_size bytes, the least recently released surfaces are freed
+ * through the callback to stay below. The pool has a lock of its own, and
+ * the callback is called without it.
+ *
+ * Example:
+ *
+ *     pool = surface_pool_create(64 << 20, destroy_surface, data);
+ *     key.format = VA_RT_FORMAT_YUV420;
+ *     key.width = 1280;
+ *     key.height = 720;
+ *     if (!surface_pool_get(pool, &key, &surface, &surface_data))
+ *         create_surface(&surface);
+ *     surface_pool_put(pool, &key, size, surface, surface_data);
+ *     surface_pool_destroy(pool);
+ */
+
+struct surface_pool_key {
+    unsigned int format;	/* VA_RT_FORMAT_* */
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;	/* pitch it was allocated with, 0 if the driver picked it */
+    unsigned int mapping;	/* backends it is mapped into, a bit each */
+};
+
+struct surface_pool_bucket {
+    struct list link;
+    struct surface_pool_key key;
+    struct list surfaces;	/* struct surface_pool_entry, most recently released first */
+};
+
+struct surface_pool_entry {
+    struct list link;		/* in the bucket */
+    struct list lru;		/* in the pool */
+    struct surface_pool_bucket *bucket;
+    uint64_t size;
+    VASurfaceID surface;
+    void *data;
+};
+
+/* Frees a surface the pool drops, data is what surface_pool_put was given */
+typedef void (*surface_pool_free_func)(void *pool_data, VASurfaceID surface, void *data);
+
+struct surface_pool {
+    pthread_mutex_t lock;	/* protects everything below */
+    struct list buckets;
+    struct list lru;		/* struct surface_pool_entry, most recently released first */
+    uint64_t size;		/* of the surfaces held */
+    uint64_t max_size;
+    uint64_t hits;
+    uint64_t misses;
+    surface_pool_free_func free_surface;
+    void *data;
+};
+
+/**
+ * @return The new pool or NULL if it could not be allocated.
+ */
+struct surface_pool *
+surface_pool_create(uint64_t max_size, surface_pool_free_func free_surface, void *data);
+
+/* Free the surfaces still held, then the pool */
+void
+surface_pool_destroy(struct surface_pool *pool);
+
+/**
+ * Take a surface of the layout of key out of the pool.
+ *
+ * @return 1 and the surface in surface and data if there was one, 0 otherwise.
+ */
+int
+surface_pool_get(struct surface_pool *pool, const struct surface_pool_key *key,
+                 VASurfaceID *surface, void **data);
+
+/**
+ * Hand a released surface of size bytes to the pool, which frees it right
+ * away if it does not fit.
+ */
+void
+surface_pool_put(struct surface_pool *pool, const struct surface_pool_key *key,
+                 uint64_t size, VASurfaceID surface, void *data);
+
+/* The number of bytes a surface of key takes, as a driver would allocate it */
+uint64_t
+surface_pool_size(const struct surface_pool_key *key);
+
+#endif
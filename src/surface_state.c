@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "surface_state.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+static void *
+surface_state_poller(void *arg)
+{
+    struct surface_state_table *table = arg;
+    struct timespec deadline;
+    uint64_t slot;
+    VASurfaceID surface;
+    int i;
+
+    pthread_mutex_lock(&table->lock);
+    while (!table->stop) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += table->poll_ns % 1000000000;
+        deadline.tv_sec += table->poll_ns / 1000000000 + deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        if (pthread_cond_timedwait(&table->stop_cond, &table->lock, &deadline) != ETIMEDOUT)
+            continue;
+        pthread_mutex_unlock(&table->lock);
+
+        for (i = 0; i < SURFACE_STATE_SLOTS; i++) {
+            slot = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+            if ((slot & SURFACE_STATE_MASK) != SURFACE_STATE_SUBMITTED)
+                continue;
+
+            surface = slot >> 32;
+            if (table->is_ready(table->data, surface))
+                surface_state_complete(table, surface, slot);
+        }
+
+        pthread_mutex_lock(&table->lock);
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    return NULL;
+}
+
+struct surface_state_table *
+surface_state_create(uint64_t poll_ns, int (*is_ready)(void *data, VASurfaceID surface), void *data)
+{
+    struct surface_state_table *table;
+    pthread_condattr_t attr;
+
+    table = calloc(1, sizeof(*table));
+    if (!table)
+        return NULL;
+
+    table->is_ready = is_ready;
+    table->data = data;
+    table->poll_ns = poll_ns;
+    pthread_mutex_init(&table->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&table->stop_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    /* Without the poller the table still works, from the calls alone */
+    if (poll_ns)
+        table->polling = !pthread_create(&table->poller, NULL, surface_state_poller, table);
+
+    return table;
+}
+
+void
+surface_state_destroy(struct surface_state_table *table)
+{
+    if (!table)
+        return;
+
+    if (table->polling) {
+        pthread_mutex_lock(&table->lock);
+        table->stop = 1;
+        pthread_cond_signal(&table->stop_cond);
+        pthread_mutex_unlock(&table->lock);
+        pthread_join(table->poller, NULL);
+    }
+
+    pthread_cond_destroy(&table->stop_cond);
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
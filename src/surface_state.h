@@ -0,0 +1,201 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _SURFACE_STATE_H_
+#define _SURFACE_STATE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <va/va.h>
+
+/**
+ * @file Table of the surfaces being decoded into and those that are done.
+ *
+ * A surface is rendering from the vaBeginPicture that renders to it, and
+ * submitted from the vaEndPicture of that picture until a vaSyncSurface
+ * returns, a vaQuerySurfaceStatus reports it ready or the poller finds it
+ * ready, after which it is complete. vaSyncSurface and vaQuerySurfaceStatus
+ * of a complete surface need not ask the backend. A backend may well call a
+ * surface ready before vaEndPicture, which is why only submitted surfaces
+ * can become complete.
+ *
+ * Like struct object_map, the table is indexed by the low bits of the
+ * surface ID, which the backends' object heaps keep dense. It is a cache
+ * rather than a map though: a surface takes over the slot of another one
+ * with the same low bits, which is then no longer tracked. Untracked
+ * surfaces are never complete, so calls on them go to the backend as they
+ * would without the table. Every slot is a single word holding the surface
+ * ID, the state and a count of its changes, so the table takes no lock. The
+ * render target of each context is kept the same way, from vaBeginPicture
+ * to vaEndPicture.
+ *
+ * A call that learns the surface is done passes the token it got before
+ * asking the backend, so a vaBeginPicture made in the meantime is not
+ * undone.
+ *
+ * Example:
+ *
+ *     table = surface_state_create(poll_ns, is_ready, data);
+ *     surface_state_begin(table, context, surface);
+ *     surface_state_end(table, context);
+ *     if (surface_state_get(table, surface, &token) != SURFACE_STATE_COMPLETE &&
+ *         sync(surface) == VA_STATUS_SUCCESS)
+ *         surface_state_complete(table, surface, token);
+ *     surface_state_destroy(table);
+ */
+
+#define SURFACE_STATE_IDLE		0	/* not rendered to, or not tracked */
+#define SURFACE_STATE_RENDERING		1
+#define SURFACE_STATE_SUBMITTED		2
+#define SURFACE_STATE_COMPLETE		3
+
+#define SURFACE_STATE_SLOTS	4096	/* a power of two */
+#define SURFACE_STATE_MASK	3u
+#define SURFACE_STATE_CHANGE	4u	/* added to the count of changes */
+
+struct surface_state_table {
+    uint64_t slots[SURFACE_STATE_SLOTS];	/* surface ID << 32 | changes | state */
+    uint64_t render_targets[SURFACE_STATE_SLOTS];	/* context ID << 32 | surface ID */
+    int (*is_ready)(void *data, VASurfaceID surface);
+    void *data;
+    uint64_t poll_ns;
+    pthread_t poller;
+    int polling;
+    pthread_mutex_t lock;
+    pthread_cond_t stop_cond;
+    int stop;
+};
+
+static inline uint64_t *
+surface_state_slot(struct surface_state_table *table, VASurfaceID surface)
+{
+    return &table->slots[surface & (SURFACE_STATE_SLOTS - 1)];
+}
+
+/**
+ * @return The state of surface. token is set for surface_state_complete.
+ */
+static inline int
+surface_state_get(struct surface_state_table *table, VASurfaceID surface, uint64_t *token)
+{
+    uint64_t slot = __atomic_load_n(surface_state_slot(table, surface), __ATOMIC_ACQUIRE);
+
+    *token = slot;
+    if ((VASurfaceID)(slot >> 32) != surface)
+        return SURFACE_STATE_IDLE;
+
+    return slot & SURFACE_STATE_MASK;
+}
+
+/* Move surface to state, taking over its slot */
+static inline void
+surface_state_set(struct surface_state_table *table, VASurfaceID surface, int state)
+{
+    uint64_t *slot = surface_state_slot(table, surface);
+    uint64_t old = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    uint64_t new;
+
+    do {
+        new = (uint64_t)surface << 32 |
+              (((uint32_t)old & ~SURFACE_STATE_MASK) + SURFACE_STATE_CHANGE) | state;
+    } while (!__atomic_compare_exchange_n(slot, &old, new, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Move surface to state, unless it changed since token was returned */
+static inline void
+surface_state_move(struct surface_state_table *table, VASurfaceID surface, uint64_t token, int state)
+{
+    uint64_t new = ((token & ~(uint64_t)SURFACE_STATE_MASK) + SURFACE_STATE_CHANGE) | state;
+
+    /* The count of changes wraps around within the low word */
+    new = (token & ~(uint64_t)UINT32_MAX) | (uint32_t)new;
+    __atomic_compare_exchange_n(surface_state_slot(table, surface), &token, new,
+                                0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/**
+ * Mark surface as being rendered to by context.
+ */
+static inline void
+surface_state_begin(struct surface_state_table *table, VAContextID context, VASurfaceID surface)
+{
+    surface_state_set(table, surface, SURFACE_STATE_RENDERING);
+    __atomic_store_n(&table->render_targets[context & (SURFACE_STATE_SLOTS - 1)],
+                     (uint64_t)context << 32 | surface, __ATOMIC_RELAXED);
+}
+
+/**
+ * Mark the render target of context as submitted.
+ */
+static inline void
+surface_state_end(struct surface_state_table *table, VAContextID context)
+{
+    uint64_t render_target = __atomic_load_n(&table->render_targets[context & (SURFACE_STATE_SLOTS - 1)],
+                                             __ATOMIC_RELAXED);
+    VASurfaceID surface = (VASurfaceID)render_target;
+    uint64_t token;
+
+    /* A surface that lost its slot in the meantime stays untracked */
+    if ((VAContextID)(render_target >> 32) == context &&
+        surface_state_get(table, surface, &token) == SURFACE_STATE_RENDERING)
+        surface_state_move(table, surface, token, SURFACE_STATE_SUBMITTED);
+}
+
+/**
+ * Mark surface as done, unless it changed since token was returned.
+ */
+static inline void
+surface_state_complete(struct surface_state_table *table, VASurfaceID surface, uint64_t token)
+{
+    if ((VASurfaceID)(token >> 32) == surface && (token & SURFACE_STATE_MASK) == SURFACE_STATE_SUBMITTED)
+        surface_state_move(table, surface, token, SURFACE_STATE_COMPLETE);
+}
+
+/**
+ * Forget a surface that is destroyed, its ID may come back for another one.
+ */
+static inline void
+surface_state_forget(struct surface_state_table *table, VASurfaceID surface)
+{
+    uint64_t token;
+
+    if (surface_state_get(table, surface, &token) != SURFACE_STATE_IDLE)
+        surface_state_set(table, surface, SURFACE_STATE_IDLE);
+}
+
+/**
+ * Create a table. With poll_ns, a thread asks is_ready(data, surface) about
+ * every submitted surface each poll_ns, and marks those it returns 1 for
+ * complete.
+ *
+ * @return The table or NULL if it could not be allocated.
+ */
+struct surface_state_table *
+surface_state_create(uint64_t poll_ns, int (*is_ready)(void *data, VASurfaceID surface), void *data);
+
+void
+surface_state_destroy(struct surface_state_table *table);
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+static void
+trace_thread_exit(void *data);
+
+struct trace *
+trace_create(const char *path, const char * const *drv_names)
+{
+    struct trace *trace;
+
+    trace = calloc(1, sizeof(*trace));
+    if (!trace)
+        return NULL;
+
+    trace->file = fopen(path, "w");
+    if (!trace->file)
+        goto error;
+
+    if (pthread_key_create(&trace->key, trace_thread_exit))
+        goto error;
+
+    fprintf(trace->file, "[");
+    trace->first = 1;
+    trace->drv_names = drv_names;
+    trace->start = call_stats_now();
+    pthread_mutex_init(&trace->lock, NULL);
+    list_init(&trace->threads);
+
+    return trace;
+
+error:
+    if (trace->file)
+        fclose(trace->file);
+    free(trace);
+    return NULL;
+}
+
+static struct trace_thread *
+trace_get_thread(struct trace *trace)
+{
+    struct trace_thread *thread = pthread_getspecific(trace->key);
+
+    if (thread)
+        return thread;
+
+    thread = calloc(1, sizeof(*thread));
+    if (!thread)
+        return NULL;
+
+    thread->trace = trace;
+    thread->tid = syscall(SYS_gettid);
+    thread->last_drv = -1;
+
+    pthread_mutex_lock(&trace->lock);
+    list_add(&thread->link, &trace->threads);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_setspecific(trace->key, thread);
+
+    return thread;
+}
+
+static struct trace_event *
+trace_next_event(struct trace_thread *thread)
+{
+    return &thread->events[thread->head & (TRACE_RING_SIZE - 1)];
+}
+
+/* Make the event filled in by the caller visible to trace_destroy */
+static void
+trace_publish_event(struct trace_thread *thread)
+{
+    __atomic_store_n(&thread->head, thread->head + 1, __ATOMIC_RELEASE);
+}
+
+void
+trace_call(struct trace *trace, int drv, const char *name, uint64_t start)
+{
+    struct trace_thread *thread = trace_get_thread(trace);
+    struct trace_event *event;
+
+    if (!thread)
+        return;
+
+    event = trace_next_event(thread);
+    event->start = start;
+    event->end = call_stats_now();
+    event->name = name;
+    event->context = VA_INVALID_ID;
+    event->surface = VA_INVALID_ID;
+    event->drv = drv;
+    event->scope = 0;
+    trace_publish_event(thread);
+
+    thread->last_drv = drv;
+    thread->last_call = start;
+}
+
+void
+trace_scope_record(struct trace_scope *scope)
+{
+    struct trace_thread *thread = trace_get_thread(scope->trace);
+    struct trace_event *event;
+
+    if (!thread)
+        return;
+
+    event = trace_next_event(thread);
+    event->start = scope->start;
+    event->end = call_stats_now();
+    event->name = scope->name;
+    event->context = scope->context;
+    event->surface = scope->surface;
+    event->drv = thread->last_call >= scope->start ? thread->last_drv : -1;
+    event->scope = 1;
+    trace_publish_event(thread);
+}
+
+static void
+trace_write_event(struct trace *trace, FILE *file, pid_t pid, pid_t tid,
+                  const struct trace_event *event, int first)
+{
+    uint64_t ts = event->start - trace->start;
+    uint64_t dur = event->end - event->start;
+
+    fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+            "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"pid\":%d,\"tid\":%d,\"args\":{",
+            first ? "" : ",",
+            event->name,
+            event->scope ? "wrapper" : trace->drv_names[event->drv],
+            (unsigned long long)(ts / 1000), (unsigned long long)(ts % 1000),
+            (unsigned long long)(dur / 1000), (unsigned long long)(dur % 1000),
+            (int)pid, (int)tid);
+
+    first = 1;
+    if (event->drv >= 0) {
+        fprintf(file, "\"backend\":\"%s\"", trace->drv_names[event->drv]);
+        first = 0;
+    }
+    if (event->context != VA_INVALID_ID) {
+        fprintf(file, "%s\"context\":\"0x%08x\"", first ? "" : ",", event->context);
+        first = 0;
+    }
+    if (event->surface != VA_INVALID_ID)
+        fprintf(file, "%s\"surface\":\"0x%08x\"", first ? "" : ",", event->surface);
+
+    fprintf(file, "}}");
+}
+
+/* Append the ring of thread to the file and free it, with trace->lock held */
+static void
+trace_write_thread(struct trace *trace, struct trace_thread *thread)
+{
+    pid_t pid = getpid();
+    uint64_t head, i;
+
+    head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+    i = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for (; i < head; i++) {
+        trace_write_event(trace, trace->file, pid, thread->tid,
+                          &thread->events[i & (TRACE_RING_SIZE - 1)], trace->first);
+        trace->first = 0;
+    }
+    fflush(trace->file);
+
+    list_del(&thread->link);
+    free(thread);
+}
+
+/* Destructor of the key, run when a thread that recorded events exits */
+static void
+trace_thread_exit(void *data)
+{
+    struct trace_thread *thread = data;
+    struct trace *trace = thread->trace;
+
+    pthread_mutex_lock(&trace->lock);
+    trace_write_thread(trace, thread);
+    pthread_mutex_unlock(&trace->lock);
+}
+
+void
+trace_destroy(struct trace *trace)
+{
+    struct trace_thread *thread, *next;
+
+    if (!trace)
+        return;
+
+    /* No destructor runs once the key is gone, the rings of the threads
+     * still alive are written here.
+     */
+    pthread_key_delete(trace->key);
+
+    pthread_mutex_lock(&trace->lock);
+    list_for_each_entry_safe(thread, next, &trace->threads, link)
+        trace_write_thread(trace, thread);
+    pthread_mutex_unlock(&trace->lock);
+
+    fprintf(trace->file, "\n]\n");
+    fclose(trace->file);
+
+    pthread_mutex_destroy(&trace->lock);
+    free(trace);
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <va/va.h>
+
+#include "call_stats.h"
+#include "list.h"
+
+/**
+ * @file Chrome trace (chrome://tracing, Perfetto) export of wrapper calls.
+ *
+ * Two kinds of events are recorded, both as complete ("X") events:
+ *
+ * - a scope per wrapper function, with the context and surface it was
+ *   called for and the backend it last dispatched to,
+ * - a call per backend vtable entry, nested in the scope that made it.
+ *
+ * The gap between a scope and the backend calls in it is the wrapper's own
+ * work. Every thread writes to a ring of its own, found through a pthread
+ * key, and publishes each event by bumping its head with a release store,
+ * so recording takes no lock. When a ring is full the oldest events are
+ * overwritten. A ring is appended to the JSON file and freed when its
+ * thread exits, and trace_destroy writes the rings of the threads still
+ * alive. The file is in the JSON array format, whose closing bracket is
+ * optional, so the file of a process that never gets to trace_destroy
+ * still loads.
+ *
+ * Example:
+ *
+ *     trace = trace_create(path, drv_names);
+ *     {
+ *         TRACE_SCOPE(trace, context, surface);
+ *         start = call_stats_now();
+ *         vtable->vaBeginPicture(...);
+ *         trace_call(trace, drv, "vaBeginPicture", start);
+ *     }
+ *     trace_destroy(trace);
+ */
+
+#define TRACE_RING_SIZE		(1 << 16)	/* events per thread */
+
+struct trace_event {
+    uint64_t start;
+    uint64_t end;
+    const char *name;
+    VAGenericID context;
+    VAGenericID surface;
+    int drv;			/* -1 if unknown */
+    int scope;			/* wrapper function rather than backend call */
+};
+
+struct trace_thread {
+    struct list link;
+    struct trace *trace;
+    pid_t tid;
+    int last_drv;		/* backend of the last call, for the enclosing scope */
+    uint64_t last_call;		/* start of that call */
+    uint64_t head;		/* number of events ever recorded */
+    struct trace_event events[TRACE_RING_SIZE];
+};
+
+struct trace {
+    const char * const *drv_names;
+    uint64_t start;
+    pthread_key_t key;
+    pthread_mutex_t lock;	/* protects threads, file and first */
+    struct list threads;
+    FILE *file;
+    int first;			/* no event written yet */
+};
+
+struct trace_scope {
+    struct trace *trace;
+    const char *name;
+    uint64_t start;
+    VAGenericID context;
+    VAGenericID surface;
+};
+
+/**
+ * Start a scope that lasts until the end of the enclosing block. Pass
+ * VA_INVALID_ID for IDs that do not apply.
+ */
+#define TRACE_SCOPE(trace, context, surface)				\
+    struct trace_scope trace_scope					\
+        __attribute__((cleanup(trace_scope_end))) =			\
+        trace_scope_begin(trace, __func__, context, surface)
+
+static inline struct trace_scope
+trace_scope_begin(struct trace *trace, const char *name,
+                  VAGenericID context, VAGenericID surface)
+{
+    struct trace_scope scope = { trace, name, 0, context, surface };
+
+    if (trace)
+        scope.start = call_stats_now();
+
+    return scope;
+}
+
+void
+trace_scope_record(struct trace_scope *scope);
+
+static inline void
+trace_scope_end(struct trace_scope *scope)
+{
+    if (scope->trace)
+        trace_scope_record(scope);
+}
+
+/**
+ * @return The new trace or NULL if it could not be allocated or path could
+ * not be created.
+ */
+struct trace *
+trace_create(const char *path, const char * const *drv_names);
+
+/**
+ * Write the recorded events to the trace file and free the trace.
+ */
+void
+trace_destroy(struct trace *trace);
+
+/**
+ * Record a call to the vtable entry name of backend drv that started at
+ * start, a time returned by call_stats_now.
+ */
+void
+trace_call(struct trace *trace, int drv, const char *name, uint64_t start);
+
+#endif
@@ -27,18 +27,29 @@
  *
  */
 
+#define _GNU_SOURCE	/* dladdr */
+
 #include "wrapper_drv_video.h"
 
+#include <dlfcn.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dlfcn.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdio.h>
-#include <assert.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #define ALIGN(i, n)    (((i) + (n) - 1) & ~((n) - 1))
 
-#define DRIVER_EXTENSION	"_drv_video.so"
+#ifndef VA_DRIVERS_PATH
+#define VA_DRIVERS_PATH		"/usr/lib64/va/drivers"
+#endif
+
+/* VP8 goes to pvr unless LIBVA_WRAPPER_ROUTES(_FILE) says otherwise */
+#define VAWR_DEFAULT_ROUTES	"VP8Version0_3:VLD=pvr"
 
 void vawr_errorMessage(const char *msg, ...)
 {
@@ -60,114 +71,952 @@ void vawr_infoMessage(const char *msg, ...)
     va_end(args);
 }
 
-static inline int
-va_getDriverInitName(char *name, int namelen, int major, int minor)
+/* Search the same directories as libva, so the backends can be swapped for
+ * other builds, e.g. the stub drivers in bench/, without installing them.
+ */
+static const char *
+vawr_driversPath(void)
 {
-    int ret = snprintf(name, namelen, "__vaDriverInit_%d_%d", major, minor);
-    return ret > 0 && ret < namelen;
+    const char *search_path = NULL;
+
+    if (geteuid() == getuid())
+        search_path = getenv("LIBVA_DRIVERS_PATH");
+
+    return search_path ? search_path : VA_DRIVERS_PATH;
 }
 
-static VAStatus vawr_openDriver(VADriverContextP ctx, char *driver_name)
+/* Load a backend, or take another reference on it if another display of
+ * the process already has, see driver_registry_open, and initialize it on
+ * ctx. The backend keeps the reference until vawr_Terminate.
+ */
+static VAStatus
+vawr_openDriver(VADriverContextP ctx, char *driver_name, struct driver_entry **driver)
 {
-    VAStatus vaStatus = VA_STATUS_ERROR_UNKNOWN;
+    VAStatus vaStatus;
+
+    vaStatus = driver_registry_open(vawr_driversPath(), driver_name, driver);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        return vaStatus;
+
+    vaStatus = (*driver)->init(ctx);
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        vawr_errorMessage("%s init failed\n", (*driver)->path);
+        driver_registry_close(*driver);
+        *driver = NULL;
+    }
+
+    return vaStatus;
+}
 
-    char *driver_dir = "/usr/lib64/va/drivers/";
-    void *handle = NULL;
+/* Load a backend on its own copy of ctx. The backend keeps its pDriverData
+ * and vtable in the copy, so later calls into it never have to touch the
+ * ctx that libva handed to the wrapper.
+ */
+static VAStatus
+vawr_loadBackend(VADriverContextP ctx, struct vawr_driver_data *vawr, int drv, char *driver_name)
+{
+    VAStatus vaStatus;
+    struct vawr_backend *backend;
 
-    char *driver_path = (char *) calloc(1, strlen(driver_dir) +
-                                         strlen(driver_name) +
-                                         strlen(DRIVER_EXTENSION) + 1 );
-    if (!driver_path) {
-        vawr_errorMessage("%s L%d Out of memory!n",
-                            __FUNCTION__, __LINE__);
+    backend = calloc(1, sizeof(*backend));
+    if (!backend)
         return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    memcpy(&backend->ctx, ctx, sizeof(backend->ctx));
+    backend->ctx.pDriverData = NULL;
+    backend->ctx.vtable = &backend->vtable;
+
+    vaStatus = vawr_openDriver(&backend->ctx, driver_name, &backend->driver);
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        free(backend);
+        return vaStatus;
     }
 
-    strncpy( driver_path, driver_dir, strlen(driver_dir) );
-    strncat( driver_path, driver_name, strlen(driver_name) );
-    strncat( driver_path, DRIVER_EXTENSION, strlen(DRIVER_EXTENSION) );
+    /* Pairs with the check in vawr_useBackend that skips the lock */
+    __atomic_store_n(&vawr->backends[drv], backend, __ATOMIC_RELEASE);
 
-    handle = dlopen( driver_path, RTLD_NOW| RTLD_GLOBAL);
-    if (!handle) {
-        /* Manage error if the file exists or not we need to know what's going
-	 * on */
-        vawr_errorMessage("dlopen of %s failed: %s\n", driver_path, dlerror());
-    } else {
-        VADriverInit init_func = NULL;
-        char init_func_s[256];
-        int i;
-
-        static const struct {
-            int major;
-            int minor;
-        } compatible_versions[] = {
-            { VA_MAJOR_VERSION, VA_MINOR_VERSION },
-            { 0, 33 },
-            { 0, 32 },
-            { -1, }
-        };
+    return VA_STATUS_SUCCESS;
+}
 
-        for (i = 0; compatible_versions[i].major >= 0; i++) {
-            if (va_getDriverInitName(init_func_s, sizeof(init_func_s),
-                                     compatible_versions[i].major,
-                                     compatible_versions[i].minor)) {
-                init_func = (VADriverInit)dlsym(handle, init_func_s);
-                if (init_func) {
-                    vawr_infoMessage("Found init function %s\n", init_func_s);
-                    break;
-                }
+/* Load the other backends ahead of the first vaCreateConfig routed to them.
+ * The backend lock is held for each load, so vawr_CreateConfig only waits if
+ * it comes in before the load of its backend has finished.
+ */
+static void *
+vawr_prewarmThread(void *arg)
+{
+    struct vawr_driver_data *vawr = arg;
+    char *driver_name;
+    int drv;
+
+    for (drv = I965_DRV + 1; drv < vawr->num_drvs; drv++) {
+        driver_name = (char *)vawr->routes->drv_names[drv];
+
+        pthread_mutex_lock(&vawr->backend_lock);
+        /* i965's copy of ctx is a snapshot of libva's ctx taken during init,
+         * unlike libva's ctx it is not written to while we read it.
+         */
+        if (!vawr->backends[drv] &&
+            vawr_loadBackend(GET_DRVCTX(vawr, I965_DRV), vawr, drv, driver_name) != VA_STATUS_SUCCESS)
+            vawr_infoMessage("pre-warming %s failed, it will be loaded on demand\n", driver_name);
+        pthread_mutex_unlock(&vawr->backend_lock);
+    }
+
+    return NULL;
+}
+
+static int
+vawr_profile_to_drv(struct vawr_driver_data *vawr, VAProfile profile, VAEntrypoint entrypoint)
+{
+    return route_table_lookup(vawr->routes, profile, entrypoint);
+}
+
+/* Pick the backend a new context of a config that several backends can
+ * decode goes to. A backend that has not decoded a frame yet is tried
+ * first, the one with the fewest contexts among those. Once all have, the
+ * context goes where the time a frame takes, times the contexts that would
+ * share the backend, is the lowest.
+ */
+static int
+vawr_pickBackend(struct vawr_driver_data *vawr, unsigned int drvs)
+{
+    uint64_t frames, score, best_score = UINT64_MAX;
+    int contexts, best_contexts = INT_MAX;
+    int drv, best = -1, fresh = 0;
+
+    for (drv = 0; drv < vawr->num_drvs; drv++) {
+        if (!(drvs & (1u << drv)))
+            continue;
+
+        contexts = __atomic_load_n(&vawr->load[drv].contexts, __ATOMIC_RELAXED);
+        frames = __atomic_load_n(&vawr->load[drv].frames, __ATOMIC_RELAXED);
+        if (!frames) {
+            if (!fresh || contexts < best_contexts) {
+                best = drv;
+                best_contexts = contexts;
             }
+            fresh = 1;
+            continue;
         }
+        if (fresh)
+            continue;
 
-        if (compatible_versions[i].major < 0) {
-            vawr_errorMessage("%s has no function %s\n",
-                            driver_path, init_func_s);
-        } else {
-            if (init_func)
-                vaStatus = (*init_func)(ctx);
-		if (VA_STATUS_SUCCESS != vaStatus) {
-			vawr_errorMessage("%s init failed\n", driver_path);
-		} else {
-			/* TODO: Store the handle to a private structure */
-		}
+        score = __atomic_load_n(&vawr->load[drv].busy_ns, __ATOMIC_RELAXED) / frames * (contexts + 1);
+        if (score < best_score) {
+            best = drv;
+            best_score = score;
         }
     }
-    free(driver_path);
-    driver_path=NULL;
+
+    return best;
+}
+
+/* vaEndPicture and vaSyncSurface calls are the ones a busy backend makes
+ * wait, add the time one took since start to drv's load. The backends decode
+ * the frames of their contexts one after another, so the time is shared
+ * among them.
+ */
+#define VAWR_LOAD_WINDOW	256	/* frames before the load is halved */
+
+static void
+vawr_recordLoad(struct vawr_driver_data *vawr, int drv, uint64_t start, int frame)
+{
+    struct vawr_load *load = &vawr->load[drv];
+    int contexts = __atomic_load_n(&load->contexts, __ATOMIC_RELAXED);
+    uint64_t busy_ns = call_stats_now() - start;
+
+    __atomic_fetch_add(&load->busy_ns, busy_ns / (contexts > 1 ? contexts : 1), __ATOMIC_RELAXED);
+    if (frame && __atomic_add_fetch(&load->frames, 1, __ATOMIC_RELAXED) == VAWR_LOAD_WINDOW) {
+        /* Let the recent frames count the most */
+        __atomic_fetch_sub(&load->frames, VAWR_LOAD_WINDOW / 2, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&load->busy_ns, __atomic_load_n(&load->busy_ns, __ATOMIC_RELAXED) / 2, __ATOMIC_RELAXED);
+    }
+}
+
+#define VAWR_LOAD_START(vawr)	\
+	(__atomic_load_n(&(vawr)->balanced, __ATOMIC_RELAXED) ? call_stats_now() : 0)
+
+/* Surfaces are always allocated by i965. Once a surface has been mapped into
+ * another backend as a render target of a context there, it is owned by that
+ * context.
+ */
+static int
+vawr_surface_drv(struct vawr_driver_data *vawr, VASurfaceID surface)
+{
+    vawr_surface_lookup_t *surface_lookup = vawr_lookup(vawr, &vawr->surfaces, surface);
+
+    return surface_lookup ? __atomic_load_n(&surface_lookup->drv, __ATOMIC_RELAXED) : I965_DRV;
+}
+
+/* The backend that last wrote surface, the one to wait on for it */
+static int
+vawr_surface_writer(struct vawr_driver_data *vawr, VASurfaceID surface)
+{
+    vawr_surface_lookup_t *surface_lookup = vawr_lookup(vawr, &vawr->surfaces, surface);
+
+    return surface_lookup ? __atomic_load_n(&surface_lookup->writer, __ATOMIC_ACQUIRE) : I965_DRV;
+}
+
+/* Make drv wait for the backend that last wrote surface before it reads
+ * surface, or writes it when write is set, which then makes drv the writer.
+ * A backend orders the calls on a surface among its own only, while the
+ * twins of a surface share its memory, so a picture pvr is still decoding
+ * would otherwise be displayed by i965 half done. VA-API has no fence one
+ * backend can hand another, the writer's vaSyncSurface is the fence, and it
+ * is skipped once the surface is known to be done, see surface_state.
+ *
+ * surface_lookup is the record of surface, NULL for surfaces never mapped
+ * into another backend, which are only ever written by i965.
+ * A failed decode is left for vaSyncSurface to report, the caller goes on.
+ */
+static void
+vawr_fenceSurface(struct vawr_driver_data *vawr, vawr_surface_lookup_t *surface_lookup,
+                  VASurfaceID surface, int drv, int write)
+{
+    VASurfaceID writer_surface = surface;
+    uint64_t token = 0;
+    VAStatus vaStatus;
+    int writer;
+
+    if (!surface_lookup)
+        return;
+    writer = __atomic_load_n(&surface_lookup->writer, __ATOMIC_ACQUIRE);
+    if (writer == drv)
+        return;
+
+    if (!vawr->surface_states ||
+        surface_state_get(vawr->surface_states, surface, &token) != SURFACE_STATE_COMPLETE) {
+        if (writer != I965_DRV)
+            writer_surface = surface_lookup->drv_surfaces[writer];
+        CALL_DRVVTABLE(vawr, writer, vaStatus, vaSyncSurface, writer_surface);
+        if (vaStatus == VA_STATUS_SUCCESS && vawr->surface_states)
+            surface_state_complete(vawr->surface_states, surface, token);
+    }
+    if (write)
+        __atomic_store_n(&surface_lookup->writer, drv, __ATOMIC_RELEASE);
+}
+
+/* Record the object drv_id of drv, obj is NULL for objects of I965_DRV */
+static VAStatus
+vawr_object_add(struct vawr_driver_data *vawr,
+                struct object_map *map,        /* per-backend array of maps */
+                struct vawr_object *obj,
+                int drv,
+                VAGenericID drv_id)
+{
+    int ret;
+
+    if (drv_id & ~VAWR_DRV_ID_MASK) {
+        vawr_errorMessage("backend %d returned ID 0x%x outside of its ID range\n", drv, drv_id);
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
+    if (!obj)
+        return VA_STATUS_SUCCESS;
+
+    obj->drv = drv;
+    obj->drv_id = drv_id;
+    obj->id = VAWR_ID(drv, drv_id);
+
+    pthread_rwlock_wrlock(&vawr->lock);
+    ret = object_map_insert(&map[drv], drv_id, obj);
+    pthread_rwlock_unlock(&vawr->lock);
+
+    if (ret) {
+        vawr_errorMessage("backend %d ID 0x%x could not be recorded, its index may be in use\n", drv, drv_id);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Record an image created by backend drv together with its data buffer,
+ * and rewrite the IDs in image to the ones the application will see.
+ */
+static VAStatus
+vawr_image_add(struct vawr_driver_data *vawr, int drv, VAImage *image)
+{
+    struct vawr_image *obj_image;
+    struct vawr_buffer *obj_buffer;
+
+    if (drv == I965_DRV) {
+        if (vawr_object_add(vawr, vawr->buffers, NULL, drv, image->buf) ||
+            vawr_object_add(vawr, vawr->images, NULL, drv, image->image_id))
+            return VA_STATUS_ERROR_OPERATION_FAILED;
+        return VA_STATUS_SUCCESS;
+    }
+
+    obj_image = calloc(1, sizeof(*obj_image));
+    obj_buffer = calloc(1, sizeof(*obj_buffer));
+    if (!obj_image || !obj_buffer)
+        goto error;
+
+    obj_buffer->context_id = VA_INVALID_ID;
+    obj_buffer->type = VAImageBufferType;
+    if (vawr_object_add(vawr, vawr->buffers, &obj_buffer->base, drv, image->buf))
+        goto error;
+
+    obj_image->buf_id = obj_buffer->base.id;
+    if (vawr_object_add(vawr, vawr->images, &obj_image->base, drv, image->image_id)) {
+        vawr_object_remove(vawr, vawr->buffers, &obj_buffer->base);
+        goto error;
+    }
+
+    image->image_id = obj_image->base.id;
+    image->buf = obj_buffer->base.id;
+
+    return VA_STATUS_SUCCESS;
+
+error:
+    free(obj_image);
+    free(obj_buffer);
+    return VA_STATUS_ERROR_ALLOCATION_FAILED;
+}
+
+/* Wait for the pictures on surface the other contexts with a queue were
+ * handed before stamp, on the worker of obj_context, so that the writer
+ * vawr_fenceSurface syncs with is the last one and has its picture.
+ */
+static void
+vawr_waitQueues(struct vawr_driver_data *vawr, struct vawr_context *obj_context,
+                VASurfaceID surface, uint64_t stamp)
+{
+    struct vawr_context *other;
+
+    pthread_rwlock_rdlock(&vawr->queues_lock);
+    LIST_FOR_EACH_ENTRY(other, &vawr->queues, link) {
+        if (other != obj_context)
+            submit_queue_wait_before(other->queue, surface, stamp);
+    }
+    pthread_rwlock_unlock(&vawr->queues_lock);
+}
+
+/* Wait for the queued pictures of every context to surface to be made
+ * before it is read, or handed to a backend's vaSyncSurface.
+ *
+ * @return The failure of a queued call of a picture on surface, if any.
+ * It is left for vaSyncSurface unless take is set.
+ */
+static inline VAStatus
+vawr_waitSurface(struct vawr_driver_data *vawr, VASurfaceID surface, int take)
+{
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    VAStatus queueStatus = VA_STATUS_SUCCESS;
+    struct vawr_context *obj_context;
+
+    if (!vawr->async)
+        return VA_STATUS_SUCCESS;
+
+    pthread_rwlock_rdlock(&vawr->queues_lock);
+    LIST_FOR_EACH_ENTRY(obj_context, &vawr->queues, link) {
+        if (submit_queue_wait_surface(obj_context->queue, surface, take ? &queueStatus : NULL) &&
+            queueStatus != VA_STATUS_SUCCESS)
+            vaStatus = queueStatus;
+    }
+    pthread_rwlock_unlock(&vawr->queues_lock);
+
+    return vaStatus;
+}
+
+struct vawr_input_fence {
+    struct vawr_driver_data *vawr;
+    struct vawr_context *obj_context;	/* NULL when called by the application */
+    uint64_t stamp;
+};
+
+static void
+vawr_fenceInput(void *data, VASurfaceID surface)
+{
+    struct vawr_input_fence *fence = data;
+    struct vawr_driver_data *vawr = fence->vawr;
+
+    if (fence->obj_context)
+        vawr_waitQueues(vawr, fence->obj_context, surface, fence->stamp);
+    else
+        vawr_waitSurface(vawr, surface, 0);
+    vawr_fenceSurface(vawr, vawr_lookup(vawr, &vawr->surfaces, surface), surface, I965_DRV, 0);
+}
+
+/* Make i965 wait for the writers of the surfaces that the video processing
+ * pipelines in buffers read, which unlike a render target are named in the
+ * parameters only. A decoder reads only the references its own backend
+ * wrote, while a pipeline on i965, where VAEntrypointVideoProc goes unless
+ * routed elsewhere, typically reads the picture pvr just decoded. The
+ * parameters are read through a map of the buffer, the reference arrays
+ * they point to are the application's.
+ */
+static void
+vawr_fenceInputs(struct vawr_driver_data *vawr, struct vawr_context *obj_context,
+                 const VABufferID *drv_buffers, int num_buffers, uint64_t stamp)
+{
+    struct vawr_input_fence fence = { vawr, obj_context, stamp };
+    struct vawr_buffer *obj_buffer;
+    VAStatus vaStatus;
+    void *data;
+    int i;
+
+    for (i = 0; i < num_buffers; i++) {
+        obj_buffer = vawr_lookup(vawr, &vawr->buffers[I965_DRV], drv_buffers[i]);
+        if (!obj_buffer || obj_buffer->type != VAProcPipelineParameterBufferType ||
+            !obj_buffer->desc)
+            continue;
+
+        CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaMapBuffer, drv_buffers[i], &data);
+        if (vaStatus != VA_STATUS_SUCCESS)
+            continue;
+        param_buffer_for_each(obj_buffer->desc, data, obj_buffer->size, obj_buffer->num_elements,
+                              vawr_fenceInput, &fence);
+        CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaUnmapBuffer, drv_buffers[i]);
+    }
+}
+
+/* Make a picture call queued by a context with LIBVA_WRAPPER_ASYNC, on the
+ * worker thread of its submit_queue
+ */
+static VAStatus
+vawr_submit(void *data, const struct submit_op *op)
+{
+    struct vawr_context *obj_context = data;
+    struct vawr_driver_data *vawr = obj_context->vawr;
+    int drv = obj_context->base.drv;
+    VAStatus vaStatus = VA_STATUS_ERROR_UNIMPLEMENTED;
+    uint64_t start;
+
+    switch (op->type) {
+    case SUBMIT_BEGIN_PICTURE:
+        /* The writer may not even have been handed its picture yet */
+        vawr_waitQueues(vawr, obj_context, op->render_target, op->stamp);
+        vawr_fenceSurface(vawr, vawr_lookup(vawr, &vawr->surfaces, op->render_target),
+                          op->render_target, drv, 1);
+        if (vawr->surface_states)
+            surface_state_begin(vawr->surface_states, obj_context->base.id, op->render_target);
+        CALL_DRVVTABLE(vawr, drv, vaStatus, vaBeginPicture, obj_context->base.drv_id, op->drv_render_target);
+        break;
+    case SUBMIT_RENDER_PICTURE:
+        if (drv == I965_DRV)
+            vawr_fenceInputs(vawr, obj_context, op->drv_buffers, op->num_buffers, op->stamp);
+        CALL_DRVVTABLE(vawr, drv, vaStatus, vaRenderPicture, obj_context->base.drv_id, op->drv_buffers, op->num_buffers);
+        break;
+    case SUBMIT_END_PICTURE:
+        start = VAWR_LOAD_START(vawr);
+        CALL_DRVVTABLE(vawr, drv, vaStatus, vaEndPicture, obj_context->base.drv_id);
+        if (vaStatus == VA_STATUS_SUCCESS && vawr->surface_states)
+            surface_state_end(vawr->surface_states, obj_context->base.id);
+        if (start)
+            vawr_recordLoad(vawr, drv, start, 1);
+        break;
+    }
+
     return vaStatus;
 }
 
+/* The record of context if its picture calls are queued, NULL otherwise.
+ * obj_context is what CHECK_OBJECT found, which leaves out i965 contexts.
+ */
+static inline struct vawr_context *
+vawr_queuedContext(struct vawr_driver_data *vawr, VAContextID context, struct vawr_context *obj_context)
+{
+    if (!vawr->async)
+        return NULL;
+    if (!obj_context)
+        obj_context = GET_OBJECT(vawr, context, context);
+
+    return obj_context && obj_context->queue ? obj_context : NULL;
+}
+
+/* Drop the fences of a destroyed surface, waited for by vawr_waitSurface,
+ * so a surface that gets its ID next does not answer for it.
+ */
+static inline void
+vawr_forgetSurface(struct vawr_driver_data *vawr, VASurfaceID surface)
+{
+    struct vawr_context *obj_context;
+
+    if (!vawr->async)
+        return;
+
+    pthread_rwlock_rdlock(&vawr->queues_lock);
+    LIST_FOR_EACH_ENTRY(obj_context, &vawr->queues, link)
+        submit_queue_forget_surface(obj_context->queue, surface);
+    pthread_rwlock_unlock(&vawr->queues_lock);
+}
+
+static inline int
+vawr_surfacePending(struct vawr_driver_data *vawr, VASurfaceID surface)
+{
+    struct vawr_context *obj_context;
+    int pending = 0;
+
+    if (!vawr->async)
+        return 0;
+
+    pthread_rwlock_rdlock(&vawr->queues_lock);
+    LIST_FOR_EACH_ENTRY(obj_context, &vawr->queues, link) {
+        if (submit_queue_surface_pending(obj_context->queue, surface)) {
+            pending = 1;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&vawr->queues_lock);
+
+    return pending;
+}
+
+/* Wait for a queued vaRenderPicture of buffer to be made before it is
+ * mapped or destroyed
+ */
+static inline void
+vawr_waitBuffer(struct vawr_driver_data *vawr, VABufferID buffer)
+{
+    struct vawr_context *obj_context;
+
+    if (!vawr->async)
+        return;
+
+    pthread_rwlock_rdlock(&vawr->queues_lock);
+    LIST_FOR_EACH_ENTRY(obj_context, &vawr->queues, link)
+        submit_queue_wait_buffer(obj_context->queue, buffer);
+    pthread_rwlock_unlock(&vawr->queues_lock);
+}
+
+/* Ask the backend of surface whether it is done, for the poller of
+ * vawr->surface_states. The surface may be destroyed by the application at
+ * any time, so its twin is looked up under the lock, and a backend that has
+ * reused the twin's ID in the meantime is harmless, the surface has changed
+ * state by then.
+ */
+static int
+vawr_surfaceReady(void *data, VASurfaceID surface)
+{
+    struct vawr_driver_data *vawr = data;
+    vawr_surface_lookup_t *surface_lookup;
+    VASurfaceStatus status;
+    VASurfaceID drv_surface = surface;
+    VAStatus vaStatus;
+    int drv = I965_DRV;
+
+    if (vawr_surfacePending(vawr, surface))
+        return 0;
+
+    pthread_rwlock_rdlock(&vawr->lock);
+    surface_lookup = object_map_lookup(&vawr->surfaces, surface);
+    if (surface_lookup) {
+        drv = __atomic_load_n(&surface_lookup->writer, __ATOMIC_ACQUIRE);
+        if (drv != I965_DRV)
+            drv_surface = surface_lookup->drv_surfaces[drv];
+    }
+    pthread_rwlock_unlock(&vawr->lock);
+
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaQuerySurfaceStatus, drv_surface, &status);
+
+    return vaStatus == VA_STATUS_SUCCESS && status == VASurfaceReady;
+}
+
+/* Stop queueing the picture calls of obj_context, once those queued are made */
+static void
+vawr_stopQueue(struct vawr_driver_data *vawr, struct vawr_context *obj_context)
+{
+    pthread_rwlock_wrlock(&vawr->queues_lock);
+    LIST_DEL(&obj_context->link);
+    pthread_rwlock_unlock(&vawr->queues_lock);
+
+    submit_queue_destroy(obj_context->queue);
+    obj_context->queue = NULL;
+}
+
+/* Free the pooled surfaces and unload the backends, before the stats are
+ * printed and what the backend calls use is freed by vawr_destroy.
+ */
+static VAStatus
+vawr_unloadBackends(struct vawr_driver_data *vawr)
+{
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    int drv;
+
+    surface_pool_destroy(vawr->surface_pool);
+    vawr->surface_pool = NULL;
+
+    for (drv = vawr->num_drvs - 1; drv >= 0; drv--) {
+        VAStatus drvStatus;
+
+        if (!vawr->backends[drv])
+            continue;
+
+        CALL_DRVVTABLE(vawr, drv, drvStatus, vaTerminate);
+        if (drvStatus != VA_STATUS_SUCCESS)
+            vaStatus = drvStatus;
+        driver_registry_close(vawr->backends[drv]->driver);
+        free(vawr->backends[drv]);
+        vawr->backends[drv] = NULL;
+    }
+
+    return vaStatus;
+}
+
+/* Free vawr and whatever __vaDriverInit_0_32 got to create */
+static void
+vawr_destroy(struct vawr_driver_data *vawr)
+{
+    int drv;
+
+    call_stats_destroy(vawr->stats);
+    trace_destroy(vawr->trace);
+
+    object_map_fini(&vawr->surfaces, free);
+    for (drv = 0; drv < vawr->num_drvs; drv++) {
+        object_map_fini(&vawr->configs[drv], free);
+        object_map_fini(&vawr->contexts[drv], free);
+        object_map_fini(&vawr->buffers[drv], free);
+        object_map_fini(&vawr->images[drv], free);
+        object_map_fini(&vawr->subpictures[drv], free);
+    }
+    pthread_rwlock_destroy(&vawr->lock);
+    pthread_rwlock_destroy(&vawr->queues_lock);
+    pthread_mutex_destroy(&vawr->backend_lock);
+    pitch_table_destroy(vawr->pitches);
+    route_table_destroy(vawr->routes);
+    if (vawr->caps_mapped)
+        caps_table_unmap(vawr->caps);
+    else
+        caps_table_destroy(vawr->caps);
+    free(vawr);
+}
+
 VAStatus
 vawr_Terminate(VADriverContextP ctx)
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaTerminate(ctx));
-    RESTORE_VAWRDATA(ctx, vawr);
+    if (vawr->prewarm_started)
+        pthread_join(vawr->prewarm_thread, NULL);
+
+    /* Contexts the application did not destroy */
+    while (!LIST_IS_EMPTY(&vawr->queues))
+        vawr_stopQueue(vawr, LIST_FIRST_ENTRY(&vawr->queues, struct vawr_context, link));
+    surface_state_destroy(vawr->surface_states);
+    if (vawr->surface_pool && vawr->stats)
+        vawr_infoMessage("surface pool: %llu hits, %llu misses\n",
+                         (unsigned long long)vawr->surface_pool->hits,
+                         (unsigned long long)vawr->surface_pool->misses);
+    if (vawr->stats && vawr->shared_surfaces)
+        vawr_infoMessage("shared surfaces: %llu, %llu bytes of padding, %llu per surface\n",
+                         (unsigned long long)vawr->shared_surfaces,
+                         (unsigned long long)vawr->padding,
+                         (unsigned long long)(vawr->padding / vawr->shared_surfaces));
+
+    vaStatus = vawr_unloadBackends(vawr);
+
+    if (vawr->stats)
+        call_stats_dump(vawr->stats, vawr->routes->drv_names, vawr_infoMessage);
+
+    /* libva frees the table it handed in */
+    ctx->vtable = vawr->vtable;
+
+    vawr_destroy(vawr);
+    ctx->pDriverData = NULL;
 
 	return vaStatus;
 }
 
+/* Fill vawr->caps from what i965 reports and the routes. A pair i965
+ * reported keeps i965's attributes wherever it is routed, as it did before
+ * the table. The other backends are only loaded for a config, and pvr does
+ * not publish VP8 in its vaQueryConfigProfiles anyway, so the wrapper
+ * answers for the pairs only routes know of. They decode into surfaces
+ * i965 allocates, which are all YUV 4:2:0.
+ */
+static VAStatus
+vawr_buildCaps(struct vawr_driver_data *vawr)
+{
+    VADriverContextP i965_ctx = GET_DRVCTX(vawr, I965_DRV);
+    VAProfile profiles[i965_ctx->max_profiles > 0 ? i965_ctx->max_profiles : 1];
+    VAEntrypoint entrypoints[i965_ctx->max_entrypoints > 0 ? i965_ctx->max_entrypoints : 1];
+    VAConfigAttrib attribs[CAPS_NUM_ATTRIBS];
+    struct caps_config *config;
+    const struct route *route;
+    int num_profiles = 0, num_entrypoints;
+    VAStatus vaStatus;
+    int i, j, k;
+
+    vawr->caps = caps_table_create();
+    if (!vawr->caps)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaQueryConfigProfiles, profiles, &num_profiles);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        num_profiles = 0;
+
+    for (i = 0; i < num_profiles; i++) {
+        if (caps_table_add_profile(vawr->caps, profiles[i]))
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+        num_entrypoints = 0;
+        CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaQueryConfigEntrypoints, profiles[i], entrypoints, &num_entrypoints);
+        if (vaStatus != VA_STATUS_SUCCESS)
+            continue;
+
+        for (j = 0; j < num_entrypoints; j++) {
+            config = caps_table_add(vawr->caps, profiles[i], entrypoints[j]);
+            if (!config)
+                return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+            for (k = 0; k < CAPS_NUM_ATTRIBS; k++)
+                attribs[k].type = k;
+            CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaGetConfigAttributes, profiles[i], entrypoints[j], attribs, CAPS_NUM_ATTRIBS);
+            if (vaStatus != VA_STATUS_SUCCESS)
+                continue;
+            for (k = 0; k < CAPS_NUM_ATTRIBS; k++)
+                config->attribs[k] = attribs[k].value;
+        }
+    }
+
+    for (i = 0; i < vawr->routes->num_routes; i++) {
+        route = &vawr->routes->routes[i];
+        if (caps_table_find(vawr->caps, route->profile, route->entrypoint))
+            continue;
+        config = caps_table_add(vawr->caps, route->profile, route->entrypoint);
+        if (!config)
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        if (route->drv == I965_DRV)
+            continue;
+
+        for (k = 0; k < CAPS_NUM_ATTRIBS; k++)
+            config->attribs[k] = VA_ATTRIB_NOT_SUPPORTED;
+        config->attribs[VAConfigAttribRTFormat] = VA_RT_FORMAT_YUV420;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* FNV-1a, for the key of the capability cache */
+static uint64_t
+vawr_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+/* Hash path and what the file there is, so the key changes when it is
+ * rebuilt or installed over.
+ *
+ * @return 0, or -1 if there is no file.
+ */
+static int
+vawr_hashFile(uint64_t *hash, const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st))
+        return -1;
+
+    *hash = vawr_hash(*hash, path, strlen(path) + 1);
+    *hash = vawr_hash(*hash, &st.st_dev, sizeof(st.st_dev));
+    *hash = vawr_hash(*hash, &st.st_ino, sizeof(st.st_ino));
+    *hash = vawr_hash(*hash, &st.st_size, sizeof(st.st_size));
+    *hash = vawr_hash(*hash, &st.st_mtim, sizeof(st.st_mtim));
+    return 0;
+}
+
+/* Hash the first driver_name in the search path */
+static uint64_t
+vawr_hashDriver(uint64_t hash, const char *driver_name)
+{
+    char *search_dirs, *driver_dir, *saveptr;
+    char driver_path[PATH_MAX];
+
+    search_dirs = strdup(vawr_driversPath());
+    if (!search_dirs)
+        return hash;
+
+    for (driver_dir = strtok_r(search_dirs, ":", &saveptr); driver_dir;
+         driver_dir = strtok_r(NULL, ":", &saveptr)) {
+        snprintf(driver_path, sizeof(driver_path), "%s/%s%s", driver_dir, driver_name, DRIVER_EXTENSION);
+        if (!vawr_hashFile(&hash, driver_path))
+            break;
+    }
+    free(search_dirs);
+
+    return hash;
+}
+
+/* Hash the wrapper itself and the cache format, so a rebuilt wrapper does
+ * not take the table the old code built
+ */
+static uint64_t
+vawr_hashWrapper(uint64_t hash)
+{
+    const uint32_t version = CAPS_FILE_VERSION;
+    Dl_info info;
+
+    hash = vawr_hash(hash, &version, sizeof(version));
+    if (dladdr((void *)vawr_hashWrapper, &info) && info.dli_fname)
+        vawr_hashFile(&hash, info.dli_fname);
+
+    return hash;
+}
+
+/* Hash the GPU behind the DRM fd libva opened, what i965 supports depends on
+ * its generation
+ */
+static uint64_t
+vawr_hashDevice(uint64_t hash, VADriverContextP ctx)
+{
+    static const char *const ids[] = { "vendor", "device", "revision" };
+    struct drm_state *drm_state = ctx->drm_state;
+    char path[PATH_MAX], id[32];
+    struct stat st;
+    ssize_t size;
+    unsigned int i;
+    int fd;
+
+    if (!drm_state || drm_state->fd < 0 || fstat(drm_state->fd, &st) || !S_ISCHR(st.st_mode))
+        return hash;
+
+    hash = vawr_hash(hash, &st.st_rdev, sizeof(st.st_rdev));
+    for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+        snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/device/%s",
+                 major(st.st_rdev), minor(st.st_rdev), ids[i]);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        size = read(fd, id, sizeof(id));
+        close(fd);
+        if (size > 0)
+            hash = vawr_hash(hash, id, size);
+    }
+
+    return hash;
+}
+
+/* Where the capabilities of this set of backends and routes on this GPU are
+ * cached, LIBVA_WRAPPER_CACHE_DIR or the user's cache directory.
+ *
+ * @return 0, or -1 if there is no cache.
+ */
+static int
+vawr_capsPath(VADriverContextP ctx, struct vawr_driver_data *vawr, char *path, size_t size, uint64_t *key)
+{
+    const struct route *route;
+    const char *dir, *home;
+    char dir_buf[PATH_MAX];
+    uint64_t hash = 0xcbf29ce484222325ull;
+    int i;
+
+    /* The file would be written wherever the environment says */
+    if (geteuid() != getuid())
+        return -1;
+
+    dir = getenv("LIBVA_WRAPPER_CACHE_DIR");
+    if (!dir) {
+        if ((home = getenv("XDG_CACHE_HOME")) && *home)
+            snprintf(dir_buf, sizeof(dir_buf), "%s/libva_wrapper", home);
+        else if ((home = getenv("HOME")) && *home)
+            snprintf(dir_buf, sizeof(dir_buf), "%s/.cache/libva_wrapper", home);
+        else
+            return -1;
+        dir = dir_buf;
+    }
+    if (!*dir)
+        return -1;
+
+    for (i = 0; i < vawr->num_drvs; i++) {
+        hash = vawr_hash(hash, vawr->routes->drv_names[i], strlen(vawr->routes->drv_names[i]) + 1);
+        hash = vawr_hashDriver(hash, vawr->routes->drv_names[i]);
+    }
+    for (i = 0; i < vawr->routes->num_routes; i++) {
+        route = &vawr->routes->routes[i];
+        hash = vawr_hash(hash, &route->profile, sizeof(route->profile));
+        hash = vawr_hash(hash, &route->entrypoint, sizeof(route->entrypoint));
+        hash = vawr_hash(hash, &route->drvs, sizeof(route->drvs));
+    }
+    hash = vawr_hashDevice(hash, ctx);
+    hash = vawr_hashWrapper(hash);
+
+    *key = hash;
+    return snprintf(path, size, "%s/caps-%016llx", dir, (unsigned long long)hash) < (int)size ? 0 : -1;
+}
+
+/* mkdir -p of the directory of path */
+static void
+vawr_makeDirs(char *path)
+{
+    char *slash;
+
+    for (slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+}
+
+/* Map the capabilities an earlier process saved, so that with defer set
+ * i965 is left to be loaded by the first call that needs it, see
+ * vawr_useBackend, and a process that only queries capabilities loads no
+ * backend at all. Otherwise load i965, build the table and save it for the
+ * next process.
+ */
+static VAStatus
+vawr_loadCaps(VADriverContextP ctx, struct vawr_driver_data *vawr, int defer)
+{
+    VADriverContextP i965_ctx;
+    char path[PATH_MAX];
+    uint64_t key;
+    VAStatus vaStatus;
+    int cached = !vawr_capsPath(ctx, vawr, path, sizeof(path), &key);
+
+    if (cached) {
+        vawr->caps = caps_table_map(path, key, &vawr->limits);
+        vawr->caps_mapped = vawr->caps != NULL;
+        if (vawr->caps && defer)
+            return VA_STATUS_SUCCESS;
+    }
+
+    vaStatus = vawr_loadBackend(ctx, vawr, I965_DRV, (char *)vawr->routes->drv_names[I965_DRV]);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        return vaStatus;
+
+    i965_ctx = GET_DRVCTX(vawr, I965_DRV);
+    vawr->limits.version_major = i965_ctx->version_major;
+    vawr->limits.version_minor = i965_ctx->version_minor;
+    vawr->limits.max_profiles = i965_ctx->max_profiles;
+    vawr->limits.max_entrypoints = i965_ctx->max_entrypoints;
+    vawr->limits.max_attributes = i965_ctx->max_attributes;
+    vawr->limits.max_image_formats = i965_ctx->max_image_formats;
+    vawr->limits.max_subpic_formats = i965_ctx->max_subpic_formats;
+    vawr->limits.max_display_attributes = i965_ctx->max_display_attributes;
+    snprintf(vawr->limits.vendor, sizeof(vawr->limits.vendor), "%s",
+             i965_ctx->str_vendor ? i965_ctx->str_vendor : "");
+    if (vawr->caps)
+        return VA_STATUS_SUCCESS;
+
+    vaStatus = vawr_buildCaps(vawr);
+    if (vaStatus == VA_STATUS_SUCCESS && cached) {
+        vawr_makeDirs(path);
+        if (caps_table_save(vawr->caps, &vawr->limits, key, path))
+            vawr_infoMessage("could not save the capabilities to %s\n", path);
+    }
+
+    return vaStatus;
+}
+
 VAStatus
 vawr_QueryConfigProfiles(VADriverContextP ctx,
                          VAProfile *profile_list,       /* out */
                          int *num_profiles)             /* out */
 {
-    VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaQueryConfigProfiles(ctx, profile_list, num_profiles));
-    RESTORE_VAWRDATA(ctx, vawr);
+    memcpy(profile_list, vawr->caps->profiles, vawr->caps->num_profiles * sizeof(*profile_list));
+    *num_profiles = vawr->caps->num_profiles;
 
-    /* PSB_DRV has not published VP8 profile in QueryConfigProfiles yet,
-     * that means we have to do it here.
-     */
-    profile_list[*num_profiles++] = VAProfileVP8Version0_3;
-
-	return vaStatus;
+	return VA_STATUS_SUCCESS;
 }
 
 VAStatus
@@ -176,21 +1025,16 @@ vawr_QueryConfigEntrypoints(VADriverContextP ctx,
                             VAEntrypoint *entrypoint_list,      /* out */
                             int *num_entrypoints)               /* out */
 {
-    VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    /* PSB_DRV currently only supports VLD entry point for VP8 */
-    if (profile == VAProfileVP8Version0_3) {
-	*entrypoint_list = VAEntrypointVLD;
-	*num_entrypoints = 1;
-	return VA_STATUS_SUCCESS;
+    *num_entrypoints = caps_table_entrypoints(vawr->caps, profile, entrypoint_list);
+    if (*num_entrypoints < 0) {
+        *num_entrypoints = 0;
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
     }
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaQueryConfigEntrypoints(ctx, profile, entrypoint_list, num_entrypoints));
-    RESTORE_VAWRDATA(ctx, vawr);
-
-	return vaStatus;
+	return VA_STATUS_SUCCESS;
 }
 
 VAStatus
@@ -200,31 +1044,134 @@ vawr_GetConfigAttributes(VADriverContextP ctx,
                          VAConfigAttrib *attrib_list,  /* in/out */
                          int num_attribs)
 {
-    VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
-    int i;
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    /* PSB_DRV currently only supports VAConfigAttribRTFormat attribute type */
-    if (profile == VAProfileVP8Version0_3) {
-        for (i = 0; i < num_attribs; i++) {
-		switch (attrib_list[i].type) {
-		case VAConfigAttribRTFormat:
-			attrib_list[i].value = VA_RT_FORMAT_YUV420;
-			break;
-		default:
-			attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
-			break;
-		}
-        }
+	return caps_table_attributes(vawr->caps, profile, entrypoint, attrib_list, num_attribs);
+}
+
+/* Load backend drv if it has not been loaded yet, and hand libva the table
+ * that dispatches to it. Every backend, i965 included, is loaded by the
+ * first config routed to it, or for i965 also by the first call on a
+ * surface, see vawr->lazy. Once both are done the check up front is all a
+ * caller pays, otherwise concurrent first users wait on the backend lock
+ * and only the first of them loads drv.
+ */
+static VAStatus
+vawr_useBackend(VADriverContextP ctx, struct vawr_driver_data *vawr, int drv)
+{
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    struct VADriverVTable *vtable = __atomic_load_n(&ctx->vtable, __ATOMIC_ACQUIRE);
 
+    if (__atomic_load_n(&vawr->backends[drv], __ATOMIC_ACQUIRE) &&
+        (drv == I965_DRV ? vtable != &vawr->lazy : vtable == vawr->vtable))
         return VA_STATUS_SUCCESS;
+
+    /* ctx->vtable is only written under the lock, so vawr_loadBackend can
+     * take a copy of ctx here.
+     */
+    pthread_mutex_lock(&vawr->backend_lock);
+    if (!vawr->backends[drv])
+        vaStatus = vawr_loadBackend(ctx, vawr, drv, (char *)vawr->routes->drv_names[drv]);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        /* From now on calls may be for drv, stop dispatching straight to i965 */
+        if (drv != I965_DRV)
+            vawr->primary_vtable = vawr->vtable;
+
+        /* Everything but the capability queries and vaCreateConfig needs
+         * i965, so until it is loaded libva keeps calling through vawr->lazy.
+         */
+        vtable = vawr->backends[I965_DRV] ? vawr->primary_vtable : &vawr->lazy;
+        if (ctx->vtable != vtable)
+            __atomic_store_n(&ctx->vtable, vtable, __ATOMIC_RELEASE);
     }
+    pthread_mutex_unlock(&vawr->backend_lock);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaGetConfigAttributes(ctx, profile, entrypoint, attrib_list, num_attribs));
-    RESTORE_VAWRDATA(ctx, vawr);
+    return vaStatus;
+}
 
-	return vaStatus;
+/* Create a config routed to several backends on each of them, so every
+ * context of it can be placed on whichever is the least loaded, see
+ * vawr_pickBackend. Backends that fail are left out. The config is owned by
+ * the first listed backend other than I965_DRV that has it, so it has a
+ * record to hold the configs of the others.
+ */
+static VAStatus
+vawr_createBalancedConfig(VADriverContextP ctx,
+                          struct vawr_driver_data *vawr,
+                          const struct route *route,
+                          VAProfile profile,
+                          VAEntrypoint entrypoint,
+                          VAConfigAttrib *attrib_list,
+                          int num_attribs,
+                          VAConfigID *config_id)	/* out */
+{
+    VAStatus vaStatus = VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+    VAStatus drvStatus;
+    struct vawr_config *obj_config;
+    int drv, owner = -1;
+
+    obj_config = calloc(1, sizeof(*obj_config));
+    if (!obj_config)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    obj_config->profile = profile;
+    obj_config->entrypoint = entrypoint;
+
+    for (drv = 0; drv < vawr->num_drvs; drv++) {
+        if (!(route->drvs & (1u << drv)))
+            continue;
+
+        drvStatus = vawr_useBackend(ctx, vawr, drv);
+        if (drvStatus == VA_STATUS_SUCCESS)
+            CALL_DRVVTABLE(vawr, drv, drvStatus, vaCreateConfig, profile, entrypoint, attrib_list, num_attribs, &obj_config->drv_configs[drv]);
+        if (drvStatus != VA_STATUS_SUCCESS) {
+            vawr_infoMessage("%s failed to create a config for profile %d, no contexts of it go there\n",
+                             vawr->routes->drv_names[drv], profile);
+            vaStatus = drvStatus;
+            continue;
+        }
+
+        obj_config->drvs |= 1u << drv;
+        if (drv != I965_DRV && (owner < 0 || drv == route->drv))
+            owner = drv;
+    }
+
+    if (owner < 0) {
+        /* At most i965 has it, which needs no record */
+        if (obj_config->drvs) {
+            vaStatus = vawr_object_add(vawr, vawr->configs, NULL, I965_DRV, obj_config->drv_configs[I965_DRV]);
+            if (vaStatus == VA_STATUS_SUCCESS) {
+                __atomic_fetch_add(&vawr->num_configs[I965_DRV], 1, __ATOMIC_RELAXED);
+                *config_id = obj_config->drv_configs[I965_DRV];
+            } else {
+                vawr->backends[I965_DRV]->vtable.vaDestroyConfig(GET_DRVCTX(vawr, I965_DRV), obj_config->drv_configs[I965_DRV]);
+            }
+        }
+        free(obj_config);
+        return vaStatus;
+    }
+
+    vaStatus = vawr_object_add(vawr, vawr->configs, &obj_config->base, owner, obj_config->drv_configs[owner]);
+    for (drv = 0; drv < vawr->num_drvs; drv++) {
+        if (!(obj_config->drvs & (1u << drv)))
+            continue;
+        if (vaStatus == VA_STATUS_SUCCESS)
+            __atomic_fetch_add(&vawr->num_configs[drv], 1, __ATOMIC_RELAXED);
+        else
+            vawr->backends[drv]->vtable.vaDestroyConfig(GET_DRVCTX(vawr, drv), obj_config->drv_configs[drv]);
+    }
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        free(obj_config);
+        return vaStatus;
+    }
+
+    /* Start keeping track of the load of the backends */
+    if (obj_config->drvs & (obj_config->drvs - 1))
+        __atomic_store_n(&vawr->balanced, 1, __ATOMIC_RELAXED);
+
+    *config_id = obj_config->base.id;
+
+    return VA_STATUS_SUCCESS;
 }
 
 VAStatus
@@ -235,50 +1182,48 @@ vawr_CreateConfig(VADriverContextP ctx,
                   int num_attribs,
                   VAConfigID *config_id)		/* out */
 {
-    VAStatus vaStatus;
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
-    struct VADriverVTable *psb_vtable = NULL;
-    struct VADriverVTable * const vtable = ctx->vtable;
-    char *driver_name = "pvr";
-
-    if (profile == VAProfileVP8Version0_3) {
-	vawr->profile = VAProfileVP8Version0_3;
-
-	/* This is the first time we learn about the config profile,
-	 * and we have to load psb_drv_video here if
-	 * a VP8 config is to be created.
-	 * Is this a good place to load psb_drv_video? We can
-	 * load it during vaInitialize together with i965_drv_video,
-	 * but it could slow down init for process that doesn't
-	 * require VP8.
-	 */
-        psb_vtable = calloc(1, sizeof(*psb_vtable));
-        if (!psb_vtable)
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_config *obj_config = NULL;
+    VAConfigID drv_config_id;
+    int drv = vawr_profile_to_drv(vawr, profile, entrypoint);
+
+    const struct route *route = route_table_find(vawr->routes, profile, entrypoint);
+
+    if (route && (route->drvs & (route->drvs - 1)))
+        return vawr_createBalancedConfig(ctx, vawr, route, profile, entrypoint, attrib_list, num_attribs, config_id);
+
+    vaStatus = vawr_useBackend(ctx, vawr, drv);
+    if (VA_STATUS_SUCCESS != vaStatus)
+        return vaStatus;
+
+    if (drv != I965_DRV) {
+        obj_config = calloc(1, sizeof(*obj_config));
+        if (!obj_config)
             return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        obj_config->profile = profile;
+        obj_config->entrypoint = entrypoint;
+    }
 
-        ctx->vtable = psb_vtable;
-        vaStatus = vawr_openDriver(ctx, driver_name);
-        if (VA_STATUS_SUCCESS == vaStatus) {
-            /* We have successfully initialized i965 video driver,
-             * Let's store i965's private driver data and vtable.
-             */
-            vawr->drv_data[PSB_DRV] = (void *)ctx->pDriverData;
-            vawr->drv_vtable[PSB_DRV] = psb_vtable;
-
-            /* Also restore the va's vtable */
-            ctx->vtable = vtable;
-
-            /* TODO: Shall we backup ctx structure? Some members like versions, max_num_profiles
-             * will be overwritten but are they still important? Most likely not.
-             * Let's not do it for now.
-             */
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaCreateConfig, profile, entrypoint, attrib_list, num_attribs, &drv_config_id);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        if (obj_config) {
+            obj_config->drvs = 1u << drv;
+            obj_config->drv_configs[drv] = drv_config_id;
+        }
+        vaStatus = vawr_object_add(vawr, vawr->configs, obj_config ? &obj_config->base : NULL, drv, drv_config_id);
+        if (vaStatus == VA_STATUS_SUCCESS) {
+            __atomic_fetch_add(&vawr->num_configs[drv], 1, __ATOMIC_RELAXED);
+            *config_id = VAWR_ID(drv, drv_config_id);
+        } else {
+            vawr->backends[drv]->vtable.vaDestroyConfig(GET_DRVCTX(vawr, drv), drv_config_id);
         }
-
     }
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaCreateConfig(ctx, profile, entrypoint, attrib_list, num_attribs, config_id));
-    RESTORE_VAWRDATA(ctx, vawr);
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        free(obj_config);
+    }
 
 	return vaStatus;
 }
@@ -288,10 +1233,30 @@ vawr_DestroyConfig(VADriverContextP ctx, VAConfigID config_id)
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_config *obj_config;
+    int drv = VAWR_ID_DRV(config_id);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaDestroyConfig(ctx, config_id));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CHECK_OBJECT(vawr, config, config_id, obj_config, VA_STATUS_ERROR_INVALID_CONFIG);
+
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaDestroyConfig, VAWR_ID_DRV_ID(config_id));
+
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        if (obj_config) {
+            int i;
+
+            /* The configs of the other backends a balanced config was created on */
+            for (i = 0; i < vawr->num_drvs; i++) {
+                if (i == drv || !(obj_config->drvs & (1u << i)))
+                    continue;
+                CALL_DRVVTABLE(vawr, i, vaStatus, vaDestroyConfig, obj_config->drv_configs[i]);
+                __atomic_fetch_sub(&vawr->num_configs[i], 1, __ATOMIC_RELAXED);
+            }
+            vawr_object_remove(vawr, vawr->configs, &obj_config->base);
+            free(obj_config);
+        }
+        __atomic_fetch_sub(&vawr->num_configs[drv], 1, __ATOMIC_RELAXED);
+    }
 
 	return vaStatus;
 }
@@ -303,14 +1268,141 @@ VAStatus vawr_QueryConfigAttributes(VADriverContextP ctx,
                                     VAConfigAttrib *attrib_list,        /* out */
                                     int *num_attribs)                   /* out */
 {
-    VAStatus vaStatus;
-    struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    VAStatus vaStatus;
+    struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_config *obj_config;
+
+    CHECK_OBJECT(vawr, config, config_id, obj_config, VA_STATUS_ERROR_INVALID_CONFIG);
+
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(config_id), vaStatus, vaQueryConfigAttributes, VAWR_ID_DRV_ID(config_id), profile, entrypoint, attrib_list, num_attribs);
+
+	return vaStatus;
+}
+
+/* Allocate surfaces of key's layout on i965 */
+static VAStatus
+vawr_allocSurfaces(struct vawr_driver_data *vawr, const struct surface_pool_key *key,
+                   VASurfaceID *surfaces, int num_surfaces)
+{
+    VAStatus vaStatus;
+
+    if (key->stride) {
+        VASurfaceAttrib surface_attrib[2];
+        VASurfaceAttribExternalBuffers buffer_attrib;
+        unsigned int h_stride = key->stride, v_stride = ALIGN(key->height, 32);
+        int i=0;
+
+        surface_attrib[i].type = VASurfaceAttribMemoryType;
+        surface_attrib[i].flags = VA_SURFACE_ATTRIB_SETTABLE;
+        surface_attrib[i].value.type = VAGenericValueTypeInteger;
+        surface_attrib[i].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_VA;
+        i++;
+
+        memset(&buffer_attrib, 0, sizeof(VASurfaceAttribExternalBuffers));
+        buffer_attrib.pixel_format = VA_FOURCC_NV12;
+        buffer_attrib.width = key->width;
+        buffer_attrib.height= key->height;
+        buffer_attrib.num_planes = 2;
+        buffer_attrib.pitches[0] = h_stride;
+        buffer_attrib.pitches[1] = h_stride;
+        buffer_attrib.offsets[0] = 0;
+        buffer_attrib.offsets[1] = h_stride * v_stride;
+        buffer_attrib.flags = 0; // tiling is diabled by default
+
+        surface_attrib[i].type = VASurfaceAttribExternalBufferDescriptor;
+        surface_attrib[i].flags = VA_SURFACE_ATTRIB_SETTABLE;
+        surface_attrib[i].value.type = VAGenericValueTypePointer;
+        surface_attrib[i].value.value.p = &buffer_attrib;
+        i++;
+
+        CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaCreateSurfaces2, key->format, key->width, key->height, surfaces, num_surfaces, &surface_attrib[0], i);
+        if (vaStatus == VA_STATUS_SUCCESS && vawr->stats) {
+            __atomic_add_fetch(&vawr->shared_surfaces, num_surfaces, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&vawr->padding, (surface_pool_size(key) -
+                               (uint64_t)key->width * key->height * 3 / 2) * num_surfaces,
+                               __ATOMIC_RELAXED);
+        }
+     } else {
+        CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaCreateSurfaces, key->width, key->height, key->format, num_surfaces, surfaces);
+     }
+
+    return vaStatus;
+}
+
+static vawr_surface_lookup_t *
+vawr_newSurfaceLookup(VASurfaceID surface)
+{
+    vawr_surface_lookup_t *surface_lookup;
+    int drv;
+
+    surface_lookup = calloc(1, sizeof(*surface_lookup));
+    if (!surface_lookup)
+        return NULL;
+
+    surface_lookup->i965_surface = surface;
+    for (drv = 0; drv < MAX_NUM_DRV; drv++)
+        surface_lookup->drv_surfaces[drv] = VA_INVALID_SURFACE;
+    surface_lookup->drv = I965_DRV;
+    surface_lookup->writer = I965_DRV;
+    surface_lookup->context_id = VA_INVALID_ID;
+
+    return surface_lookup;
+}
+
+/* Destroy the surfaces of the other backends that share the memory of an
+ * i965 surface, and its record.
+ */
+static VAStatus
+vawr_destroyTwins(struct vawr_driver_data *vawr, vawr_surface_lookup_t *surface)
+{
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    VAStatus drvStatus;
+    int drv;
+
+    for (drv = I965_DRV + 1; drv < vawr->num_drvs; drv++) {
+        if (surface->drv_surfaces[drv] == VA_INVALID_SURFACE)
+            continue;
+        CALL_DRVVTABLE(vawr, drv, drvStatus, vaDestroySurfaces, &surface->drv_surfaces[drv], 1);
+        if (drvStatus != VA_STATUS_SUCCESS)
+            vaStatus = drvStatus;
+    }
+    free(surface);
+
+    return vaStatus;
+}
+
+/* Called by the pool for a surface it drops */
+static void
+vawr_freeSurface(void *data, VASurfaceID surface, void *surface_data)
+{
+    struct vawr_driver_data *vawr = data;
+    VAStatus vaStatus, drvStatus;
+
+    drvStatus = vawr_destroyTwins(vawr, surface_data);
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaDestroySurfaces, &surface, 1);
+    if (vaStatus != VA_STATUS_SUCCESS || drvStatus != VA_STATUS_SUCCESS)
+        vawr_infoMessage("failed to free pooled surface 0x%x\n", surface);
+}
+
+/* Hand a surface the application destroyed to vawr->surface_pool, along
+ * with its twins. It no longer belongs to a context, but the last writer
+ * stays, so the next one to use it still waits for that backend.
+ */
+static void
+vawr_releaseSurface(struct vawr_driver_data *vawr, vawr_surface_lookup_t *surface)
+{
+    struct surface_pool_key key = surface->layout;
+    int drv;
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaQueryConfigAttributes(ctx, config_id, profile, entrypoint, attrib_list, num_attribs));
-    RESTORE_VAWRDATA(ctx, vawr);
+    for (drv = I965_DRV + 1; drv < vawr->num_drvs; drv++) {
+        if (surface->drv_surfaces[drv] != VA_INVALID_SURFACE)
+            key.mapping |= 1u << drv;
+    }
+    surface->drv = I965_DRV;
+    surface->context_id = VA_INVALID_ID;
 
-	return vaStatus;
+    surface_pool_put(vawr->surface_pool, &key, surface_pool_size(&key), surface->i965_surface, surface);
 }
 
 VAStatus
@@ -325,62 +1417,73 @@ vawr_CreateSurfaces(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
-    unsigned int h_stride = 0, v_stride = 0;
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    vawr_surface_lookup_t *surface_lookups[num_surfaces > 0 ? num_surfaces : 1];
+    struct surface_pool_key key;
+    int num_pooled = 0;
+    int drv, i;
 
     /* We will always call i965's vaCreateSurfaces for VA Surface allocation,
-     * then if the config profile is VP8 we will map the surface into TTM
+     * then if the config is routed to another backend we will map the
+     * surface into it
      */
-    ctx->pDriverData = vawr->drv_data[0];
 
-    // XXX, assume we have already got correct profile (vaCreateConfig is called before vaCreateSurface)
-    if (vawr->profile == VAProfileVP8Version0_3) {
-        VASurfaceAttrib surface_attrib[2];
-        VASurfaceAttribExternalBuffers buffer_attrib;
-        int i=0;
+    // XXX, surfaces are not tied to a config, so allocate them with a pitch
+    // every backend with a live config accepts (vaCreateConfig is called
+    // before vaCreateSurface)
+    memset(&key, 0, sizeof(key));
+    key.format = format;
+    key.width = width;
+    key.height = height;
+    for (drv = I965_DRV + 1; drv < vawr->num_drvs; drv++) {
+        if (__atomic_load_n(&vawr->num_configs[drv], __ATOMIC_RELAXED) > 0)
+            key.mapping |= 1u << drv;
+    }
+    /* No pitch suits them all (pvr stops at 4096): leave the layout to i965
+     * and the import to fail at vaCreateContext.
+     */
+    if (key.mapping)
+        key.stride = pitch_table_pick(vawr->pitches, 1u << I965_DRV | key.mapping, width);
+
+    /* Released surfaces of the same layout come back with their twins */
+    if (vawr->surface_pool) {
+        while (num_pooled < num_surfaces &&
+               surface_pool_get(vawr->surface_pool, &key, &surfaces[num_pooled],
+                                (void **)&surface_lookups[num_pooled]))
+            num_pooled++;
+    }
 
-        surface_attrib[i].type = VASurfaceAttribMemoryType;
-        surface_attrib[i].flags = VA_SURFACE_ATTRIB_SETTABLE;
-        surface_attrib[i].value.type = VAGenericValueTypeInteger;
-        surface_attrib[i].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_VA;
-        i++;
+    vaStatus = VA_STATUS_SUCCESS;
+    if (num_pooled < num_surfaces)
+        vaStatus = vawr_allocSurfaces(vawr, &key, surfaces + num_pooled, num_surfaces - num_pooled);
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        for (i = 0; i < num_pooled; i++)
+            vawr_releaseSurface(vawr, surface_lookups[i]);
+        return vaStatus;
+    }
 
-        /* Calculate stride to meet psb requirement */
-        if (512 >= width)
-            h_stride = 512;
-        else if (1024 >= width)
-            h_stride = 1024;
-        else if (1280 >= width)
-            h_stride = 1280;
-        else if (2048 >= width)
-            h_stride = 2048;
-        else if (4096 >= width)
-            h_stride = 4096;
-        else
-            assert(0);
-        v_stride = ALIGN(height, 32);
-        memset(&buffer_attrib, 0, sizeof(VASurfaceAttribExternalBuffers));
-        buffer_attrib.pixel_format = VA_FOURCC_NV12;
-        buffer_attrib.width = width;
-        buffer_attrib.height= height;
-        buffer_attrib.num_planes = 2;
-        buffer_attrib.pitches[0] = h_stride;
-        buffer_attrib.pitches[1] = h_stride;
-        buffer_attrib.offsets[0] = 0;
-        buffer_attrib.offsets[1] = h_stride * v_stride;
-        buffer_attrib.flags = 0; // tiling is diabled by default
+    if (!vawr->surface_pool)
+        return VA_STATUS_SUCCESS;
 
-        surface_attrib[i].type = VASurfaceAttribExternalBufferDescriptor;
-        surface_attrib[i].flags = VA_SURFACE_ATTRIB_SETTABLE;
-        surface_attrib[i].value.type = VAGenericValueTypePointer;
-        surface_attrib[i].value.value.p = &buffer_attrib;
-        i++;
+    /* Keep the layout of every surface, to pool it on vaDestroySurfaces */
+    for (i = num_pooled; i < num_surfaces; i++) {
+        surface_lookups[i] = vawr_newSurfaceLookup(surfaces[i]);
+        if (surface_lookups[i]) {
+            surface_lookups[i]->layout = key;
+            surface_lookups[i]->layout.mapping = 0;
+        }
+    }
 
-        vaStatus = vawr->drv_vtable[0]->vaCreateSurfaces2(ctx, format, width, height, surfaces, num_surfaces, &surface_attrib[0], i);
-     } else {
-        vaStatus = vawr->drv_vtable[0]->vaCreateSurfaces(ctx, width, height, format, num_surfaces, surfaces);
-     }
+    pthread_rwlock_wrlock(&vawr->lock);
+    for (i = 0; i < num_surfaces; i++) {
+        if (surface_lookups[i] &&
+            object_map_insert(&vawr->surfaces, surfaces[i], surface_lookups[i])) {
+            vawr_destroyTwins(vawr, surface_lookups[i]);
+            surface_lookups[i] = NULL;
+        }
+    }
+    pthread_rwlock_unlock(&vawr->lock);
 
-    RESTORE_VAWRDATA(ctx, vawr);
 	return vaStatus;
 }
 
@@ -391,34 +1494,157 @@ vawr_DestroySurfaces(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
-    vawr_surface_lookup_t *surface, *temp;
-    int i;
-
-	if (vawr->profile == VAProfileVP8Version0_3) {
-		/* First destroy the PVR surfaces */
-		for (i=0; i<num_surfaces; i++) {
-			LIST_FOR_EACH_ENTRY_SAFE(surface, temp, &vawr->surfaces, link) {
-				if (surface->i965_surface == surface_list[i]) {
-					/* Restore the PVR's context for DestroySurfaces purpose */
-					ctx->pDriverData = vawr->drv_data[1];
-					vaStatus = vawr->drv_vtable[1]->vaDestroySurfaces(ctx, &surface->pvr_surface, 1);
-					surface->i965_surface = 0;
-					surface->pvr_surface = 0;
-					LIST_DEL(&surface->link);
-				}
-			}
-
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    VASurfaceID i965_surfaces[num_surfaces > 0 ? num_surfaces : 1];
+    vawr_surface_lookup_t *surface;
+    int i, num_i965_surfaces = 0;
+
+	/* First pool the surfaces or destroy the surfaces of the other backends */
+	for (i=0; i<num_surfaces; i++) {
+		vawr_waitSurface(vawr, surface_list[i], 0);
+		vawr_forgetSurface(vawr, surface_list[i]);
+		if (vawr->surface_states)
+			surface_state_forget(vawr->surface_states, surface_list[i]);
+		surface = vawr_remove(vawr, &vawr->surfaces, surface_list[i]);
+		if (surface && vawr->surface_pool && surface->layout.width) {
+			vawr_releaseSurface(vawr, surface);
+			continue;
 		}
+		if (surface)
+			vawr_destroyTwins(vawr, surface);
+		i965_surfaces[num_i965_surfaces++] = surface_list[i];
 	}
 
 	/* Now destroy the i965 surfaces */
-    ctx->pDriverData = vawr->drv_data[0];
-	vaStatus = vawr->drv_vtable[0]->vaDestroySurfaces(ctx, surface_list, num_surfaces);
-    RESTORE_VAWRDATA(ctx, vawr);
+	vaStatus = VA_STATUS_SUCCESS;
+	if (num_i965_surfaces)
+		CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaDestroySurfaces, i965_surfaces, num_i965_surfaces);
 
 	return vaStatus;
 }
 
+/* Import the memory behind image, a derived image of an i965 surface, into
+ * drv as a new surface. PRIME hands drv a dma-buf fd of the surface's buffer
+ * object, so neither driver needs a CPU mapping of it. USER_PTR maps the
+ * buffer through i965 and lets drv pin the pages behind that mapping.
+ */
+static VAStatus
+vawr_importSurface(struct vawr_driver_data *vawr,
+                   int drv,
+                   VAImage *image,
+                   unsigned int mem_type,
+                   unsigned long buffer,
+                   VASurfaceID *drv_surface)
+{
+    VAStatus vaStatus;
+    VASurfaceAttrib attrib_list[2];
+    VASurfaceAttribExternalBuffers buffer_descriptor;
+
+    memset(&buffer_descriptor, 0, sizeof(buffer_descriptor));
+    buffer_descriptor.pixel_format = image->format.fourcc;
+    buffer_descriptor.width = image->width;
+    buffer_descriptor.height = image->height;
+    buffer_descriptor.data_size = image->data_size;
+    buffer_descriptor.num_planes = image->num_planes;
+    buffer_descriptor.pitches[0] = image->pitches[0];
+    buffer_descriptor.pitches[1] = image->pitches[1];
+    buffer_descriptor.pitches[2] = image->pitches[1];
+    buffer_descriptor.offsets[0] = image->offsets[0];
+    buffer_descriptor.offsets[1] = image->offsets[1];
+    buffer_descriptor.offsets[2] = image->offsets[1];
+    buffer_descriptor.buffers = &buffer;
+    buffer_descriptor.num_buffers = 1;
+
+    memset(attrib_list, 0, sizeof(attrib_list));
+    attrib_list[0].type = VASurfaceAttribExternalBufferDescriptor;
+    attrib_list[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib_list[0].value.type = VAGenericValueTypePointer;
+    attrib_list[0].value.value.p = &buffer_descriptor;
+
+    attrib_list[1].type = VASurfaceAttribMemoryType;
+    attrib_list[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib_list[1].value.type = VAGenericValueTypeInteger;
+    attrib_list[1].value.value.i = mem_type;
+
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaCreateSurfaces2, VA_RT_FORMAT_YUV420, image->width,
+                   ALIGN(image->height, 32), drv_surface, 1, attrib_list, 2);
+
+    return vaStatus;
+}
+
+static VAStatus
+vawr_shareSurfacePrime(struct vawr_driver_data *vawr, int drv, VAImage *image, VASurfaceID *drv_surface)
+{
+    VAStatus vaStatus;
+    VABufferInfo buf_info;
+
+    if (!vawr->backends[I965_DRV]->vtable.vaAcquireBufferHandle)
+        return VA_STATUS_ERROR_UNIMPLEMENTED;
+
+    memset(&buf_info, 0, sizeof(buf_info));
+    buf_info.mem_type = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME;
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaAcquireBufferHandle, image->buf, &buf_info);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        return vaStatus;
+
+    /* drv takes its own reference on the dma-buf, so the fd only has to
+     * stay valid until the import is done.
+     */
+    vaStatus = vawr_importSurface(vawr, drv, image, VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME,
+                                  buf_info.handle, drv_surface);
+
+    vawr->backends[I965_DRV]->vtable.vaReleaseBufferHandle(GET_DRVCTX(vawr, I965_DRV), image->buf);
+
+    return vaStatus;
+}
+
+static VAStatus
+vawr_shareSurfaceUserPtr(struct vawr_driver_data *vawr, int drv, VAImage *image, VASurfaceID *drv_surface)
+{
+    VAStatus vaStatus;
+    void *user_pointer = NULL;
+
+    /* Call i965's vaMapBuffer to retrieve the user accessible pointer to the surface */
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaMapBuffer, image->buf, &user_pointer);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        return vaStatus;
+
+    vaStatus = vawr_importSurface(vawr, drv, image, VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR,
+                                  (unsigned long)user_pointer, drv_surface);
+
+    /* Unmap the surface buffer */
+    vawr->backends[I965_DRV]->vtable.vaUnmapBuffer(GET_DRVCTX(vawr, I965_DRV), image->buf);
+
+    return vaStatus;
+}
+
+/* Create a surface of drv that aliases the memory of the i965 surface */
+static VAStatus
+vawr_shareSurface(struct vawr_driver_data *vawr, int drv, VASurfaceID surface, VASurfaceID *drv_surface)
+{
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, surface);
+    VAStatus vaStatus;
+    VAImage image;
+
+    if (!vawr->backends[drv]->vtable.vaCreateSurfaces2)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    /* Call vaDeriveImage of i965 to create a VAImage of corresponding VASurface */
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaDeriveImage, surface, &image);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        return vaStatus;
+
+    vaStatus = VA_STATUS_ERROR_UNIMPLEMENTED;
+    if (vawr->surface_sharing != VAWR_SHARING_USERPTR)
+        vaStatus = vawr_shareSurfacePrime(vawr, drv, &image, drv_surface);
+    if (vaStatus != VA_STATUS_SUCCESS && vawr->surface_sharing != VAWR_SHARING_PRIME)
+        vaStatus = vawr_shareSurfaceUserPtr(vawr, drv, &image, drv_surface);
+
+    vawr->backends[I965_DRV]->vtable.vaDestroyImage(GET_DRVCTX(vawr, I965_DRV), image.image_id);
+
+    return vaStatus;
+}
+
 VAStatus
 vawr_CreateContext(VADriverContextP ctx,
                    VAConfigID config_id,
@@ -430,107 +1656,126 @@ vawr_CreateContext(VADriverContextP ctx,
                    VAContextID *context)                /* out */
 {
     VAStatus vaStatus;
-    VASurfaceID vawr_render_targets[num_render_targets];
+    VASurfaceID vawr_render_targets[num_render_targets > 0 ? num_render_targets : 1];
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_config *obj_config;
+    struct vawr_context *obj_context = NULL;
+    VAContextID drv_context;
+    VAConfigID drv_config = VAWR_ID_DRV_ID(config_id);
+    int drv = VAWR_ID_DRV(config_id);
     int i;
 
-    /* If config profile is VP8, we have to map the render targets into pvr driver's TTM
-     * Since config_id is opague to wrapper (at least for now), we can only check vawr->profile
-     */
-	if (vawr->profile == VAProfileVP8Version0_3) {
+    CHECK_OBJECT(vawr, config, config_id, obj_config, VA_STATUS_ERROR_INVALID_CONFIG);
+
+    if (obj_config && (obj_config->drvs & (obj_config->drvs - 1))) {
+        drv = vawr_pickBackend(vawr, obj_config->drvs);
+        drv_config = obj_config->drv_configs[drv];
+    }
+
+    /* If the config is routed to another backend, we have to map the render targets into it */
+	if (drv != I965_DRV) {
 		vawr_surface_lookup_t *surface;
-		LIST_INIT(&vawr->surfaces);
 
 		for (i=0; i<num_render_targets; i++) {
-		    VAImage	image;
-
-			/* Call vaDeriveImage of i965 to create a VAImage of corresponding VASurface */
-			ctx->pDriverData = vawr->drv_data[0];
-
-			vaStatus = vawr->drv_vtable[0]->vaDeriveImage(ctx, render_targets[i], &image);
-			if (vaStatus == VA_STATUS_SUCCESS) {
-			    unsigned long long *user_pointer = NULL;
-
-			    /* VAImage has been created successfully, now call i965's vaMapBuffer to
-			     * retrieve the user accessible pointer to the surface
-			     */
-				vaStatus = vawr->drv_vtable[0]->vaMapBuffer(ctx, image.buf, (void **) &user_pointer);
-				vawr_errorMessage("CreateContext: user ptr: %p:, addr: %p\n", user_pointer, &user_pointer);
-				if (vaStatus == VA_STATUS_SUCCESS) {
-					/* TODO: We have to pass the user pointer to pvr's vaCreateSurfaces2
-					 * to map this VASurface into pvr's TTM
-					 */
-					vaStatus = VA_STATUS_ERROR_OPERATION_FAILED;
-					if (vawr->drv_vtable[1]->vaCreateSurfaces2) {
-						VASurfaceID	surface_id;
-						VASurfaceAttrib attrib_list[2] = {};
-						VASurfaceAttribExternalBuffers *buffer_descriptor = NULL;
-
-						buffer_descriptor = calloc(1, sizeof(*buffer_descriptor));
-						if (!buffer_descriptor) {
-							return VA_STATUS_ERROR_ALLOCATION_FAILED;
-						}
-
-						buffer_descriptor->num_buffers = 1;
-						buffer_descriptor->width = image.width;
-						buffer_descriptor->height = image.height;
-						//buffer_descriptor->pixel_format = image.format.fourcc; /* format will be used instead of pixel_format */
-						//buffer_descriptor->data_size =
-						buffer_descriptor->pitches[0] = image.pitches[0];
-						buffer_descriptor->pitches[1] = image.pitches[1];
-						buffer_descriptor->pitches[2] = image.pitches[1];
-						buffer_descriptor->offsets[0] = image.offsets[0];
-						buffer_descriptor->offsets[1] = image.offsets[1];
-						buffer_descriptor->offsets[2] = image.offsets[1];
-						buffer_descriptor->buffers = (unsigned long long *)&user_pointer;
-
-						ctx->pDriverData = vawr->drv_data[1];
-
-						attrib_list[0].type = VASurfaceAttribExternalBufferDescriptor;
-						attrib_list[0].value.value.p = buffer_descriptor;
-
-						attrib_list[1].type = VASurfaceAttribMemoryType;
-						attrib_list[1].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
-
-						vaStatus = vawr->drv_vtable[1]->vaCreateSurfaces2(ctx, VA_RT_FORMAT_YUV420, image.width,
-										((image.height + 32 - 1) & ~(32 - 1)), &surface_id, 1, &attrib_list[0], 2);
-						if (vaStatus == VA_STATUS_SUCCESS){
-							/* Find a way to store the returned surface_id with correct mapping of i965's surface_id,
-							 * since all future surface_id communicated between application and wrappre is i965's
-							 * while one communicated between wrapper and pvr driver is pvr's.
-							 */
-							surface = calloc(1, sizeof *surface);
-							if (!surface) {
-								return VA_STATUS_ERROR_ALLOCATION_FAILED;
-							}
-
-							surface->i965_surface = render_targets[i];
-							surface->pvr_surface = surface_id;
-							LIST_ADD(&surface->link,&vawr->surfaces);
-
-							/* render_targets is pvr's surface_id from here on */
-							vawr_render_targets[i] = surface_id;
-							/* Free allocated memory */
-							free(buffer_descriptor);
-						}
-					}
-				}
+			VASurfaceID surface_id;
+
+			/* A surface keeps its twin in drv until vaDestroySurfaces, so
+			 * contexts re-created on a seek or a rendition switch reuse it.
+			 */
+			surface = vawr_lookup(vawr, &vawr->surfaces, render_targets[i]);
+			if (surface && surface->drv_surfaces[drv] != VA_INVALID_SURFACE) {
+				vawr_render_targets[i] = surface->drv_surfaces[drv];
+				continue;
+			}
+
+			vaStatus = vawr_shareSurface(vawr, drv, render_targets[i], &surface_id);
+			if (vaStatus != VA_STATUS_SUCCESS)
+				return vaStatus;
+
+			/* Find a way to store the returned surface_id with correct mapping of i965's surface_id,
+			 * since all future surface_id communicated between application and wrappre is i965's
+			 * while one communicated between wrapper and drv is drv's.
+			 */
+			pthread_rwlock_wrlock(&vawr->lock);
+			surface = object_map_lookup(&vawr->surfaces, render_targets[i]);
+			if (surface && surface->drv_surfaces[drv] != VA_INVALID_SURFACE) {
+				/* Another thread shared the same surface in the meantime */
+				pthread_rwlock_unlock(&vawr->lock);
+				vawr->backends[drv]->vtable.vaDestroySurfaces(GET_DRVCTX(vawr, drv), &surface_id, 1);
+				vawr_render_targets[i] = surface->drv_surfaces[drv];
+				continue;
+			}
 
-				/* Unmap the surface buffer */
-				ctx->pDriverData = vawr->drv_data[0];
-				vaStatus = vawr->drv_vtable[0]->vaUnmapBuffer(ctx, image.buf);
+			if (!surface) {
+				surface = vawr_newSurfaceLookup(render_targets[i]);
+				if (!surface || object_map_insert(&vawr->surfaces, render_targets[i], surface)) {
+					pthread_rwlock_unlock(&vawr->lock);
+					free(surface);
+					vawr->backends[drv]->vtable.vaDestroySurfaces(GET_DRVCTX(vawr, drv), &surface_id, 1);
+					return VA_STATUS_ERROR_ALLOCATION_FAILED;
+				}
+				surface->drv = drv;
 			}
+			surface->drv_surfaces[drv] = surface_id;
+			pthread_rwlock_unlock(&vawr->lock);
+
+			/* render_targets is drv's surface_id from here on */
+			vawr_render_targets[i] = surface_id;
 		}
+	} else {
+		for (i=0; i<num_render_targets; i++)
+			vawr_render_targets[i] = render_targets[i];
 	}
 
-	RESTORE_DRVDATA(ctx, vawr);
-    if (vawr->profile == VAProfileVP8Version0_3) {
-        CALL_DRVVTABLE(vawr, vaStatus, vaCreateContext(ctx, config_id, picture_width, picture_height, flag, vawr_render_targets, num_render_targets, context));
-    } else {
-        CALL_DRVVTABLE(vawr, vaStatus, vaCreateContext(ctx, config_id, picture_width, picture_height, flag, render_targets, num_render_targets, context));
+    if (obj_config || vawr->async) {
+        obj_context = calloc(1, sizeof(*obj_context));
+        if (!obj_context)
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        obj_context->config_id = config_id;
+        obj_context->profile = obj_config ? obj_config->profile : VAProfileNone;
+        obj_context->vawr = vawr;
+    }
+
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaCreateContext, drv_config, picture_width, picture_height, flag, vawr_render_targets, num_render_targets, &drv_context);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        vaStatus = vawr_object_add(vawr, vawr->contexts, obj_context ? &obj_context->base : NULL, drv, drv_context);
+        if (vaStatus == VA_STATUS_SUCCESS) {
+            *context = VAWR_ID(drv, drv_context);
+            if (obj_context)
+                __atomic_fetch_add(&vawr->load[drv].contexts, 1, __ATOMIC_RELAXED);
+            if (vawr->async) {
+                obj_context->queue = submit_queue_create(vawr_submit, obj_context, &vawr->submit_clock);
+                if (obj_context->queue) {
+                    pthread_rwlock_wrlock(&vawr->queues_lock);
+                    LIST_ADD(&obj_context->link, &vawr->queues);
+                    pthread_rwlock_unlock(&vawr->queues_lock);
+                } else {
+                    vawr_infoMessage("failed to start the submit thread of context 0x%x, its calls are made right away\n", *context);
+                }
+            }
+        } else {
+            vawr->backends[drv]->vtable.vaDestroyContext(GET_DRVCTX(vawr, drv), drv_context);
+        }
     }
 
-    RESTORE_VAWRDATA(ctx, vawr);
+
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        free(obj_context);
+    } else if (drv != I965_DRV || obj_context) {
+        vawr_surface_lookup_t *surface;
+
+        /* The mapped render targets are owned by the new context, render
+         * targets an i965 context was placed on go back to i965.
+         */
+        for (i = 0; i < num_render_targets; i++) {
+            surface = vawr_lookup(vawr, &vawr->surfaces, render_targets[i]);
+            if (surface) {
+                surface->context_id = *context;
+                __atomic_store_n(&surface->drv, drv, __ATOMIC_RELAXED);
+            }
+        }
+    }
 
 	return vaStatus;
 }
@@ -540,14 +1785,59 @@ vawr_DestroyContext(VADriverContextP ctx, VAContextID context)
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, context, VA_INVALID_ID);
+    struct vawr_context *obj_context;
+
+    CHECK_OBJECT(vawr, context, context, obj_context, VA_STATUS_ERROR_INVALID_CONTEXT);
+    if (!obj_context && (vawr->async || __atomic_load_n(&vawr->balanced, __ATOMIC_RELAXED)))
+        obj_context = GET_OBJECT(vawr, context, context);
+
+    if (obj_context && obj_context->queue)
+        vawr_stopQueue(vawr, obj_context);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaDestroyContext(ctx, context));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(context), vaStatus, vaDestroyContext, VAWR_ID_DRV_ID(context));
+
+    if (vaStatus == VA_STATUS_SUCCESS && obj_context) {
+        __atomic_fetch_sub(&vawr->load[obj_context->base.drv].contexts, 1, __ATOMIC_RELAXED);
+        vawr_object_remove(vawr, vawr->contexts, &obj_context->base);
+        free(obj_context);
+    }
 
 	return vaStatus;
 }
 
+/* The other backends only know their own surface IDs, so the i965 IDs in
+ * the parameter buffers of their contexts have to be swapped for theirs
+ * before they see them. Which fields hold surface IDs is described per codec
+ * in param_buffer.c.
+ */
+struct vawr_translation
+{
+    struct vawr_driver_data *vawr;
+    int drv;
+};
+
+static VASurfaceID
+vawr_translateSurface(void *data, VASurfaceID surface)
+{
+    struct vawr_translation *translation = data;
+    vawr_surface_lookup_t *surface_lookup;
+    VASurfaceID surface_out;
+
+    GET_SURFACEID(translation->vawr, translation->drv, surface_lookup, surface, surface_out);
+
+    return surface_out;
+}
+
+static void
+vawr_translateBuffer(struct vawr_driver_data *vawr, struct vawr_buffer *obj_buffer, void *data)
+{
+    struct vawr_translation translation = { vawr, obj_buffer->base.drv };
+
+    param_buffer_translate(obj_buffer->desc, data, obj_buffer->size, obj_buffer->num_elements,
+                           vawr_translateSurface, &translation);
+}
+
 VAStatus
 vawr_CreateBuffer(VADriverContextP ctx,
                   VAContextID context,          /* in */
@@ -559,20 +1849,59 @@ vawr_CreateBuffer(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, context, VA_INVALID_ID);
+    struct vawr_context *obj_context;
+    struct vawr_buffer *obj_buffer = NULL;
+    void *translated = NULL;
+    VABufferID drv_buf_id;
+    int drv = VAWR_ID_DRV(context);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaCreateBuffer(ctx, context, type, size, num_elements, data, buf_id));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CHECK_OBJECT(vawr, context, context, obj_context, VA_STATUS_ERROR_INVALID_CONTEXT);
 
-    /* For now, let's track the VP8's VAPictureParameterBufferType buf_id so that we can overwrite the
-     * i965's VASurfaceID embedded in the picture parameter with pvr's. This is a dirty hack until we
-     * find a better way to deal with surface_id.
+    /* i965 buffers get a record only to find the surfaces of a pipeline,
+     * see vawr_fenceInputs
      */
-	if (vawr->profile == VAProfileVP8Version0_3) {
-		if (type == VAPictureParameterBufferType) {
-			vawr->pic_param_buf_id = *buf_id;
-		}
-	}
+    if (obj_context || type == VAProcPipelineParameterBufferType) {
+        obj_buffer = calloc(1, sizeof(*obj_buffer));
+        if (!obj_buffer)
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+        obj_buffer->base.drv = drv;	/* for vawr_translateBuffer */
+        obj_buffer->context_id = context;
+        obj_buffer->type = type;
+        obj_buffer->size = size;
+        obj_buffer->num_elements = num_elements;
+        obj_buffer->desc = param_buffer_lookup(obj_context ? obj_context->profile : VAProfileNone, type);
+    }
+
+    /* Translate the surface IDs on a copy of the caller's data, so no
+     * extra map of the backend buffer is needed before rendering.
+     */
+    if (obj_buffer && obj_buffer->desc && data && drv != I965_DRV) {
+        translated = malloc((size_t)size * num_elements);
+        if (!translated) {
+            free(obj_buffer);
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        memcpy(translated, data, (size_t)size * num_elements);
+        vawr_translateBuffer(vawr, obj_buffer, translated);
+        data = translated;
+    }
+
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaCreateBuffer, VAWR_ID_DRV_ID(context), type, size, num_elements, data, &drv_buf_id);
+    free(translated);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        vaStatus = vawr_object_add(vawr, vawr->buffers, obj_buffer ? &obj_buffer->base : NULL, drv, drv_buf_id);
+        if (vaStatus == VA_STATUS_SUCCESS) {
+            *buf_id = VAWR_ID(drv, drv_buf_id);
+        } else {
+            vawr->backends[drv]->vtable.vaDestroyBuffer(GET_DRVCTX(vawr, drv), drv_buf_id);
+        }
+    }
+
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        free(obj_buffer);
+    }
 
 	return vaStatus;
 }
@@ -584,10 +1913,18 @@ vawr_BufferSetNumElements(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_buffer *obj_buffer;
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaBufferSetNumElements(ctx, buf_id, num_elements));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CHECK_OBJECT(vawr, buffer, buf_id, obj_buffer, VA_STATUS_ERROR_INVALID_BUFFER);
+    if (!obj_buffer)
+        obj_buffer = GET_OBJECT(vawr, buffer, buf_id);
+
+    vawr_waitBuffer(vawr, buf_id);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(buf_id), vaStatus, vaBufferSetNumElements, VAWR_ID_DRV_ID(buf_id), num_elements);
+    if (vaStatus == VA_STATUS_SUCCESS && obj_buffer) {
+        obj_buffer->num_elements = num_elements;
+    }
 
 	return vaStatus;
 }
@@ -601,10 +1938,12 @@ vawr_BufferInfo(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_buffer *obj_buffer;
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaBufferInfo(ctx, buf_id, type, size, num_elements));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CHECK_OBJECT(vawr, buffer, buf_id, obj_buffer, VA_STATUS_ERROR_INVALID_BUFFER);
+
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(buf_id), vaStatus, vaBufferInfo, VAWR_ID_DRV_ID(buf_id), type, size, num_elements);
 
     return vaStatus;
 }
@@ -616,10 +1955,20 @@ vawr_MapBuffer(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_buffer *obj_buffer;
+
+    CHECK_OBJECT(vawr, buffer, buf_id, obj_buffer, VA_STATUS_ERROR_INVALID_BUFFER);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaMapBuffer(ctx, buf_id, pbuf));
-    RESTORE_VAWRDATA(ctx, vawr);
+    vawr_waitBuffer(vawr, buf_id);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(buf_id), vaStatus, vaMapBuffer, VAWR_ID_DRV_ID(buf_id), pbuf);
+
+    /* Applications that fill the parameters in place get them translated
+     * when they unmap them, through the pointer they have been writing to.
+     */
+    if (vaStatus == VA_STATUS_SUCCESS && obj_buffer && obj_buffer->desc) {
+        obj_buffer->mapped = *pbuf;
+    }
 
 	return vaStatus;
 }
@@ -629,10 +1978,17 @@ vawr_UnmapBuffer(VADriverContextP ctx, VABufferID buf_id)
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_buffer *obj_buffer;
+
+    CHECK_OBJECT(vawr, buffer, buf_id, obj_buffer, VA_STATUS_ERROR_INVALID_BUFFER);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaUnmapBuffer(ctx, buf_id));
-    RESTORE_VAWRDATA(ctx, vawr);
+    if (obj_buffer && obj_buffer->mapped) {
+        vawr_translateBuffer(vawr, obj_buffer, obj_buffer->mapped);
+        obj_buffer->mapped = NULL;
+    }
+
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(buf_id), vaStatus, vaUnmapBuffer, VAWR_ID_DRV_ID(buf_id));
 
 	return vaStatus;
 }
@@ -642,10 +1998,21 @@ vawr_DestroyBuffer(VADriverContextP ctx, VABufferID buffer_id)
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_buffer *obj_buffer;
+
+    CHECK_OBJECT(vawr, buffer, buffer_id, obj_buffer, VA_STATUS_ERROR_INVALID_BUFFER);
+    /* Some i965 buffers have a record too, see vawr_CreateBuffer */
+    if (!obj_buffer)
+        obj_buffer = GET_OBJECT(vawr, buffer, buffer_id);
+
+    vawr_waitBuffer(vawr, buffer_id);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(buffer_id), vaStatus, vaDestroyBuffer, VAWR_ID_DRV_ID(buffer_id));
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaDestroyBuffer(ctx, buffer_id));
-    RESTORE_VAWRDATA(ctx, vawr);
+    if (vaStatus == VA_STATUS_SUCCESS && obj_buffer) {
+        vawr_object_remove(vawr, vawr->buffers, &obj_buffer->base);
+        free(obj_buffer);
+    }
 
 	return vaStatus;
 }
@@ -657,14 +2024,35 @@ vawr_BeginPicture(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, context, render_target);
+    struct vawr_context *obj_context;
     VASurfaceID vawr_render_target;
     vawr_surface_lookup_t *surface_lookup;
+    int drv = VAWR_ID_DRV(context);
+
+    CHECK_OBJECT(vawr, context, context, obj_context, VA_STATUS_ERROR_INVALID_CONTEXT);
 
-    GET_SURFACEID(vawr, surface_lookup, render_target, vawr_render_target);
+    /* The record serves both the twin in drv and vawr_fenceSurface */
+    surface_lookup = vawr_lookup(vawr, &vawr->surfaces, render_target);
+    if (drv != I965_DRV && surface_lookup &&
+        surface_lookup->drv_surfaces[drv] != VA_INVALID_SURFACE)
+        vawr_render_target = surface_lookup->drv_surfaces[drv];
+    else
+        vawr_render_target = render_target;
     //vawr_infoMessage("vawr_BeginPicture: render_target %d\n", render_target);
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaBeginPicture(ctx, context, vawr_render_target));
-    RESTORE_VAWRDATA(ctx, vawr);
+    if ((obj_context = vawr_queuedContext(vawr, context, obj_context))) {
+        struct submit_op op = {
+            .type = SUBMIT_BEGIN_PICTURE,
+            .render_target = render_target,
+            .drv_render_target = vawr_render_target,
+        };
+
+        return submit_queue_push(obj_context->queue, &op);
+    }
+    vawr_fenceSurface(vawr, surface_lookup, render_target, drv, 1);
+    if (vawr->surface_states)
+        surface_state_begin(vawr->surface_states, context, render_target);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaBeginPicture, VAWR_ID_DRV_ID(context), vawr_render_target);
 
 	return vaStatus;
 }
@@ -677,34 +2065,42 @@ vawr_RenderPicture(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
-    VAPictureParameterBufferVP8 * const pic_param;
+    TRACE_SCOPE(vawr->trace, context, VA_INVALID_ID);
+    struct vawr_context *obj_context;
+    VABufferID vawr_buffers[num_buffers > 0 ? num_buffers : 1];
+    int drv = VAWR_ID_DRV(context);
+    int i;
+
+    CHECK_OBJECT(vawr, context, context, obj_context, VA_STATUS_ERROR_INVALID_CONTEXT);
+
+    /* The queue copies num_buffers IDs */
+    if (num_buffers < 0)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
 
-    RESTORE_DRVDATA(ctx, vawr);
+    for (i = 0; i < num_buffers; i++) {
+        if (VAWR_ID_DRV(buffers[i]) != drv ||
+            (drv != I965_DRV && !GET_OBJECT(vawr, buffer, buffers[i])))
+            return VA_STATUS_ERROR_INVALID_BUFFER;
+        vawr_buffers[i] = VAWR_ID_DRV_ID(buffers[i]);
+    }
 
-    /* For now, let's track the VP8's VAPictureParameterBufferType buf_id so that we can overwrite the
-     * i965's VASurfaceID embedded in the picture parameter with pvr's. This is a dirty hack until we
-     * find a better way to deal with surface_id.
+    /* Surface IDs in the parameter buffers have already been translated to
+     * drv's by vawr_CreateBuffer or vawr_UnmapBuffer, so nothing needs to be
+     * mapped here.
      */
-	if (vawr->profile == VAProfileVP8Version0_3) {
-	    if (vawr->pic_param_buf_id) {
-	        vawr_surface_lookup_t *surface_lookup;
-
-		CALL_DRVVTABLE(vawr, vaStatus, vaMapBuffer(ctx, vawr->pic_param_buf_id, (void **)&pic_param));
-		/* Ok we have the picture parameter, let's translate parameters with surface_id */
-			LIST_FOR_EACH_ENTRY(surface_lookup, &vawr->surfaces, link) {
-					if (surface_lookup->i965_surface == pic_param->last_ref_frame)
-						pic_param->last_ref_frame = surface_lookup->pvr_surface;
-					if (surface_lookup->i965_surface == pic_param->golden_ref_frame)
-						pic_param->golden_ref_frame = surface_lookup->pvr_surface;
-					if (surface_lookup->i965_surface == pic_param->alt_ref_frame)
-						pic_param->alt_ref_frame = surface_lookup->pvr_surface;
-			}
-		CALL_DRVVTABLE(vawr, vaStatus, vaUnmapBuffer(ctx, vawr->pic_param_buf_id));
-		vawr->pic_param_buf_id = 0;
-	    }
-	}
-    CALL_DRVVTABLE(vawr, vaStatus, vaRenderPicture(ctx, context, buffers, num_buffers));
-    RESTORE_VAWRDATA(ctx, vawr);
+    if ((obj_context = vawr_queuedContext(vawr, context, obj_context))) {
+        struct submit_op op = {
+            .type = SUBMIT_RENDER_PICTURE,
+            .num_buffers = num_buffers,
+            .buffers = buffers,
+            .drv_buffers = vawr_buffers,
+        };
+
+        return submit_queue_push(obj_context->queue, &op);
+    }
+    if (drv == I965_DRV)
+        vawr_fenceInputs(vawr, NULL, vawr_buffers, num_buffers, 0);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaRenderPicture, VAWR_ID_DRV_ID(context), vawr_buffers, num_buffers);
 
 	return vaStatus;
 }
@@ -714,10 +2110,26 @@ vawr_EndPicture(VADriverContextP ctx, VAContextID context)
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, context, VA_INVALID_ID);
+    struct vawr_context *obj_context;
+    uint64_t start = VAWR_LOAD_START(vawr);
+
+    CHECK_OBJECT(vawr, context, context, obj_context, VA_STATUS_ERROR_INVALID_CONTEXT);
+
+    /* Returns as soon as it is queued, the fence it leaves on the render
+     * target is waited for by vawr_SyncSurface
+     */
+    if ((obj_context = vawr_queuedContext(vawr, context, obj_context))) {
+        struct submit_op op = { .type = SUBMIT_END_PICTURE };
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaEndPicture(ctx, context));
-    RESTORE_VAWRDATA(ctx, vawr);
+        return submit_queue_push(obj_context->queue, &op);
+    }
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(context), vaStatus, vaEndPicture, VAWR_ID_DRV_ID(context));
+    if (vaStatus == VA_STATUS_SUCCESS && vawr->surface_states)
+        surface_state_end(vawr->surface_states, context);
+    if (start) {
+        vawr_recordLoad(vawr, VAWR_ID_DRV(context), start, 1);
+    }
 
 	return vaStatus;
 }
@@ -728,13 +2140,30 @@ vawr_SyncSurface(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, render_target);
     VASurfaceID vawr_render_target;
     vawr_surface_lookup_t *surface_lookup;
+    uint64_t start = VAWR_LOAD_START(vawr);
+    uint64_t token = 0;
+    int drv;
+
+    vaStatus = vawr_waitSurface(vawr, render_target, 1);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        return vaStatus;
 
-    GET_SURFACEID(vawr, surface_lookup, render_target, vawr_render_target);
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaSyncSurface(ctx, vawr_render_target));
-    RESTORE_VAWRDATA(ctx, vawr);
+    /* Nothing to wait for on a surface known to be done */
+    if (vawr->surface_states &&
+        surface_state_get(vawr->surface_states, render_target, &token) == SURFACE_STATE_COMPLETE)
+        return VA_STATUS_SUCCESS;
+
+    drv = vawr_surface_writer(vawr, render_target);
+    GET_SURFACEID(vawr, drv, surface_lookup, render_target, vawr_render_target);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaSyncSurface, vawr_render_target);
+    if (vaStatus == VA_STATUS_SUCCESS && vawr->surface_states)
+        surface_state_complete(vawr->surface_states, render_target, token);
+    if (start) {
+        vawr_recordLoad(vawr, drv, start, 0);
+    }
 
 	return vaStatus;
 }
@@ -746,13 +2175,30 @@ vawr_QuerySurfaceStatus(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, render_target);
     VASurfaceID vawr_render_target;
     vawr_surface_lookup_t *surface_lookup;
+    uint64_t token = 0;
+    int drv;
+
+    /* A picture still queued has not even reached the backend */
+    if (vawr_surfacePending(vawr, render_target)) {
+        *status = VASurfaceRendering;
+        return VA_STATUS_SUCCESS;
+    }
+
+    if (vawr->surface_states &&
+        surface_state_get(vawr->surface_states, render_target, &token) == SURFACE_STATE_COMPLETE) {
+        *status = VASurfaceReady;
+        return VA_STATUS_SUCCESS;
+    }
 
-    GET_SURFACEID(vawr, surface_lookup, render_target, vawr_render_target);
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaQuerySurfaceStatus(ctx, vawr_render_target, status));
-    RESTORE_VAWRDATA(ctx, vawr);
+    drv = vawr_surface_writer(vawr, render_target);
+    GET_SURFACEID(vawr, drv, surface_lookup, render_target, vawr_render_target);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaQuerySurfaceStatus, vawr_render_target, status);
+    if (vaStatus == VA_STATUS_SUCCESS && *status == VASurfaceReady && vawr->surface_states) {
+        surface_state_complete(vawr->surface_states, render_target, token);
+    }
 
 	return vaStatus;
 }
@@ -775,14 +2221,13 @@ vawr_PutSurface(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
-    //VASurfaceID vawr_render_target;
-    //vawr_surface_lookup_t *surface_lookup;
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, render_target);
+
+	vawr_waitSurface(vawr, render_target, 0);
+	vawr_fenceSurface(vawr, vawr_lookup(vawr, &vawr->surfaces, render_target), render_target, I965_DRV, 0);
 
-    //GET_SURFACEID(vawr, surface_lookup, render_target, vawr_render_target);
 	/* Rendering should always be done via i965 */
-	ctx->pDriverData = vawr->drv_data[0];
-	vaStatus = vawr->drv_vtable[0]->vaPutSurface(ctx, render_target, draw, srcx, srcy, srcw, srch, destx, desty, destw, desth, cliprects, number_cliprects, flags);
-    RESTORE_VAWRDATA(ctx, vawr);
+	CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaPutSurface, render_target, draw, srcx, srcy, srcw, srch, destx, desty, destw, desth, cliprects, number_cliprects, flags);
 
 	return vaStatus;
 }
@@ -794,10 +2239,9 @@ vawr_QueryImageFormats(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaQueryImageFormats(ctx, format_list, num_formats));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaQueryImageFormats, format_list, num_formats);
 
 	return vaStatus;
 }
@@ -811,10 +2255,15 @@ vawr_CreateImage(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
-
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaCreateImage(ctx, format, width, height, out_image));
-    RESTORE_VAWRDATA(ctx, vawr);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+
+    /* Images are not tied to a context, i965 can read and write every surface */
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaCreateImage, format, width, height, out_image);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        vaStatus = vawr_image_add(vawr, I965_DRV, out_image);
+        if (vaStatus != VA_STATUS_SUCCESS)
+            vawr->backends[I965_DRV]->vtable.vaDestroyImage(GET_DRVCTX(vawr, I965_DRV), out_image->image_id);
+    }
 
 	return vaStatus;
 }
@@ -825,13 +2274,20 @@ VAStatus vawr_DeriveImage(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, surface);
     VASurfaceID vawr_surface;
     vawr_surface_lookup_t *surface_lookup;
-
-    GET_SURFACEID(vawr, surface_lookup, surface, vawr_surface);
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaDeriveImage(ctx, vawr_surface, out_image));
-    RESTORE_VAWRDATA(ctx, vawr);
+    int drv = vawr_surface_drv(vawr, surface);
+
+    vawr_waitSurface(vawr, surface, 0);
+    vawr_fenceSurface(vawr, vawr_lookup(vawr, &vawr->surfaces, surface), surface, drv, 0);
+    GET_SURFACEID(vawr, drv, surface_lookup, surface, vawr_surface);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaDeriveImage, vawr_surface, out_image);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        vaStatus = vawr_image_add(vawr, drv, out_image);
+        if (vaStatus != VA_STATUS_SUCCESS)
+            vawr->backends[drv]->vtable.vaDestroyImage(GET_DRVCTX(vawr, drv), out_image->image_id);
+    }
 
 	return vaStatus;
 }
@@ -841,10 +2297,25 @@ vawr_DestroyImage(VADriverContextP ctx, VAImageID image)
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_image *obj_image;
+    struct vawr_buffer *obj_buffer = NULL;
+
+    CHECK_OBJECT(vawr, image, image, obj_image, VA_STATUS_ERROR_INVALID_IMAGE);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaDestroyImage(ctx, image));
-    RESTORE_VAWRDATA(ctx, vawr);
+    if (obj_image)
+        obj_buffer = GET_OBJECT(vawr, buffer, obj_image->buf_id);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(image), vaStatus, vaDestroyImage, VAWR_ID_DRV_ID(image));
+
+    if (vaStatus == VA_STATUS_SUCCESS && obj_image) {
+        /* The backend destroys the image's data buffer along with it */
+        if (obj_buffer) {
+            vawr_object_remove(vawr, vawr->buffers, &obj_buffer->base);
+            free(obj_buffer);
+        }
+        vawr_object_remove(vawr, vawr->images, &obj_image->base);
+        free(obj_image);
+    }
 
 	return vaStatus;
 }
@@ -856,10 +2327,12 @@ vawr_SetImagePalette(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_image *obj_image;
+
+    CHECK_OBJECT(vawr, image, image, obj_image, VA_STATUS_ERROR_INVALID_IMAGE);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaSetImagePalette(ctx, image, palette));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(image), vaStatus, vaSetImagePalette, VAWR_ID_DRV_ID(image), palette);
 
 	return vaStatus;
 }
@@ -875,13 +2348,19 @@ vawr_GetImage(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, surface);
+    struct vawr_image *obj_image;
     VASurfaceID vawr_surface;
     vawr_surface_lookup_t *surface_lookup;
+    int drv = VAWR_ID_DRV(image);
 
-    GET_SURFACEID(vawr, surface_lookup, surface, vawr_surface);
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaGetImage(ctx, vawr_surface, x, y, width, height, image));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CHECK_OBJECT(vawr, image, image, obj_image, VA_STATUS_ERROR_INVALID_IMAGE);
+
+    /* The surface memory is shared, so read it through the image's backend */
+    vawr_waitSurface(vawr, surface, 0);
+    vawr_fenceSurface(vawr, vawr_lookup(vawr, &vawr->surfaces, surface), surface, drv, 0);
+    GET_SURFACEID(vawr, drv, surface_lookup, surface, vawr_surface);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaGetImage, vawr_surface, x, y, width, height, VAWR_ID_DRV_ID(image));
 
 	return vaStatus;
 }
@@ -901,13 +2380,23 @@ vawr_PutImage(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, surface);
+    struct vawr_image *obj_image;
     VASurfaceID vawr_surface;
     vawr_surface_lookup_t *surface_lookup;
+    int drv = VAWR_ID_DRV(image);
+
+    CHECK_OBJECT(vawr, image, image, obj_image, VA_STATUS_ERROR_INVALID_IMAGE);
 
-    GET_SURFACEID(vawr, surface_lookup, surface, vawr_surface);
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaPutImage(ctx, vawr_surface, image, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height));
-    RESTORE_VAWRDATA(ctx, vawr);
+    vawr_waitSurface(vawr, surface, 0);
+    vawr_fenceSurface(vawr, vawr_lookup(vawr, &vawr->surfaces, surface), surface, drv, 1);
+    GET_SURFACEID(vawr, drv, surface_lookup, surface, vawr_surface);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaPutImage, vawr_surface, VAWR_ID_DRV_ID(image), src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height);
+
+    /* The backend may still be writing the image into the surface */
+    if (vawr->surface_states) {
+        surface_state_forget(vawr->surface_states, surface);
+    }
 
 	return vaStatus;
 }
@@ -920,10 +2409,9 @@ vawr_QuerySubpictureFormats(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaQuerySubpictureFormats(ctx, format_list, flags, num_formats));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaQuerySubpictureFormats, format_list, flags, num_formats);
 
 	return vaStatus;
 }
@@ -935,10 +2423,33 @@ vawr_CreateSubpicture(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_image *obj_image;
+    struct vawr_subpicture *obj_subpic = NULL;
+    VASubpictureID drv_subpic;
+    int drv = VAWR_ID_DRV(image);
+
+    CHECK_OBJECT(vawr, image, image, obj_image, VA_STATUS_ERROR_INVALID_IMAGE);
+
+    if (obj_image) {
+        obj_subpic = calloc(1, sizeof(*obj_subpic));
+        if (!obj_subpic)
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        obj_subpic->image_id = image;
+    }
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaCreateSubpicture(ctx, image, subpicture));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaCreateSubpicture, VAWR_ID_DRV_ID(image), &drv_subpic);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        vaStatus = vawr_object_add(vawr, vawr->subpictures, obj_subpic ? &obj_subpic->base : NULL, drv, drv_subpic);
+        if (vaStatus == VA_STATUS_SUCCESS)
+            *subpicture = VAWR_ID(drv, drv_subpic);
+        else
+            vawr->backends[drv]->vtable.vaDestroySubpicture(GET_DRVCTX(vawr, drv), drv_subpic);
+    }
+
+    if (vaStatus != VA_STATUS_SUCCESS) {
+        free(obj_subpic);
+    }
 
 	return vaStatus;
 }
@@ -949,10 +2460,17 @@ vawr_DestroySubpicture(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_subpicture *obj_subpic;
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaDestroySubpicture(ctx, subpicture));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CHECK_OBJECT(vawr, subpicture, subpicture, obj_subpic, VA_STATUS_ERROR_INVALID_SUBPICTURE);
+
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(subpicture), vaStatus, vaDestroySubpicture, VAWR_ID_DRV_ID(subpicture));
+
+    if (vaStatus == VA_STATUS_SUCCESS && obj_subpic) {
+        vawr_object_remove(vawr, vawr->subpictures, &obj_subpic->base);
+        free(obj_subpic);
+    }
 
 	return vaStatus;
 }
@@ -964,10 +2482,20 @@ vawr_SetSubpictureImage(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_subpicture *obj_subpic;
+    struct vawr_image *obj_image;
+
+    CHECK_OBJECT(vawr, subpicture, subpicture, obj_subpic, VA_STATUS_ERROR_INVALID_SUBPICTURE);
+    CHECK_OBJECT(vawr, image, image, obj_image, VA_STATUS_ERROR_INVALID_IMAGE);
+    if (VAWR_ID_DRV(image) != VAWR_ID_DRV(subpicture))
+        return VA_STATUS_ERROR_INVALID_IMAGE;
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaSetSubpictureImage(ctx, subpicture, image));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(subpicture), vaStatus, vaSetSubpictureImage, VAWR_ID_DRV_ID(subpicture), VAWR_ID_DRV_ID(image));
+
+    if (vaStatus == VA_STATUS_SUCCESS && obj_subpic) {
+        obj_subpic->image_id = image;
+    }
 
 	return vaStatus;
 }
@@ -981,10 +2509,12 @@ vawr_SetSubpictureChromakey(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_subpicture *obj_subpic;
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaSetSubpictureChromakey(ctx, subpicture, chromakey_min, chromakey_max, chromakey_mask));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CHECK_OBJECT(vawr, subpicture, subpicture, obj_subpic, VA_STATUS_ERROR_INVALID_SUBPICTURE);
+
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(subpicture), vaStatus, vaSetSubpictureChromakey, VAWR_ID_DRV_ID(subpicture), chromakey_min, chromakey_max, chromakey_mask);
 
 	return vaStatus;
 }
@@ -996,10 +2526,12 @@ vawr_SetSubpictureGlobalAlpha(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_subpicture *obj_subpic;
+
+    CHECK_OBJECT(vawr, subpicture, subpicture, obj_subpic, VA_STATUS_ERROR_INVALID_SUBPICTURE);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaSetSubpictureGlobalAlpha(ctx, subpicture, global_alpha));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, VAWR_ID_DRV(subpicture), vaStatus, vaSetSubpictureGlobalAlpha, VAWR_ID_DRV_ID(subpicture), global_alpha);
 
 	return vaStatus;
 }
@@ -1025,10 +2557,20 @@ vawr_AssociateSubpicture(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_subpicture *obj_subpic;
+    VASurfaceID vawr_surfaces[num_surfaces > 0 ? num_surfaces : 1];
+    vawr_surface_lookup_t *surface_lookup;
+    int drv = VAWR_ID_DRV(subpicture);
+    int i;
+
+    CHECK_OBJECT(vawr, subpicture, subpicture, obj_subpic, VA_STATUS_ERROR_INVALID_SUBPICTURE);
+
+    for (i = 0; i < num_surfaces; i++) {
+        GET_SURFACEID(vawr, drv, surface_lookup, target_surfaces[i], vawr_surfaces[i]);
+    }
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaAssociateSubpicture(ctx, subpicture, target_surfaces, num_surfaces, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height, flags));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaAssociateSubpicture, VAWR_ID_DRV_ID(subpicture), vawr_surfaces, num_surfaces, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height, flags);
 
 	return vaStatus;
 }
@@ -1041,10 +2583,20 @@ vawr_DeassociateSubpicture(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
+    struct vawr_subpicture *obj_subpic;
+    VASurfaceID vawr_surfaces[num_surfaces > 0 ? num_surfaces : 1];
+    vawr_surface_lookup_t *surface_lookup;
+    int drv = VAWR_ID_DRV(subpicture);
+    int i;
+
+    CHECK_OBJECT(vawr, subpicture, subpicture, obj_subpic, VA_STATUS_ERROR_INVALID_SUBPICTURE);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaDeassociateSubpicture(ctx, subpicture, target_surfaces, num_surfaces));
-    RESTORE_VAWRDATA(ctx, vawr);
+    for (i = 0; i < num_surfaces; i++) {
+        GET_SURFACEID(vawr, drv, surface_lookup, target_surfaces[i], vawr_surfaces[i]);
+    }
+
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaDeassociateSubpicture, VAWR_ID_DRV_ID(subpicture), vawr_surfaces, num_surfaces);
 
 	return vaStatus;
 }
@@ -1056,10 +2608,9 @@ vawr_QueryDisplayAttributes(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaQueryDisplayAttributes(ctx, attr_list, num_attributes));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaQueryDisplayAttributes, attr_list, num_attributes);
 
 	return vaStatus;
 
@@ -1072,10 +2623,9 @@ vawr_GetDisplayAttributes(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaGetDisplayAttributes(ctx, attr_list, num_attributes));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaGetDisplayAttributes, attr_list, num_attributes);
 
 	return vaStatus;
 
@@ -1088,10 +2638,9 @@ vawr_SetDisplayAttributes(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, VA_INVALID_ID);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaSetDisplayAttributes(ctx, attr_list, num_attributes));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, I965_DRV, vaStatus, vaSetDisplayAttributes, attr_list, num_attributes);
 
 	return vaStatus;
 
@@ -1111,14 +2660,16 @@ VAStatus vawr_LockSurface(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, surface);
     VASurfaceID vawr_render_target;
     vawr_surface_lookup_t *surface_lookup;
+    int drv = vawr_surface_drv(vawr, surface);
 
-    GET_SURFACEID(vawr, surface_lookup, surface, vawr_render_target);
+    vawr_waitSurface(vawr, surface, 0);
+    vawr_fenceSurface(vawr, vawr_lookup(vawr, &vawr->surfaces, surface), surface, drv, 0);
+    GET_SURFACEID(vawr, drv, surface_lookup, surface, vawr_render_target);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaLockSurface(ctx, vawr_render_target, fourcc, luma_stride, chroma_u_stride, chroma_v_stride, luma_offset, chroma_u_offset, chroma_v_offset, buffer_name, buffer));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaLockSurface, vawr_render_target, fourcc, luma_stride, chroma_u_stride, chroma_v_stride, luma_offset, chroma_u_offset, chroma_v_offset, buffer_name, buffer);
 
     return vaStatus;
 }
@@ -1129,18 +2680,95 @@ VAStatus vawr_UnlockSurface(VADriverContextP ctx,
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr = GET_VAWRDATA(ctx);
+    TRACE_SCOPE(vawr->trace, VA_INVALID_ID, surface);
     VASurfaceID vawr_render_target;
     vawr_surface_lookup_t *surface_lookup;
+    int drv = vawr_surface_drv(vawr, surface);
 
-    GET_SURFACEID(vawr, surface_lookup, surface, vawr_render_target);
+    GET_SURFACEID(vawr, drv, surface_lookup, surface, vawr_render_target);
 
-    RESTORE_DRVDATA(ctx, vawr);
-    CALL_DRVVTABLE(vawr, vaStatus, vaUnlockSurface( ctx, vawr_render_target));
-    RESTORE_VAWRDATA(ctx, vawr);
+    CALL_DRVVTABLE(vawr, drv, vaStatus, vaUnlockSurface, vawr_render_target);
 
     return vaStatus;
 }
 
+/* Until the first config of another backend is created every object belongs
+ * to i965, and
+ * the wrapper would only pass the calls on. So unless something has to see
+ * every call (stats, trace, capture, async), libva is first handed a table of
+ * forwarders straight to i965, and vawr_CreateConfig switches ctx->vtable
+ * to the vawr_* functions. Those handle i965's objects exactly like the
+ * forwarders do, see struct vawr_object, so calls other threads are making
+ * through the old table at that moment are still right.
+ * LIBVA_WRAPPER_DIRECT=0 always uses the vawr_* functions.
+ */
+#define VAWR_EXPAND(...)	__VA_ARGS__
+#define VAWR_DIRECT_FUNC(func, params, args)	\
+static VAStatus	\
+vawr_direct_##func params	\
+{	\
+    struct vawr_backend *i965 = ((struct vawr_driver_data *)GET_VAWRDATA(ctx))->backends[I965_DRV];	\
+	\
+    return i965->vtable.va##func(&i965->ctx, VAWR_EXPAND args);	\
+}
+#define VAWR_DIRECT_FUNCS(X)	\
+    X(DestroyConfig, (VADriverContextP ctx, VAConfigID config_id), (config_id))	\
+    X(QueryConfigAttributes, (VADriverContextP ctx, VAConfigID config_id, VAProfile *profile, VAEntrypoint *entrypoint, VAConfigAttrib *attrib_list, int *num_attribs), (config_id, profile, entrypoint, attrib_list, num_attribs))	\
+    X(CreateSurfaces, (VADriverContextP ctx, int width, int height, int format, int num_surfaces, VASurfaceID *surfaces), (width, height, format, num_surfaces, surfaces))	\
+    X(DestroySurfaces, (VADriverContextP ctx, VASurfaceID *surface_list, int num_surfaces), (surface_list, num_surfaces))	\
+    X(CreateContext, (VADriverContextP ctx, VAConfigID config_id, int picture_width, int picture_height, int flag, VASurfaceID *render_targets, int num_render_targets, VAContextID *context), (config_id, picture_width, picture_height, flag, render_targets, num_render_targets, context))	\
+    X(DestroyContext, (VADriverContextP ctx, VAContextID context), (context))	\
+    X(CreateBuffer, (VADriverContextP ctx, VAContextID context, VABufferType type, unsigned int size, unsigned int num_elements, void *data, VABufferID *buf_id), (context, type, size, num_elements, data, buf_id))	\
+    X(BufferSetNumElements, (VADriverContextP ctx, VABufferID buf_id, unsigned int num_elements), (buf_id, num_elements))	\
+    X(BufferInfo, (VADriverContextP ctx, VABufferID buf_id, VABufferType *type, unsigned int *size, unsigned int *num_elements), (buf_id, type, size, num_elements))	\
+    X(MapBuffer, (VADriverContextP ctx, VABufferID buf_id, void **pbuf), (buf_id, pbuf))	\
+    X(UnmapBuffer, (VADriverContextP ctx, VABufferID buf_id), (buf_id))	\
+    X(DestroyBuffer, (VADriverContextP ctx, VABufferID buffer_id), (buffer_id))	\
+    X(BeginPicture, (VADriverContextP ctx, VAContextID context, VASurfaceID render_target), (context, render_target))	\
+    X(RenderPicture, (VADriverContextP ctx, VAContextID context, VABufferID *buffers, int num_buffers), (context, buffers, num_buffers))	\
+    X(EndPicture, (VADriverContextP ctx, VAContextID context), (context))	\
+    X(SyncSurface, (VADriverContextP ctx, VASurfaceID render_target), (render_target))	\
+    X(QuerySurfaceStatus, (VADriverContextP ctx, VASurfaceID render_target, VASurfaceStatus *status), (render_target, status))	\
+    X(PutSurface, (VADriverContextP ctx, VASurfaceID surface, void *draw, short srcx, short srcy, unsigned short srcw, unsigned short srch, short destx, short desty, unsigned short destw, unsigned short desth, VARectangle *cliprects, unsigned int number_cliprects, unsigned int flags), (surface, draw, srcx, srcy, srcw, srch, destx, desty, destw, desth, cliprects, number_cliprects, flags))	\
+    X(QueryImageFormats, (VADriverContextP ctx, VAImageFormat *format_list, int *num_formats), (format_list, num_formats))	\
+    X(CreateImage, (VADriverContextP ctx, VAImageFormat *format, int width, int height, VAImage *image), (format, width, height, image))	\
+    X(DeriveImage, (VADriverContextP ctx, VASurfaceID surface, VAImage *image), (surface, image))	\
+    X(DestroyImage, (VADriverContextP ctx, VAImageID image), (image))	\
+    X(SetImagePalette, (VADriverContextP ctx, VAImageID image, unsigned char *palette), (image, palette))	\
+    X(GetImage, (VADriverContextP ctx, VASurfaceID surface, int x, int y, unsigned int width, unsigned int height, VAImageID image), (surface, x, y, width, height, image))	\
+    X(PutImage, (VADriverContextP ctx, VASurfaceID surface, VAImageID image, int src_x, int src_y, unsigned int src_width, unsigned int src_height, int dest_x, int dest_y, unsigned int dest_width, unsigned int dest_height), (surface, image, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height))	\
+    X(QuerySubpictureFormats, (VADriverContextP ctx, VAImageFormat *format_list, unsigned int *flags, unsigned int *num_formats), (format_list, flags, num_formats))	\
+    X(CreateSubpicture, (VADriverContextP ctx, VAImageID image, VASubpictureID *subpicture), (image, subpicture))	\
+    X(DestroySubpicture, (VADriverContextP ctx, VASubpictureID subpicture), (subpicture))	\
+    X(SetSubpictureImage, (VADriverContextP ctx, VASubpictureID subpicture, VAImageID image), (subpicture, image))	\
+    X(SetSubpictureChromakey, (VADriverContextP ctx, VASubpictureID subpicture, unsigned int chromakey_min, unsigned int chromakey_max, unsigned int chromakey_mask), (subpicture, chromakey_min, chromakey_max, chromakey_mask))	\
+    X(SetSubpictureGlobalAlpha, (VADriverContextP ctx, VASubpictureID subpicture, float global_alpha), (subpicture, global_alpha))	\
+    X(AssociateSubpicture, (VADriverContextP ctx, VASubpictureID subpicture, VASurfaceID *target_surfaces, int num_surfaces, short src_x, short src_y, unsigned short src_width, unsigned short src_height, short dest_x, short dest_y, unsigned short dest_width, unsigned short dest_height, unsigned int flags), (subpicture, target_surfaces, num_surfaces, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height, flags))	\
+    X(DeassociateSubpicture, (VADriverContextP ctx, VASubpictureID subpicture, VASurfaceID *target_surfaces, int num_surfaces), (subpicture, target_surfaces, num_surfaces))	\
+    X(QueryDisplayAttributes, (VADriverContextP ctx, VADisplayAttribute *attr_list, int *num_attributes), (attr_list, num_attributes))	\
+    X(GetDisplayAttributes, (VADriverContextP ctx, VADisplayAttribute *attr_list, int num_attributes), (attr_list, num_attributes))	\
+    X(SetDisplayAttributes, (VADriverContextP ctx, VADisplayAttribute *attr_list, int num_attributes), (attr_list, num_attributes))	\
+    X(LockSurface, (VADriverContextP ctx, VASurfaceID surface, unsigned int *fourcc, unsigned int *luma_stride, unsigned int *chroma_u_stride, unsigned int *chroma_v_stride, unsigned int *luma_offset, unsigned int *chroma_u_offset, unsigned int *chroma_v_offset, unsigned int *buffer_name, void **buffer), (surface, fourcc, luma_stride, chroma_u_stride, chroma_v_stride, luma_offset, chroma_u_offset, chroma_v_offset, buffer_name, buffer))	\
+    X(UnlockSurface, (VADriverContextP ctx, VASurfaceID surface), (surface))
+
+VAWR_DIRECT_FUNCS(VAWR_DIRECT_FUNC)
+
+/* Entry points of vawr->lazy, which libva calls until i965 is loaded. They
+ * load it, then go on through the table vawr_useBackend switched to.
+ */
+#define VAWR_LAZY_FUNC(func, params, args)	\
+static VAStatus	\
+vawr_lazy_##func params	\
+{	\
+    VAStatus vaStatus = vawr_useBackend(ctx, GET_VAWRDATA(ctx), I965_DRV);	\
+	\
+    if (vaStatus != VA_STATUS_SUCCESS)	\
+        return vaStatus;	\
+    return __atomic_load_n(&ctx->vtable, __ATOMIC_ACQUIRE)->va##func(ctx, VAWR_EXPAND args);	\
+}
+
+VAWR_DIRECT_FUNCS(VAWR_LAZY_FUNC)
+
 VAStatus DLL_EXPORT
 __vaDriverInit_0_32(VADriverContextP ctx);
 
@@ -1149,93 +2777,244 @@ __vaDriverInit_0_32(  VADriverContextP ctx )
 {
     VAStatus vaStatus;
     struct vawr_driver_data *vawr;
-    struct VADriverVTable *i965_vtable = NULL;
     struct VADriverVTable * const vtable = ctx->vtable;
     char *driver_name = "i965";
+    const char *prewarm;
+    const char *sharing;
+    const char *stats;
+    const char *trace;
+    const char *capture;
+    const char *capture_data;
+    const char *direct;
+    const char *async;
+    const char *poll;
+    const char *pool;
+    const char *pitches;
+    unsigned long long pool_mb;
+    const char *routes = NULL;
+    const char *routes_file = NULL;
+    int drv;
 
     vawr = calloc(1, sizeof(*vawr));
     if (!vawr)
 	return VA_STATUS_ERROR_ALLOCATION_FAILED;
 
-    i965_vtable = calloc(1, sizeof(*i965_vtable));
-    if (!i965_vtable)
-        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    pthread_mutex_init(&vawr->backend_lock, NULL);
+    pthread_rwlock_init(&vawr->lock, NULL);
+    pthread_rwlock_init(&vawr->queues_lock, NULL);
+    LIST_INIT(&vawr->queues);
+    vawr->vtable = vtable;
+
+    /* Which backend decodes what. Like LIBVA_DRIVERS_PATH, this names the
+     * libraries to load, so it is ignored for setuid programs.
+     */
+    if (geteuid() == getuid()) {
+        routes = getenv("LIBVA_WRAPPER_ROUTES");
+        routes_file = getenv("LIBVA_WRAPPER_ROUTES_FILE");
+    }
+    if (routes && *routes)
+        vawr->routes = route_table_create(routes, driver_name, MAX_NUM_DRV, vawr_errorMessage);
+    else if (routes_file && *routes_file)
+        vawr->routes = route_table_load(routes_file, driver_name, MAX_NUM_DRV, vawr_errorMessage);
+    if (!vawr->routes) {
+        if ((routes && *routes) || (routes_file && *routes_file))
+            vawr_errorMessage("ignoring the routes, VP8 goes to pvr\n");
+        vawr->routes = route_table_create(VAWR_DEFAULT_ROUTES, driver_name, MAX_NUM_DRV, vawr_errorMessage);
+        if (!vawr->routes) {
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+            goto error;
+        }
+    }
+    vawr->num_drvs = vawr->routes->num_drvs;
+
+    /* What pitch surfaces shared between backends get */
+    pitches = getenv("LIBVA_WRAPPER_PITCHES");
+    vawr->pitches = pitch_table_create(pitches, vawr->routes->drv_names, vawr->num_drvs, vawr_errorMessage);
+    if (!vawr->pitches && pitches) {
+        vawr_errorMessage("ignoring the pitches\n");
+        vawr->pitches = pitch_table_create(NULL, vawr->routes->drv_names, vawr->num_drvs, vawr_errorMessage);
+    }
+    vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+    if (!vawr->pitches)
+        goto error;
+
+    if (object_map_init(&vawr->surfaces))
+        goto error;
+
+    for (drv = 0; drv < vawr->num_drvs; drv++) {
+        if (object_map_init(&vawr->configs[drv]) ||
+            object_map_init(&vawr->contexts[drv]) ||
+            object_map_init(&vawr->buffers[drv]) ||
+            object_map_init(&vawr->images[drv]) ||
+            object_map_init(&vawr->subpictures[drv]))
+            goto error;
+    }
+
+    sharing = getenv("LIBVA_WRAPPER_SURFACE_SHARING");
+    if (sharing && !strcmp(sharing, "prime"))
+        vawr->surface_sharing = VAWR_SHARING_PRIME;
+    else if (sharing && !strcmp(sharing, "userptr"))
+        vawr->surface_sharing = VAWR_SHARING_USERPTR;
+
+    stats = getenv("LIBVA_WRAPPER_STATS");
+    if (stats && atoi(stats) > 0)
+        vawr->stats = call_stats_create(vawr->num_drvs);
+
+    trace = getenv("LIBVA_WRAPPER_TRACE");
+    if (trace && *trace)
+        vawr->trace = trace_create(trace, vawr->routes->drv_names);
+
+    /* Surfaces released by vaDestroySurfaces, handed out again by
+     * vaCreateSurfaces, see vawr_releaseSurface. Off unless asked for, as it
+     * keeps memory the application freed.
+     */
+    pool = getenv("LIBVA_WRAPPER_SURFACE_POOL_MB");
+    pool_mb = pool ? strtoull(pool, NULL, 0) : 0;
+    if (pool_mb)
+        vawr->surface_pool = surface_pool_create(pool_mb << 20, vawr_freeSurface, vawr);
+
+    /* Known to be done surfaces, see vawr_SyncSurface. Only asked for, as
+     * it trusts that every picture goes through the wrapper.
+     */
+    poll = getenv("LIBVA_WRAPPER_POLL_US");
+    if (poll && *poll)
+        vawr->surface_states = surface_state_create(strtoull(poll, NULL, 0) * 1000,
+                                                    vawr_surfaceReady, vawr);
+
+    async = getenv("LIBVA_WRAPPER_ASYNC");
+    vawr->async = async && atoi(async) > 0;
+
+    /* Capture has to see every call and pre-warming starts from i965's copy
+     * of ctx, otherwise i965 can wait for the first call that needs it.
+     */
+    capture = getenv("LIBVA_WRAPPER_CAPTURE");
+    prewarm = getenv("LIBVA_WRAPPER_PREWARM");
+    vaStatus = vawr_loadCaps(ctx, vawr, !(capture && *capture) && !(prewarm && atoi(prewarm) > 0));
+    if (vaStatus != VA_STATUS_SUCCESS)
+        goto error;
+
+    /* Publish the limits i965 reported in its copy of ctx, or saved along
+     * with the capabilities, to libva.
+     */
+    ctx->version_major = vawr->limits.version_major;
+    ctx->version_minor = vawr->limits.version_minor;
+    ctx->max_profiles = vawr->limits.max_profiles;
+    ctx->max_entrypoints = vawr->limits.max_entrypoints;
+    ctx->max_attributes = vawr->limits.max_attributes;
+    ctx->max_image_formats = vawr->limits.max_image_formats;
+    ctx->max_subpic_formats = vawr->limits.max_subpic_formats;
+    ctx->max_display_attributes = vawr->limits.max_display_attributes;
+    ctx->str_vendor = vawr->limits.vendor;
+
+    /* Make room for the profiles and entrypoints routed to the other backends */
+    ctx->max_profiles = ctx->max_profiles + vawr->routes->num_routes;
+    ctx->max_entrypoints = ctx->max_entrypoints + vawr->routes->num_routes;
+
+    /* Populate va wrapper's vtable */
+    vtable->vaTerminate = vawr_Terminate;
+    vtable->vaQueryConfigEntrypoints = vawr_QueryConfigEntrypoints;
+    vtable->vaQueryConfigProfiles = vawr_QueryConfigProfiles;
+    vtable->vaQueryConfigEntrypoints = vawr_QueryConfigEntrypoints;
+    vtable->vaQueryConfigAttributes = vawr_QueryConfigAttributes;
+    vtable->vaCreateConfig = vawr_CreateConfig;
+    vtable->vaDestroyConfig = vawr_DestroyConfig;
+    vtable->vaGetConfigAttributes = vawr_GetConfigAttributes;
+    vtable->vaCreateSurfaces = vawr_CreateSurfaces;
+    vtable->vaDestroySurfaces = vawr_DestroySurfaces;
+    vtable->vaCreateContext = vawr_CreateContext;
+    vtable->vaDestroyContext = vawr_DestroyContext;
+    vtable->vaCreateBuffer = vawr_CreateBuffer;
+    vtable->vaBufferSetNumElements = vawr_BufferSetNumElements;
+    vtable->vaBufferInfo = vawr_BufferInfo;
+    vtable->vaMapBuffer = vawr_MapBuffer;
+    vtable->vaUnmapBuffer = vawr_UnmapBuffer;
+    vtable->vaDestroyBuffer = vawr_DestroyBuffer;
+    vtable->vaBeginPicture = vawr_BeginPicture;
+    vtable->vaRenderPicture = vawr_RenderPicture;
+    vtable->vaEndPicture = vawr_EndPicture;
+    vtable->vaSyncSurface = vawr_SyncSurface;
+    vtable->vaQuerySurfaceStatus = vawr_QuerySurfaceStatus;
+    vtable->vaPutSurface = vawr_PutSurface;
+    vtable->vaQueryImageFormats = vawr_QueryImageFormats;
+    vtable->vaCreateImage = vawr_CreateImage;
+    vtable->vaDeriveImage = vawr_DeriveImage;
+    vtable->vaDestroyImage = vawr_DestroyImage;
+    vtable->vaSetImagePalette = vawr_SetImagePalette;
+    vtable->vaGetImage = vawr_GetImage;
+    vtable->vaPutImage = vawr_PutImage;
+    vtable->vaQuerySubpictureFormats = vawr_QuerySubpictureFormats;
+    vtable->vaCreateSubpicture = vawr_CreateSubpicture;
+    vtable->vaDestroySubpicture = vawr_DestroySubpicture;
+    vtable->vaSetSubpictureImage = vawr_SetSubpictureImage;
+    vtable->vaSetSubpictureChromakey = vawr_SetSubpictureChromakey;
+    vtable->vaSetSubpictureGlobalAlpha = vawr_SetSubpictureGlobalAlpha;
+    vtable->vaAssociateSubpicture = vawr_AssociateSubpicture;
+    vtable->vaDeassociateSubpicture = vawr_DeassociateSubpicture;
+    vtable->vaQueryDisplayAttributes = vawr_QueryDisplayAttributes;
+    vtable->vaGetDisplayAttributes = vawr_GetDisplayAttributes;
+    vtable->vaSetDisplayAttributes = vawr_SetDisplayAttributes;
+    vtable->vaLockSurface = vawr_LockSurface;
+    vtable->vaUnlockSurface= vawr_UnlockSurface;
+
+    /* Log what the application asks for, to replay it later with
+     * bench/vawr_replay. This has to be the last change to vtable.
+     */
+    if (capture && *capture) {
+        capture_data = getenv("LIBVA_WRAPPER_CAPTURE_DATA");
+        vawr->capture = capture_create(capture,
+                                       capture_data && atoi(capture_data) > 0 ? CAPTURE_FLAG_DATA : 0,
+                                       vtable);
+    }
 
-    /* Store i965_ctx into wrapper's private driver data
-     * It will later be used when i965 VA API is called
+    /* The other backends are normally loaded by the first vaCreateConfig
+     * routed to them, e.g. pvr by the first VP8 one, which puts their
+     * dlopen and init on the first frame. Optionally start loading them
+     * right away in the background instead.
      */
+    if (prewarm && atoi(prewarm) > 0)
+        vawr->prewarm_started = !pthread_create(&vawr->prewarm_thread, NULL, vawr_prewarmThread, vawr);
+
+    /* Hand libva the i965 only table until the first config elsewhere */
+    direct = getenv("LIBVA_WRAPPER_DIRECT");
+    if (!vawr->stats && !vawr->trace && !vawr->capture && !vawr->async &&
+        !vawr->surface_states && !(direct && atoi(direct) == 0)) {
+        vawr->direct = *vtable;
+#define X(func, params, args)	vawr->direct.va##func = vawr_direct_##func;
+        VAWR_DIRECT_FUNCS(X)
+#undef X
+        /* The pool keeps the layout of i965's surfaces too */
+        if (vawr->surface_pool) {
+            vawr->direct.vaCreateSurfaces = vawr_CreateSurfaces;
+            vawr->direct.vaDestroySurfaces = vawr_DestroySurfaces;
+        }
+        vawr->primary_vtable = &vawr->direct;
+    } else {
+        vawr->primary_vtable = vtable;
+    }
 
-    /* By default we should load and initialize OTC's i965 video driver */
-
-    /* First, hook i965_vtable to ctx so that i965_drv_video uses it. */
-    ctx->vtable = i965_vtable;
-
-    /* Then, load the i965 driver */
-    vaStatus = vawr_openDriver(ctx, driver_name);
-    if (VA_STATUS_SUCCESS == vaStatus) {
-	/* We have successfully initialized i965 video driver,
-	 * Let's store i965's private driver data and vtable.
-	 */
-        vawr->drv_data[I965_DRV] = (void *)ctx->pDriverData;
-        vawr->drv_vtable[I965_DRV] = i965_vtable;
-        vawr->profile = VAProfileNone;
-
-        /* Also restore the va's vtable */
-        ctx->vtable = vtable;
-
-        /* Increase max num of profiles and entrypoints for PSB's VP8 profile */
-        ctx->max_profiles = ctx->max_profiles + 1;
-        ctx->max_entrypoints = ctx->max_entrypoints + 1;
-
-        /* Populate va wrapper's vtable */
-        vtable->vaTerminate = vawr_Terminate;
-        vtable->vaQueryConfigEntrypoints = vawr_QueryConfigEntrypoints;
-        vtable->vaQueryConfigProfiles = vawr_QueryConfigProfiles;
-        vtable->vaQueryConfigEntrypoints = vawr_QueryConfigEntrypoints;
-        vtable->vaQueryConfigAttributes = vawr_QueryConfigAttributes;
-        vtable->vaCreateConfig = vawr_CreateConfig;
-        vtable->vaDestroyConfig = vawr_DestroyConfig;
-        vtable->vaGetConfigAttributes = vawr_GetConfigAttributes;
-        vtable->vaCreateSurfaces = vawr_CreateSurfaces;
-        vtable->vaDestroySurfaces = vawr_DestroySurfaces;
-        vtable->vaCreateContext = vawr_CreateContext;
-        vtable->vaDestroyContext = vawr_DestroyContext;
-        vtable->vaCreateBuffer = vawr_CreateBuffer;
-        vtable->vaBufferSetNumElements = vawr_BufferSetNumElements;
-        vtable->vaBufferInfo = vawr_BufferInfo;
-        vtable->vaMapBuffer = vawr_MapBuffer;
-        vtable->vaUnmapBuffer = vawr_UnmapBuffer;
-        vtable->vaDestroyBuffer = vawr_DestroyBuffer;
-        vtable->vaBeginPicture = vawr_BeginPicture;
-        vtable->vaRenderPicture = vawr_RenderPicture;
-        vtable->vaEndPicture = vawr_EndPicture;
-        vtable->vaSyncSurface = vawr_SyncSurface;
-        vtable->vaQuerySurfaceStatus = vawr_QuerySurfaceStatus;
-        vtable->vaPutSurface = vawr_PutSurface;
-        vtable->vaQueryImageFormats = vawr_QueryImageFormats;
-        vtable->vaCreateImage = vawr_CreateImage;
-        vtable->vaDeriveImage = vawr_DeriveImage;
-        vtable->vaDestroyImage = vawr_DestroyImage;
-        vtable->vaSetImagePalette = vawr_SetImagePalette;
-        vtable->vaGetImage = vawr_GetImage;
-        vtable->vaPutImage = vawr_PutImage;
-        vtable->vaQuerySubpictureFormats = vawr_QuerySubpictureFormats;
-        vtable->vaCreateSubpicture = vawr_CreateSubpicture;
-        vtable->vaDestroySubpicture = vawr_DestroySubpicture;
-        vtable->vaSetSubpictureImage = vawr_SetSubpictureImage;
-        vtable->vaSetSubpictureChromakey = vawr_SetSubpictureChromakey;
-        vtable->vaSetSubpictureGlobalAlpha = vawr_SetSubpictureGlobalAlpha;
-        vtable->vaAssociateSubpicture = vawr_AssociateSubpicture;
-        vtable->vaDeassociateSubpicture = vawr_DeassociateSubpicture;
-        vtable->vaQueryDisplayAttributes = vawr_QueryDisplayAttributes;
-        vtable->vaGetDisplayAttributes = vawr_GetDisplayAttributes;
-        vtable->vaSetDisplayAttributes = vawr_SetDisplayAttributes;
-        vtable->vaLockSurface = vawr_LockSurface;
-        vtable->vaUnlockSurface= vawr_UnlockSurface;
+    /* Until i965 is loaded, see vawr_useBackend. vaCreateConfig stays
+     * vawr_CreateConfig, so a config routed elsewhere loads only its
+     * own backend.
+     */
+    if (!vawr->backends[I965_DRV]) {
+        vawr->lazy = *vawr->primary_vtable;
+#define X(func, params, args)	vawr->lazy.va##func = vawr_lazy_##func;
+        VAWR_DIRECT_FUNCS(X)
+#undef X
+        ctx->vtable = &vawr->lazy;
+    } else {
+        ctx->vtable = vawr->primary_vtable;
     }
 
     /* Store wrapper's private driver data*/
     ctx->pDriverData = (void *)vawr;
 
     return vaStatus;
+
+error:
+    /* libva does not call vaTerminate after a failed init */
+    surface_state_destroy(vawr->surface_states);
+    vawr_unloadBackends(vawr);
+    vawr_destroy(vawr);
+    return vaStatus;
 }
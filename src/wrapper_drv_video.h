@@ -30,22 +30,54 @@
 #include <va/va.h>
 #include <va/va_backend.h>
 #include <va/va_dec_vp8.h>
+#include <va/va_drmcommon.h>
+
+#include <pthread.h>
 
 #include "list.h"
+#include "call_stats.h"
+#include "capture.h"
+#include "caps.h"
+#include "driver_registry.h"
+#include "object_map.h"
+#include "param_buffer.h"
+#include "pitch.h"
+#include "route.h"
+#include "submit_queue.h"
+#include "surface_pool.h"
+#include "surface_state.h"
+#include "trace.h"
 
 #define DLL_EXPORT __attribute__((visibility("default")))
 
-#define MAX_NUM_DRV	2
+/* IDs leave room for 8 backends, see VAWR_DRV_SHIFT */
+#define MAX_NUM_DRV	8
 
+/* The primary backend allocates every surface, the others decode into them
+ * through surfaces of their own that share the memory, see
+ * vawr_surface_lookup_t. Which backend a config goes to is decided by the
+ * routes, see LIBVA_WRAPPER_ROUTES.
+ */
 #define I965_DRV	0
-#define PSB_DRV		1
+
+void vawr_errorMessage(const char *msg, ...);
+void vawr_infoMessage(const char *msg, ...);
 
 #define GET_VAWRDATA(ctx)    ctx->pDriverData
-#define RESTORE_VAWRDATA(ctx, vawr)	ctx->pDriverData = vawr
-#define RESTORE_I965DATA(ctx, vawr) ctx->pDriverData = vawr->drv_data[I965_DRV]
-#define RESTORE_PSBDATA(ctx, vawr)	ctx->pDriverData = vawr->drv_data[PSB_DRV]
-#define RESTORE_DRVDATA(ctx, vawr)	ctx->pDriverData = vawr->profile == VAProfileVP8Version0_3 ? vawr->drv_data[PSB_DRV] : vawr->drv_data[I965_DRV]
-#define CALL_DRVVTABLE(vawr, status, param) status = ((vawr->profile == VAProfileVP8Version0_3) ? vawr->drv_vtable[PSB_DRV]->param : vawr->drv_vtable[I965_DRV]->param)
+/* Every backend runs on its own shadow copy of the VADriverContext, so the
+ * ctx handed in by libva is never modified after initialization and calls
+ * from several threads can be dispatched without serializing them.
+ */
+#define GET_DRVCTX(vawr, drv)	(&(vawr)->backends[drv]->ctx)
+#define CALL_DRVVTABLE(vawr, drv, status, func, ...)	\
+	do {	\
+		uint64_t vawr_start = (vawr)->stats || (vawr)->trace ? call_stats_now() : 0;	\
+		status = (vawr)->backends[drv]->vtable.func(GET_DRVCTX(vawr, drv), ##__VA_ARGS__);	\
+		if ((vawr)->stats)	\
+			call_stats_record((vawr)->stats, drv, CALL_STATS_##func, vawr_start);	\
+		if ((vawr)->trace)	\
+			trace_call((vawr)->trace, drv, #func, vawr_start);	\
+	} while (0)
 #define CHECK_INVALID_PARAM(param) \
     do { \
         if (param) { \
@@ -54,13 +86,44 @@
             return vaStatus; \
         } \
     } while (0)
-#define GET_SURFACEID(vawr, surface_lookup, surface, surface_out)	\
-	if (vawr->profile == VAProfileVP8Version0_3) {	\
-		LIST_FOR_EACH_ENTRY(surface_lookup, &vawr->surfaces, link) 	\
-				if (surface_lookup->i965_surface == surface) 	\
-					surface_out = surface_lookup->pvr_surface;	\
-	} else 	\
+#define GET_SURFACEID(vawr, drv, surface_lookup, surface, surface_out)	\
+	if (drv != I965_DRV &&	\
+	    (surface_lookup = vawr_lookup(vawr, &vawr->surfaces, surface)) &&	\
+	    surface_lookup->drv_surfaces[drv] != VA_INVALID_SURFACE)	\
+		surface_out = surface_lookup->drv_surfaces[drv];	\
+	else	\
 		surface_out = surface
+/* Look up the wrapper's record of an application visible object ID */
+#define GET_OBJECT(vawr, type, id)	((struct vawr_##type *)vawr_lookupObject(vawr, vawr->type##s, id))
+/* Set obj to the record of id, NULL for objects of I965_DRV, which have
+ * none, and return error if id is not an object of a loaded backend.
+ */
+#define CHECK_OBJECT(vawr, type, id, obj, error)	\
+    do { \
+        obj = NULL; \
+        if (VAWR_ID_DRV(id) >= (vawr)->num_drvs) \
+            return error; \
+        if (VAWR_ID_DRV(id) != I965_DRV && \
+            !(obj = GET_OBJECT(vawr, type, id))) \
+            return error; \
+    } while (0)
+
+/* How i965 surfaces are shared with the other backends, see LIBVA_WRAPPER_SURFACE_SHARING */
+#define VAWR_SHARING_AUTO	0	/* PRIME, falling back to USER_PTR */
+#define VAWR_SHARING_PRIME	1
+#define VAWR_SHARING_USERPTR	2
+
+/* The application sees a backend's object IDs with the index of the backend
+ * in the top bits, so the owner of any ID is a shift away. Backends build
+ * their IDs from an object heap whose type offsets stay below bit 29, and
+ * IDs of I965_DRV are passed through unchanged, so IDs the application puts
+ * into i965's parameter buffers need no rewriting.
+ */
+#define VAWR_DRV_SHIFT		29
+#define VAWR_DRV_ID_MASK	((1u << VAWR_DRV_SHIFT) - 1)
+#define VAWR_ID(drv, drv_id)	(((VAGenericID)(drv) << VAWR_DRV_SHIFT) | (drv_id))
+#define VAWR_ID_DRV(id)		((int)((id) >> VAWR_DRV_SHIFT))
+#define VAWR_ID_DRV_ID(id)	((id) & VAWR_DRV_ID_MASK)
 
 /* Linked list macro to list.h */
 #define LIST list
@@ -73,18 +136,183 @@
 #define LIST_FOR_EACH_ENTRY_SAFE list_for_each_entry_safe
 
 
+struct vawr_backend
+{
+	struct VADriverContext ctx;	/* shadow of libva's ctx, owned by the backend */
+	struct VADriverVTable vtable;
+	struct driver_entry *driver;	/* library the backend was loaded from */
+};
+
+/* How busy a backend is, see vawr_pickBackend. Only kept up to date once a
+ * config can go to several backends.
+ */
+struct vawr_load
+{
+	int contexts;			/* live contexts with a record */
+	uint64_t busy_ns;		/* time in vaEndPicture and vaSyncSurface, per context */
+	uint64_t frames;		/* vaEndPicture calls busy_ns covers */
+};
+
 struct vawr_driver_data
 {
-	void *drv_data[MAX_NUM_DRV];
-	struct VADriverVTable *drv_vtable[MAX_NUM_DRV];
-	struct LIST surfaces;	/* surface_id lookup table */
+	struct route_table *routes;	/* backend names and what they decode */
+	int num_drvs;			/* routes->num_drvs */
+	struct caps_table *caps;	/* answers the vaQueryConfig* calls, see vawr_buildCaps */
+	int caps_mapped;		/* caps is the cache file, see vawr_loadCaps */
+	struct caps_limits limits;	/* what i965 publishes in ctx */
+	struct vawr_backend *backends[MAX_NUM_DRV];	/* NULL until loaded */
+	pthread_mutex_t backend_lock;	/* serializes loading of backends */
+	pthread_t prewarm_thread;	/* loads the other backends in the background, see LIBVA_WRAPPER_PREWARM */
+	int prewarm_started;
+	int surface_sharing;		/* VAWR_SHARING_* */
+	struct call_stats *stats;	/* NULL unless LIBVA_WRAPPER_STATS is set */
+	struct trace *trace;		/* NULL unless LIBVA_WRAPPER_TRACE is set */
+	struct capture *capture;	/* NULL unless LIBVA_WRAPPER_CAPTURE is set */
+	int async;			/* picture calls go through a submit_queue, see LIBVA_WRAPPER_ASYNC */
+	uint64_t submit_clock;		/* stamps the calls pushed to any queue */
+	pthread_rwlock_t queues_lock;	/* protects queues, held while waiting on one */
+	struct list queues;		/* struct vawr_context with a queue */
+	struct surface_state_table *surface_states;	/* NULL unless LIBVA_WRAPPER_POLL_US is set */
+	struct surface_pool *surface_pool;	/* NULL unless LIBVA_WRAPPER_SURFACE_POOL_MB is above 0 */
+	struct pitch_table *pitches;	/* pitches of shared surfaces, see LIBVA_WRAPPER_PITCHES */
+	uint64_t shared_surfaces;	/* allocated with a pitch from pitches, counted with stats */
+	uint64_t padding;		/* bytes of those beyond their pixels */
+	struct VADriverVTable *vtable;	/* libva's table, holding the vawr_* functions */
+	struct VADriverVTable direct;	/* i965 only table, see vawr_direct_* */
+	struct VADriverVTable lazy;	/* loads i965 first, see vawr_useBackend */
+	struct VADriverVTable *primary_vtable;	/* vtable or &direct, what libva gets once i965 is loaded */
+	pthread_rwlock_t lock;		/* protects the object maps below */
+	struct object_map surfaces;	/* i965 surface_id -> vawr_surface_lookup_t */
+	/* Backend IDs -> records, one map per backend */
+	struct object_map configs[MAX_NUM_DRV];		/* struct vawr_config */
+	struct object_map contexts[MAX_NUM_DRV];	/* struct vawr_context */
+	struct object_map buffers[MAX_NUM_DRV];		/* struct vawr_buffer */
+	struct object_map images[MAX_NUM_DRV];		/* struct vawr_image */
+	struct object_map subpictures[MAX_NUM_DRV];	/* struct vawr_subpicture */
+	int num_configs[MAX_NUM_DRV];	/* live configs per backend */
+	int balanced;			/* set once a config can go to several backends */
+	struct vawr_load load[MAX_NUM_DRV];
+};
+
+static inline void *
+vawr_lookup(struct vawr_driver_data *vawr, struct object_map *map, VAGenericID id)
+{
+	void *data;
+
+	pthread_rwlock_rdlock(&vawr->lock);
+	data = object_map_lookup(map, id);
+	pthread_rwlock_unlock(&vawr->lock);
+
+	return data;
+}
+
+static inline void *
+vawr_remove(struct vawr_driver_data *vawr, struct object_map *map, VAGenericID id)
+{
+	void *data;
+
+	pthread_rwlock_wrlock(&vawr->lock);
+	data = object_map_remove(map, id);
+	pthread_rwlock_unlock(&vawr->lock);
+
+	return data;
+}
+
+static inline void *
+vawr_lookupObject(struct vawr_driver_data *vawr, struct object_map *maps, VAGenericID id)
+{
+	if (VAWR_ID_DRV(id) >= vawr->num_drvs)
+		return NULL;
+
+	return vawr_lookup(vawr, &maps[VAWR_ID_DRV(id)], VAWR_ID_DRV_ID(id));
+}
+
+/* Every config, context, buffer, image and subpicture created through the
+ * wrapper is owned by exactly one backend. The application sees id, which
+ * is VAWR_ID(drv, drv_id).
+ *
+ * Only objects of backends other than I965_DRV get a record. The IDs of
+ * i965's objects are its own and nothing else about them is needed, so
+ * calls on them go to i965 without a lookup, and objects created while the
+ * wrapper dispatched straight to i965 (see vawr_direct_*) need no records
+ * when it stops doing so. The exception are i965 contexts placed by
+ * vawr_pickBackend or with a submit_queue, whose records are only looked up
+ * for what needs them.
+ */
+struct vawr_object
+{
+	VAGenericID id;
+	VAGenericID drv_id;
+	int drv;
+};
+
+/* Drop the record of obj after its backend object has been destroyed. By
+ * then the backend may have handed the same ID out again to a create on
+ * another thread, whose record must be left alone.
+ */
+static inline void
+vawr_object_remove(struct vawr_driver_data *vawr, struct object_map *maps, struct vawr_object *obj)
+{
+	pthread_rwlock_wrlock(&vawr->lock);
+	if (object_map_lookup(&maps[obj->drv], obj->drv_id) == obj)
+		object_map_remove(&maps[obj->drv], obj->drv_id);
+	pthread_rwlock_unlock(&vawr->lock);
+}
+
+struct vawr_config
+{
+	struct vawr_object base;
+	VAProfile profile;
+	VAEntrypoint entrypoint;
+	unsigned int drvs;		/* bit per backend the config was created on, base.drv included */
+	VAConfigID drv_configs[MAX_NUM_DRV];	/* the config on each of them */
+};
+
+struct vawr_context
+{
+	struct vawr_object base;
+	VAConfigID config_id;
 	VAProfile profile;
-	VABufferID pic_param_buf_id;
+	struct vawr_driver_data *vawr;	/* for vawr_submit */
+	struct submit_queue *queue;	/* NULL unless LIBVA_WRAPPER_ASYNC is set */
+	struct list link;		/* in vawr->queues if queue is set */
 };
 
+struct vawr_buffer
+{
+	struct vawr_object base;
+	VAContextID context_id;		/* VA_INVALID_ID for image buffers */
+	VABufferType type;
+	const struct param_buffer_desc *desc;	/* surface IDs to translate, NULL if none */
+	unsigned int size;
+	unsigned int num_elements;
+	void *mapped;			/* parameters the application is filling in place */
+};
+
+struct vawr_image
+{
+	struct vawr_object base;
+	VABufferID buf_id;
+};
+
+struct vawr_subpicture
+{
+	struct vawr_object base;
+	VAImageID image_id;
+};
+
+/* An i965 surface that has been mapped into other backends, or any surface
+ * while there is a surface pool. It is owned by
+ * drv, the backend of the context it is a render target of, and calls on it
+ * go there. writer is the backend that last wrote it, which the others wait
+ * for before they touch its memory, see vawr_fenceSurface.
+ */
 typedef struct vawr_surface_lookup
 {
 	VASurfaceID	i965_surface;
-	VASurfaceID pvr_surface;
-	struct LIST link;
+	VASurfaceID drv_surfaces[MAX_NUM_DRV];	/* VA_INVALID_SURFACE if not mapped */
+	int drv;
+	int writer;
+	VAContextID context_id;		/* context the surface is a render target of */
+	struct surface_pool_key layout;	/* what it was created as, see vawr->surface_pool */
 }vawr_surface_lookup_t;